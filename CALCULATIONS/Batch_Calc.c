@@ -0,0 +1,302 @@
+// Name: Batch_Calc
+// Description: Efficiencies, powers, distance and energy over whole columns of a logged session
+
+// elec_efficiency() and fuel_efficiency() take one sample per call, which is right live but
+// slow for recomputing a season of logs. Here every column is a plain array and two rows go
+// through double SIMD lanes at once (SSE2, or NEON on aarch64 - 32 bit NEON has no double).
+//
+// Results must be the same as the Q16.16 path (Fixed_Point.h). Raw products below 2^47 are
+// exact in double and are divided once, so rounding the double quotient gives the same Q16.16
+// value - except for a quotient within 1e-6 of a half step, a saturated one, a zero
+// denominator or products too big to be exact. Those lanes are redone by the scalar row,
+// which gives NaN where the live functions give no result.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include "Fixed_Point.h"
+#include "Batch_Calc.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BATCH_ISA "sse2"
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BATCH_ISA "neon"
+#else
+#define BATCH_ISA "scalar"
+#endif
+
+// largest product that is formed exactly, same bound the scalar helpers switch path at
+#define EXACT_LIMIT     140737488355328.0       // 2^47
+// largest quotient rounded in the lanes, beyond it q16_sat() takes over
+#define ROUND_LIMIT     2147483646.0
+// a quotient below 2^31 rounded twice is within 2^-21 of the exact one,
+// closer than this to .5 goes scalar
+#define TIE_MARGIN      1e-6
+
+/*-------------------------------------------------------------*/
+// one row, exactly as elec_efficiency() / fuel_efficiency() calculate it
+
+static void elec_row(const batchCols *in, const batchOut *out, size_t i)
+{
+    q16_t mtr_PWR = q16_power_raw(in->mtr_volt[i], in->mtr_curr[i]);
+    q16_t fc_PWR = q16_power_raw(in->fc_volt[i], in->fc_curr[i]);
+
+    out->mtr_pwr[i] = q16_to_float(mtr_PWR);
+    out->fc_pwr[i] = q16_to_float(fc_PWR);
+    q16_t eff = (fc_PWR > 0) ? q16_power_ratio_raw(in->mtr_volt[i], in->mtr_curr[i], in->fc_volt[i], in->fc_curr[i])
+                             : q16_div_sat(mtr_PWR, fc_PWR);
+    out->elec_eff[i] = (fc_PWR <= 0 || q16_no_result(eff)) ? NAN : q16_to_float(eff);
+}
+
+static void fuel_row(const batchCols *in, const batchOut *out, size_t i)
+{
+    if (i == 0) {
+        out->dist[0] = 0;
+        out->energy[0] = 0;
+        out->fuel_eff[0] = 0;
+        return;
+    }
+
+    uint32_t s1 = in->speed[i - 1], s2 = in->speed[i];
+    uint32_t e1 = in->fc_joules[i - 1], e2 = in->fc_joules[i];
+    float time_diff = in->time[i] - in->time[i - 1];
+
+    out->dist[i] = (float) ((((double) s1 + (double) s2) * (double) time_diff) * 0.5e-4);
+    out->energy[i] = (float) (((double) e1 - (double) e2) * SIG_FC_JOULES_SCALE);
+    q16_t eff = q16_fuel_ratio_raw(s1, s2, e1, e2, (int64_t) lroundf(time_diff * 1e6f));
+    out->fuel_eff[i] = q16_no_result(eff) ? NAN : q16_to_float(eff);
+}
+
+void batch_calc_scalar(const batchCols *in, const batchOut *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        elec_row(in, out, i);
+        fuel_row(in, out, i);
+    }
+}
+
+const char *batch_calc_isa(void)
+{
+    return BATCH_ISA;
+}
+
+#if defined(__SSE2__) || (defined(__aarch64__) && defined(__ARM_NEON))
+/*-------------------------------------------------------------*/
+// two double lanes - the kernels below only use these
+
+#if defined(__SSE2__)
+typedef __m128d vd;
+typedef __m128d vm;
+
+static inline vd vd_set(double x) { return _mm_set1_pd(x); }
+static inline vd vd_add(vd a, vd b) { return _mm_add_pd(a, b); }
+static inline vd vd_sub(vd a, vd b) { return _mm_sub_pd(a, b); }
+static inline vd vd_mul(vd a, vd b) { return _mm_mul_pd(a, b); }
+static inline vd vd_div(vd a, vd b) { return _mm_div_pd(a, b); }
+static inline vd vd_abs(vd a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+static inline vm vd_gt(vd a, vd b) { return _mm_cmpgt_pd(a, b); }
+static inline vm vd_lt(vd a, vd b) { return _mm_cmplt_pd(a, b); }
+static inline vm vd_eq(vd a, vd b) { return _mm_cmpeq_pd(a, b); }
+static inline vm vm_or(vm a, vm b) { return _mm_or_pd(a, b); }
+static inline int vm_bits(vm m) { return _mm_movemask_pd(m); }
+
+// two uint32 -> double, SSE2 only converts signed so the top bit is moved out of the way
+static inline vd vd_u32(const uint32_t *p)
+{
+    __m128i x = _mm_xor_si128(_mm_loadl_epi64((const __m128i *) p), _mm_set1_epi32((int) 0x80000000u));
+    return _mm_add_pd(_mm_cvtepi32_pd(x), _mm_set1_pd(2147483648.0));
+}
+
+// a - b in float, like the scalar time difference, widened to double
+static inline vd vd_sub_f32(const float *a, const float *b)
+{
+    __m128 fa = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *) a));
+    __m128 fb = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i *) b));
+    return _mm_cvtps_pd(_mm_sub_ps(fa, fb));
+}
+
+// x * k in float, x holding float values
+static inline vd vd_mul_f32(vd x, float k)
+{
+    return _mm_cvtps_pd(_mm_mul_ps(_mm_cvtpd_ps(x), _mm_set1_ps(k)));
+}
+
+static inline vd vd_and(vm m, vd a)
+{
+    return _mm_and_pd(m, a);
+}
+
+static inline vd vd_copysign(vd mag, vd sgn)
+{
+    return _mm_or_pd(mag, _mm_and_pd(sgn, _mm_set1_pd(-0.0)));
+}
+
+static inline void vd_store_f32(float *p, vd x)
+{
+    _mm_storel_pi((__m64 *) p, _mm_cvtpd_ps(x));
+}
+#else
+typedef float64x2_t vd;
+typedef uint64x2_t vm;
+
+static inline vd vd_set(double x) { return vdupq_n_f64(x); }
+static inline vd vd_add(vd a, vd b) { return vaddq_f64(a, b); }
+static inline vd vd_sub(vd a, vd b) { return vsubq_f64(a, b); }
+static inline vd vd_mul(vd a, vd b) { return vmulq_f64(a, b); }
+static inline vd vd_div(vd a, vd b) { return vdivq_f64(a, b); }
+static inline vd vd_abs(vd a) { return vabsq_f64(a); }
+static inline vm vd_gt(vd a, vd b) { return vcgtq_f64(a, b); }
+static inline vm vd_lt(vd a, vd b) { return vcltq_f64(a, b); }
+static inline vm vd_eq(vd a, vd b) { return vceqq_f64(a, b); }
+static inline vm vm_or(vm a, vm b) { return vorrq_u64(a, b); }
+static inline int vm_bits(vm m) { return (int) ((vgetq_lane_u64(m, 0) & 1) | (vgetq_lane_u64(m, 1) & 2)); }
+
+static inline vd vd_u32(const uint32_t *p)
+{
+    return vcvtq_f64_u64(vmovl_u32(vld1_u32(p)));
+}
+
+static inline vd vd_sub_f32(const float *a, const float *b)
+{
+    return vcvt_f64_f32(vsub_f32(vld1_f32(a), vld1_f32(b)));
+}
+
+static inline vd vd_mul_f32(vd x, float k)
+{
+    return vcvt_f64_f32(vmul_n_f32(vcvt_f32_f64(x), k));
+}
+
+static inline vd vd_and(vm m, vd a)
+{
+    return vreinterpretq_f64_u64(vandq_u64(m, vreinterpretq_u64_f64(a)));
+}
+
+static inline vd vd_copysign(vd mag, vd sgn)
+{
+    return vbslq_f64(vdupq_n_u64(0x8000000000000000ull), sgn, mag);
+}
+
+static inline void vd_store_f32(float *p, vd x)
+{
+    vst1_f32(p, vcvt_f32_f64(x));
+}
+#endif
+
+// nearest integer with ties to even, 0 <= a < 2^51 - adding 2^52 leaves no fraction bits
+static inline vd vd_rint(vd a)
+{
+    return vd_sub(vd_add(a, vd_set(4503599627370496.0)), vd_set(4503599627370496.0));
+}
+
+// nearest integer, halves away from zero like lroundf() - for x exact in double
+// flags lanes out of range
+static inline vd vd_round_exact(vd x, vm *slow)
+{
+    vd a = vd_abs(x);
+    vd y = vd_add(a, vd_set(0.5));
+    vd r = vd_rint(y);
+
+    // floor(a + 0.5): one less where rounding went up
+    r = vd_sub(r, vd_and(vd_gt(r, y), vd_set(1.0)));
+    *slow = vm_or(*slow, vd_gt(a, vd_set(ROUND_LIMIT)));
+
+    // sign back on, + 0.0 so a rounded -0 is stored as 0 like the integer path
+    return vd_add(vd_copysign(r, x), vd_set(0.0));
+}
+
+// same for a rounded quotient like q16_div_round() - lanes that could round differently
+// from the exact value are flagged, so ties to even is as good as away from zero here
+static inline vd vd_round(vd x, vm *slow)
+{
+    vd a = vd_abs(x);
+    vd r = vd_rint(a);
+
+    *slow = vm_or(*slow, vm_or(vd_gt(a, vd_set(ROUND_LIMIT)),
+                               vd_gt(vd_abs(vd_sub(a, r)), vd_set(0.5 - TIE_MARGIN))));
+    return vd_add(vd_copysign(r, x), vd_set(0.0));
+}
+
+/*-------------------------------------------------------------*/
+// rows i and i + 1
+
+static inline __attribute__((always_inline)) void elec_pair(const batchCols *in, const batchOut *out, size_t i)
+{
+    vm slow = vd_lt(vd_set(0.0), vd_set(0.0));
+    vd mtr_P = vd_mul(vd_u32(in->mtr_volt + i), vd_u32(in->mtr_curr + i));
+    vd fc_P = vd_mul(vd_u32(in->fc_volt + i), vd_u32(in->fc_curr + i));
+
+    // raw products in 1e-8 units, past 2^47 the scalar helpers saturate
+    slow = vm_or(slow, vm_or(vd_gt(mtr_P, vd_set(EXACT_LIMIT)), vd_gt(fc_P, vd_set(EXACT_LIMIT))));
+
+    vd mtr_Q = vd_round(vd_mul(mtr_P, vd_set(Q16_ONE / 1e8)), &slow);
+    vd fc_Q = vd_round(vd_mul(fc_P, vd_set(Q16_ONE / 1e8)), &slow);
+    vd eff_Q = vd_round(vd_div(vd_mul(mtr_P, vd_set(Q16_ONE)), fc_P), &slow);
+
+    // no fuel cell power - no result (NaN) from the scalar row
+    slow = vm_or(slow, vd_lt(fc_Q, vd_set(0.5)));
+
+    vd_store_f32(out->mtr_pwr + i, vd_mul(mtr_Q, vd_set(1.0 / Q16_ONE)));
+    vd_store_f32(out->fc_pwr + i, vd_mul(fc_Q, vd_set(1.0 / Q16_ONE)));
+    vd_store_f32(out->elec_eff + i, vd_mul(eff_Q, vd_set(1.0 / Q16_ONE)));
+
+    int bits = vm_bits(slow);
+    if (bits & 1)
+        elec_row(in, out, i);
+    if (bits & 2)
+        elec_row(in, out, i + 1);
+}
+
+static inline __attribute__((always_inline)) void fuel_pair(const batchCols *in, const batchOut *out, size_t i)
+{
+    vm slow = vd_lt(vd_set(0.0), vd_set(0.0));
+    vd speed_sum = vd_add(vd_u32(in->speed + i - 1), vd_u32(in->speed + i));
+    vd fuel_used = vd_sub(vd_u32(in->fc_joules + i - 1), vd_u32(in->fc_joules + i));
+    vd time_diff = vd_sub_f32(in->time + i, in->time + i - 1);
+
+    vd_store_f32(out->dist + i, vd_mul(vd_mul(speed_sum, time_diff), vd_set(0.5e-4)));
+    vd_store_f32(out->energy + i, vd_mul(fuel_used, vd_set(SIG_FC_JOULES_SCALE)));
+
+    // (s1 + s2) * dt_us * 2^16 / (2 * (e1 - e2) * 1e6) as q16_fuel_ratio_raw() forms it
+    // a float is exact in double, so halves round the same as lroundf()
+    vd dt_us = vd_round_exact(vd_mul_f32(time_diff, 1e6f), &slow);
+    vd num = vd_mul(speed_sum, dt_us);
+    vd den = vd_mul(fuel_used, vd_set(2e6));
+
+    slow = vm_or(slow, vm_or(vd_gt(vd_abs(num), vd_set(EXACT_LIMIT)), vd_eq(den, vd_set(0.0))));
+
+    vd eff_Q = vd_round(vd_div(vd_mul(num, vd_set(Q16_ONE)), den), &slow);
+    vd_store_f32(out->fuel_eff + i, vd_mul(eff_Q, vd_set(1.0 / Q16_ONE)));
+
+    int bits = vm_bits(slow);
+    if (bits & 1)
+        fuel_row(in, out, i);
+    if (bits & 2)
+        fuel_row(in, out, i + 1);
+}
+
+void batch_calc(const batchCols *in, const batchOut *out, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 1 < n; i += 2)
+        elec_pair(in, out, i);
+    for (; i < n; i++)
+        elec_row(in, out, i);
+
+    // distances need the row before, row 0 is left at 0
+    if (n > 0)
+        fuel_row(in, out, 0);
+    for (i = 1; i + 1 < n; i += 2)
+        fuel_pair(in, out, i);
+    for (; i < n; i++)
+        fuel_row(in, out, i);
+}
+#else
+void batch_calc(const batchCols *in, const batchOut *out, size_t n)
+{
+    batch_calc_scalar(in, out, n);
+}
+#endif
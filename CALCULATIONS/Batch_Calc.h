@@ -0,0 +1,36 @@
+#ifndef BATCH_CALC_H
+#define BATCH_CALC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// one column per signal, row i of every column is the same instant (e.g. resampled ticks)
+// raw values are as sent on the bus (1/10000 units), times in float seconds like the live path
+typedef struct batchCols {
+    const float *time;
+    const uint32_t *mtr_volt, *mtr_curr;
+    const uint32_t *fc_volt, *fc_curr;
+    const uint32_t *fc_joules;
+    const uint32_t *speed;
+} batchCols;
+
+// result columns, n rows each - a NULL column is not allowed
+// dist, energy and fuel_eff are over the interval from row i - 1 to row i, 0 in row 0
+typedef struct batchOut {
+    float *mtr_pwr, *fc_pwr;    // W, Q16.16 like q16_power_raw()
+    float *elec_eff;            // same value elec_efficiency() gives as instant efficiency, NaN = no result
+    float *dist;                // average speed * time (speed units * s)
+    float *energy;              // fuel cell energy used (J)
+    float *fuel_eff;            // same value fuel_efficiency() gives as instant efficiency, NaN = no result
+} batchOut;
+
+// whole session at once - SSE2 or NEON (aarch64) two rows at a time, scalar otherwise
+void batch_calc(const batchCols *in, const batchOut *out, size_t n);
+
+// one row at a time - the reference batch_calc() matches bit for bit
+void batch_calc_scalar(const batchCols *in, const batchOut *out, size_t n);
+
+// "sse2", "neon" or "scalar" - what batch_calc() was built with
+const char *batch_calc_isa(void);
+
+#endif
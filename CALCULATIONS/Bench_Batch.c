@@ -0,0 +1,195 @@
+// Name: Bench_Batch
+// Description: Batch kernels (Batch_Calc.c) against one elec_efficiency() / fuel_efficiency()
+//              call per sample - time per row and whether the results are the same
+
+// The session is synthetic, one row per 100 ms tick with the ranges of Bench_Fixed.c and a fuel
+// cell energy that runs down and is refilled. Some rows have no fuel cell current or no fuel
+// used so the saturating cases are covered too. Prints one JSON object.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "Batch_Calc.h"
+#include "Elec_Efficiency.h"
+#include "Fuel_Efficiency.h"
+#include "Stream_Stats.h"
+#include "Log_Hist.h"
+
+#define BENCH_ROWS 1000000
+
+// best of this many passes is reported
+#define BENCH_PASSES 5
+
+typedef struct benchCols {
+    float *time;
+    uint32_t *mtr_volt, *mtr_curr, *fc_volt, *fc_curr, *fc_joules, *speed;
+} benchCols;
+
+static uint32_t rand_range(double lo, double hi)
+{
+    return (uint32_t) ((lo + (hi - lo) * ((double) rand() / RAND_MAX)) * 10000);
+}
+
+static float *out_column(size_t n)
+{
+    return malloc(n * sizeof(float));
+}
+
+// one call per sample the way calc_fuel() / calc_elec() make them
+static void per_call(const batchCols *in, float *elec, float *fuel, size_t n)
+{
+    runStats EEff, FEff;
+    float inst = 0;
+
+    run_stats_init(&EEff);
+    run_stats_init(&FEff);
+    for (size_t i = 0; i < n; i++)
+    {
+        elec_efficiency(in->mtr_volt[i], in->mtr_curr[i], in->fc_volt[i], in->fc_curr[i], in->fc_joules[i],
+                        in->time[i], in->time[i], &EEff, &inst);
+        elec[i] = inst;
+
+        if (i == 0) {
+            fuel[0] = 0;
+            continue;
+        }
+        fuel_efficiency(in->speed[i - 1], in->speed[i], in->fc_joules[i - 1], in->fc_joules[i],
+                        in->time[i - 1], in->time[i], in->time[i - 1], in->time[i], &FEff, &inst);
+        fuel[i] = inst;
+    }
+}
+
+// rows where two float columns are not the same bit for bit
+static uint64_t mismatches(const float *a, const float *b, size_t n)
+{
+    uint64_t count = 0;
+    for (size_t i = 0; i < n; i++)
+        count += (memcmp(&a[i], &b[i], sizeof(float)) != 0);
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = BENCH_ROWS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': n = strtoull(optarg, NULL, 10); break;
+            default:
+                printf("usage: %s [-n rows]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    benchCols c;
+    c.time = malloc(n * sizeof(float));
+    c.mtr_volt = malloc(n * sizeof(uint32_t));
+    c.mtr_curr = malloc(n * sizeof(uint32_t));
+    c.fc_volt = malloc(n * sizeof(uint32_t));
+    c.fc_curr = malloc(n * sizeof(uint32_t));
+    c.fc_joules = malloc(n * sizeof(uint32_t));
+    c.speed = malloc(n * sizeof(uint32_t));
+
+    // batch results, scalar batch results, one call per sample
+    float *col[2][6];
+    float *callElec = out_column(n), *callFuel = out_column(n);
+    int outOk = (callElec != NULL && callFuel != NULL);
+    for (int k = 0; k < 2; k++)
+        for (int j = 0; j < 6; j++)
+            outOk &= ((col[k][j] = out_column(n)) != NULL);
+
+    if (!outOk || c.time == NULL || c.mtr_volt == NULL || c.mtr_curr == NULL || c.fc_volt == NULL
+        || c.fc_curr == NULL || c.fc_joules == NULL || c.speed == NULL || n == 0)
+    {
+        printf("out of memory for %llu rows\n", (unsigned long long) n);
+        return 1;
+    }
+
+    srand(1);
+    uint32_t fuel = rand_range(80000, 90000);
+    for (size_t i = 0; i < n; i++)
+    {
+        c.time[i] = (float) i * 0.1f;
+        c.mtr_volt[i] = rand_range(0, 60);
+        c.mtr_curr[i] = rand_range(0, 40);
+        c.fc_volt[i] = rand_range(20, 60);
+        c.fc_curr[i] = (i % 997 == 0) ? 0 : rand_range(0.5, 40);
+        c.speed[i] = rand_range(0, 60);
+
+        // no fuel used now and then, refilled when it runs low
+        if (i % 1009 != 0)
+            fuel -= rand_range(1, 500);
+        if (fuel < 50000000u)
+            fuel = rand_range(80000, 90000);
+        c.fc_joules[i] = fuel;
+    }
+
+    batchCols in = { c.time, c.mtr_volt, c.mtr_curr, c.fc_volt, c.fc_curr, c.fc_joules, c.speed };
+    batchOut out[2];
+    for (int k = 0; k < 2; k++)
+    {
+        out[k].mtr_pwr = col[k][0];
+        out[k].fc_pwr = col[k][1];
+        out[k].elec_eff = col[k][2];
+        out[k].dist = col[k][3];
+        out[k].energy = col[k][4];
+        out[k].fuel_eff = col[k][5];
+    }
+
+    uint64_t best[3] = { UINT64_MAX, UINT64_MAX, UINT64_MAX };
+    for (int pass = 0; pass < BENCH_PASSES; pass++)
+    {
+        uint64_t t0 = mono_ns();
+        per_call(&in, callElec, callFuel, n);
+        uint64_t t1 = mono_ns();
+        batch_calc_scalar(&in, &out[1], n);
+        uint64_t t2 = mono_ns();
+        batch_calc(&in, &out[0], n);
+        uint64_t t3 = mono_ns();
+
+        if (t1 - t0 < best[0])
+            best[0] = t1 - t0;
+        if (t2 - t1 < best[1])
+            best[1] = t2 - t1;
+        if (t3 - t2 < best[2])
+            best[2] = t3 - t2;
+    }
+
+    // every batch column against the scalar rows, efficiencies against the live functions too
+    uint64_t diffScalar = 0;
+    for (int j = 0; j < 6; j++)
+        diffScalar += mismatches(col[0][j], col[1][j], n);
+    uint64_t diffElec = mismatches(out[0].elec_eff, callElec, n);
+    uint64_t diffFuel = mismatches(out[0].fuel_eff, callFuel, n);
+
+    double callNs = (double) best[0] / n;
+    double scalarNs = (double) best[1] / n;
+    double batchNs = (double) best[2] / n;
+
+    printf("{\"rows\":%llu,\"isa\":\"%s\",\"per_call_ns_per_row\":%.2f,\"scalar_ns_per_row\":%.2f,\"batch_ns_per_row\":%.2f,",
+           (unsigned long long) n, batch_calc_isa(), callNs, scalarNs, batchNs);
+    printf("\"speedup_vs_per_call\":%.2f,\"speedup_vs_scalar\":%.2f,",
+           batchNs > 0 ? callNs / batchNs : 0.0, batchNs > 0 ? scalarNs / batchNs : 0.0);
+    printf("\"mismatch\":{\"batch_vs_scalar\":%llu,\"elec_vs_per_call\":%llu,\"fuel_vs_per_call\":%llu}}\n",
+           (unsigned long long) diffScalar, (unsigned long long) diffElec, (unsigned long long) diffFuel);
+
+    for (int k = 0; k < 2; k++)
+        for (int j = 0; j < 6; j++)
+            free(col[k][j]);
+    free(callFuel);
+    free(callElec);
+    free(c.speed);
+    free(c.fc_joules);
+    free(c.fc_curr);
+    free(c.fc_volt);
+    free(c.mtr_curr);
+    free(c.mtr_volt);
+    free(c.time);
+    return 0;
+}
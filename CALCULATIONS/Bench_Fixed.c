@@ -0,0 +1,197 @@
+// Name: Bench_Fixed
+// Description: Fixed point (Fixed_Point.h) against the float path of the efficiency calculations
+//              - time per sample and error of both against a double reference
+
+// Inputs are random raw bus values in the ranges seen on the car: motor 0 - 60 V / 0 - 40 A,
+// fuel cell 20 - 60 V / 0.5 - 40 A, 0 - 60 km/h, fuel cell energy up to 90 kJ used 1 J - 5 kJ
+// per 100 ms tick. One sample in NO_RESULT_EVERY has the fuel cell off and another no fuel used
+// (or too little for the Q16.16 range); the fixed point path must give no result for exactly
+// the samples whose double reference is not finite or out of range. Prints one JSON object.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include "Fixed_Point.h"
+#include "Log_Hist.h"
+
+#define BENCH_SAMPLES 1000000
+#define NO_RESULT_EVERY 64
+
+typedef struct benchInput {
+    uint32_t mtr_v, mtr_i, fc_v, fc_i;
+    uint32_t speed1, speed2, fuel1, fuel2;
+    float dt;
+} benchInput;
+
+typedef struct errStats {
+    double max_abs;
+    double max_rel;
+} errStats;
+
+static uint32_t rand_range(double lo, double hi)
+{
+    return (uint32_t) ((lo + (hi - lo) * ((double) rand() / RAND_MAX)) * Q16_RAW_SCALE);
+}
+
+// float path as it was - a divide per field
+static float elec_float(const benchInput *in)
+{
+    float mtr_V = ((float) in->mtr_v) / 10000;
+    float mtr_I = ((float) in->mtr_i) / 10000;
+    float fc_V = ((float) in->fc_v) / 10000;
+    float fc_I = ((float) in->fc_i) / 10000;
+    return (mtr_V * mtr_I) / (fc_V * fc_I);
+}
+
+static float fuel_float(const benchInput *in)
+{
+    float speed1_f = ((float) in->speed1) / 10000;
+    float speed2_f = ((float) in->speed2) / 10000;
+    float fuel1_f = ((float) in->fuel1) / 10000;
+    float fuel2_f = ((float) in->fuel2) / 10000;
+    return ((speed1_f + speed2_f) / 2 * in->dt) / (fuel1_f - fuel2_f);
+}
+
+static q16_t elec_fixed(const benchInput *in)
+{
+    return q16_power_ratio_raw(in->mtr_v, in->mtr_i, in->fc_v, in->fc_i);
+}
+
+static q16_t fuel_fixed(const benchInput *in)
+{
+    return q16_fuel_ratio_raw(in->speed1, in->speed2, in->fuel1, in->fuel2, (int64_t) lroundf(in->dt * 1e6f));
+}
+
+static double elec_double(const benchInput *in)
+{
+    return ((double) in->mtr_v * in->mtr_i) / ((double) in->fc_v * in->fc_i);
+}
+
+static double fuel_double(const benchInput *in)
+{
+    return ((double) in->speed1 + in->speed2) / 2 * in->dt / ((double) in->fuel1 - in->fuel2);
+}
+
+// where the live functions give no result - division by zero or beyond Q16.16
+static int ref_no_result(double ref)
+{
+    return !isfinite(ref) || fabs(ref) >= (double) Q16_MAX / Q16_ONE;
+}
+
+static void err_add(errStats *e, double got, double ref)
+{
+    double abs_err = fabs(got - ref);
+    // relative error only where the value is above the Q16.16 step by a margin
+    double rel_err = (fabs(ref) >= 0.01) ? abs_err / fabs(ref) : 0;
+    if (abs_err > e->max_abs)
+        e->max_abs = abs_err;
+    if (rel_err > e->max_rel)
+        e->max_rel = rel_err;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t n = BENCH_SAMPLES;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': n = strtoull(optarg, NULL, 10); break;
+            default:
+                printf("usage: %s [-n samples]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    benchInput *in = malloc(n * sizeof(benchInput));
+    float *outFloat = malloc(n * 2 * sizeof(float));
+    q16_t *outFixed = malloc(n * 2 * sizeof(q16_t));
+    if (in == NULL || outFloat == NULL || outFixed == NULL || n == 0)
+    {
+        printf("out of memory for %llu samples\n", (unsigned long long) n);
+        return 1;
+    }
+
+    srand(1);
+    for (uint64_t i = 0; i < n; i++)
+    {
+        in[i].mtr_v = rand_range(0, 60);
+        in[i].mtr_i = rand_range(0, 40);
+        in[i].fc_v = rand_range(20, 60);
+        in[i].fc_i = rand_range(0.5, 40);
+        in[i].speed1 = rand_range(0, 60);
+        in[i].speed2 = rand_range(0, 60);
+        in[i].fuel1 = rand_range(5000, 90000);
+        in[i].fuel2 = in[i].fuel1 - rand_range(1, 5000) % in[i].fuel1;
+        in[i].dt = 0.1f;
+        if (in[i].fuel2 == in[i].fuel1)
+            in[i].fuel2--;
+
+        // fuel cell off, and standing still on no fuel or a trickle of it
+        if (i % NO_RESULT_EVERY == 0)
+            in[i].fc_i = 0;
+        if (i % NO_RESULT_EVERY == NO_RESULT_EVERY / 2)
+            in[i].fuel2 = in[i].fuel1 - (rand() % 2);
+    }
+
+    uint64_t t0 = mono_ns();
+    for (uint64_t i = 0; i < n; i++)
+    {
+        outFloat[2 * i] = elec_float(&in[i]);
+        outFloat[2 * i + 1] = fuel_float(&in[i]);
+    }
+    uint64_t t1 = mono_ns();
+    for (uint64_t i = 0; i < n; i++)
+    {
+        outFixed[2 * i] = elec_fixed(&in[i]);
+        outFixed[2 * i + 1] = fuel_fixed(&in[i]);
+    }
+    uint64_t t2 = mono_ns();
+
+    // errors against double where there is a result, the fixed point path has to flag the others
+    errStats floatElec = { 0 }, floatFuel = { 0 }, fixedElec = { 0 }, fixedFuel = { 0 };
+    uint64_t noResult = 0, missed = 0, floatLost = 0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            double ref = k ? fuel_double(&in[i]) : elec_double(&in[i]);
+            q16_t fixed = outFixed[2 * i + k];
+            int none = ref_no_result(ref);
+
+            noResult += none;
+            missed += (none != q16_no_result(fixed));
+            if (none || q16_no_result(fixed))
+                continue;
+            // float cancels a small fuel difference out of large energy values to nothing
+            if (isfinite(outFloat[2 * i + k]))
+                err_add(k ? &floatFuel : &floatElec, outFloat[2 * i + k], ref);
+            else
+                floatLost++;
+            err_add(k ? &fixedFuel : &fixedElec, q16_to_float(fixed), ref);
+        }
+    }
+
+    double floatNs = (double) (t1 - t0) / n;
+    double fixedNs = (double) (t2 - t1) / n;
+
+    printf("{\"samples\":%llu,\"float_ns_per_sample\":%.2f,\"fixed_ns_per_sample\":%.2f,\"speedup\":%.2f,",
+           (unsigned long long) n, floatNs, fixedNs, fixedNs > 0 ? floatNs / fixedNs : 0.0);
+    printf("\"error_vs_double\":{\"float_elec\":{\"max_abs\":%.3g,\"max_rel\":%.3g},\"float_fuel\":{\"max_abs\":%.3g,\"max_rel\":%.3g},",
+           floatElec.max_abs, floatElec.max_rel, floatFuel.max_abs, floatFuel.max_rel);
+    printf("\"fixed_elec\":{\"max_abs\":%.3g,\"max_rel\":%.3g},\"fixed_fuel\":{\"max_abs\":%.3g,\"max_rel\":%.3g}},",
+           fixedElec.max_abs, fixedElec.max_rel, fixedFuel.max_abs, fixedFuel.max_rel);
+    printf("\"q16_step\":%.3g,\"no_result\":%llu,\"no_result_missed\":%llu,\"float_not_finite\":%llu}\n", 1.0 / Q16_ONE,
+           (unsigned long long) noResult, (unsigned long long) missed, (unsigned long long) floatLost);
+
+    free(outFixed);
+    free(outFloat);
+    free(in);
+    return 0;
+}
@@ -0,0 +1,321 @@
+// Name: Bench_Pipeline
+// Description: End-to-end benchmark of the decode and calculation pipeline
+//              CAN_sort() -> resample -> fuel/elec efficiency -> fan step -> publish -> telemetry log -> log writer
+
+// Drives a recorded trace (-t) or a synthetic one through the same stages main.c runs and
+// prints one JSON object: frames/s, ns/frame per stage, latency percentiles from frame
+// arrival to updated efficiency, and heap allocations per frame.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "Calculate.h"
+#include "CAN_Sort.h"
+#include "CAN_Trace.h"
+#include "Signal_Store.h"
+#include "typedefs.h"
+
+// default synthetic trace length
+#define BENCH_FRAMES 1000000
+
+// stages timed separately
+enum { ST_DECODE, ST_RESAMPLE, ST_FUEL, ST_ELEC, ST_FAN, ST_PUBLISH, ST_SAVE, ST_RECORD, ST_COUNT };
+static const char *stageName[ST_COUNT] = { "decode", "resample", "fuel_efficiency", "elec_efficiency", "fan", "publish", "save", "record" };
+
+/*-------------------------------------------------------------*/
+// counting heap allocations - glibc malloc is wrapped so every call goes through here
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+static uint64_t allocCount;
+
+void *malloc(size_t size) { allocCount++; return __libc_malloc(size); }
+void *calloc(size_t n, size_t size) { allocCount++; return __libc_calloc(n, size); }
+void *realloc(void *p, size_t size) { allocCount++; return __libc_realloc(p, size); }
+
+/*-------------------------------------------------------------*/
+
+static void put_word(uint8_t *p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+// motor, fuel cell power, fuel cell energy, speed and cabin frames round robin at full bus rate
+static void synthetic_frame(uint64_t i, canFrame *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->time_ns = 1700000000000000000ull + i * 111000;      // ~9000 frames/s
+    f->len = 8;
+
+    switch (i % 5)
+    {
+        case 0:
+            f->id = CAN_ID_MOTOR;
+            put_word(&f->data[0], 200000 + (i % 1000));     // 20 A
+            put_word(&f->data[4], 480000);                  // 48 V
+            break;
+        case 1:
+            f->id = CAN_ID_FC_POWER;
+            put_word(&f->data[0], 250000);
+            put_word(&f->data[4], 500000);
+            break;
+        case 2:
+            f->id = CAN_ID_FC_ENERGY;
+            put_word(&f->data[4], 900000000 - (uint32_t) (i * 10));
+            break;
+        case 3:
+            f->id = CAN_ID_SPEED;
+            f->flags = CAN_FRAME_EFF;
+            put_word(&f->data[0], 300000 + (i % 5000));
+            break;
+        default:
+            f->id = CAN_ID_DRIVER_ENV;
+            put_word(&f->data[0], 40 + (i % 20));
+            put_word(&f->data[4], 3 + (i % 8));
+            break;
+    }
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, uint64_t n, double p)
+{
+    if (n == 0)
+        return 0;
+    uint64_t i = (uint64_t) (p * (double) (n - 1) + 0.5);
+    return sorted[i];
+}
+
+int main(int argc, char *argv[])
+{
+    const char *traceFile = NULL;
+    const char *outFile = NULL;
+    uint64_t frames = BENCH_FRAMES;
+    int batch = 1;
+    int opt;
+    canTrace trace;
+    int haveTrace = 0;
+
+    while ((opt = getopt(argc, argv, "t:n:b:o:")) != -1)
+    {
+        switch (opt)
+        {
+            case 't': traceFile = optarg; break;
+            case 'n': frames = strtoull(optarg, NULL, 10); break;
+            case 'b': batch = atoi(optarg); break;
+            case 'o': outFile = optarg; break;
+            default:
+                printf("usage: %s [-t trace.trc] [-n frames] [-b batch] [-o result.json]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (batch < 1)
+        batch = 1;
+
+    if (traceFile != NULL)
+    {
+        if (can_trace_open(&trace, traceFile) < 0)
+        {
+            printf("could not open trace file %s: %s\n", traceFile, strerror(errno));
+            return 1;
+        }
+        haveTrace = 1;
+        frames = trace.count;
+    }
+
+    // everything allocated up front, the timed loop itself should allocate nothing
+    signalStore *store = calloc(1, sizeof(signalStore));
+    canFrame *input = malloc(frames * sizeof(canFrame));
+    canFrame *work = malloc(batch * sizeof(canFrame));
+    uint32_t *latency = malloc(frames * sizeof(uint32_t));
+    if (store == NULL || input == NULL || work == NULL || latency == NULL)
+    {
+        printf("out of memory for %llu frames\n", (unsigned long long) frames);
+        return 1;
+    }
+
+    // bad trace records left out
+    uint64_t nInput = 0;
+    for (uint64_t i = 0; i < frames; i++)
+    {
+        if (!haveTrace)
+            synthetic_frame(i, &input[nInput++]);
+        else if (can_trace_get(&trace, i, &input[nInput]))
+            nInput++;
+    }
+    frames = nInput;
+
+    initializeSpeedVal();
+    if (CAN_sort_init(store) < 0)
+    {
+        printf("could not register every CAN decoder\n");
+        return 1;
+    }
+    if (calc_log_open(LOG_FSYNC_INTERVAL, LOG_WRITER_FSYNC_MS, LOG_FULL_DROP) < 0)
+    {
+        printf("could not open the CSV files: %s\n", strerror(errno));
+        return 1;
+    }
+    unlink("bench_pipeline.tlg");
+    if (calc_tlog_open("bench_pipeline.tlg") < 0)
+    {
+        printf("could not open the telemetry log: %s\n", strerror(errno));
+        return 1;
+    }
+    unlink("bench_flight.rec");
+    if (flight_rec_open(&flight, "bench_flight.rec", 0) < 0)
+    {
+        printf("could not open the flight recorder: %s\n", strerror(errno));
+        return 1;
+    }
+
+    uint64_t stageNs[ST_COUNT] = { 0 };
+    uint64_t nLatency = 0;
+    uint64_t passes = 0;
+    uint64_t allocStart = allocCount;
+    uint64_t start = mono_ns();
+
+    for (uint64_t i = 0; i < frames; i += batch)
+    {
+        int n = (frames - i < (uint64_t) batch) ? (int) (frames - i) : batch;
+        signalSnapshot snap;
+
+        // frame arrival - handed over to the pipeline like a batch off the frame ring
+        uint64_t t0 = mono_ns();
+        memcpy(work, &input[i], n * sizeof(canFrame));
+
+        // resampled and recorded after every frame as in main.c, timed into their own stages
+        uint64_t resampleNs = 0, recordNs = 0;
+        signal_store_write_begin(store);
+        for (int k = 0; k < n; k++)
+        {
+            CAN_sort(&work[k]);
+            uint64_t r0 = mono_ns();
+            calc_resample(store);
+            uint64_t r1 = mono_ns();
+            calc_record(store);
+            resampleNs += r1 - r0;
+            recordNs += mono_ns() - r1;
+        }
+        signal_store_write_end(store);
+        uint64_t t1 = mono_ns();
+
+        signal_store_snapshot(store, &snap);
+        stageNs[ST_DECODE] += t1 - t0 - resampleNs - recordNs;
+        stageNs[ST_RECORD] += recordNs;
+        stageNs[ST_RESAMPLE] += resampleNs + mono_ns() - t1;
+
+        // efficiencies for every tick the batch completed, each published and recorded
+        alignedSample a;
+        int newEff = 0;
+        uint64_t published = 0;
+        for (;;)
+        {
+            uint64_t s0 = mono_ns();
+            int ready = resample_next(&aligner, &a);
+            uint64_t s1 = mono_ns();
+            stageNs[ST_RESAMPLE] += s1 - s0;
+            if (!ready)
+                break;
+
+            int newFuel = calc_fuel(store, &a);
+            uint64_t s2 = mono_ns();
+            int newElec = calc_elec(store, &a);
+            uint64_t s3 = mono_ns();
+            calc_save(newFuel, newElec);
+            uint64_t s4 = mono_ns();
+            calc_publish(store);
+            uint64_t s5 = mono_ns();
+            calc_record(store);
+            uint64_t s6 = mono_ns();
+
+            stageNs[ST_FUEL] += s2 - s1;
+            stageNs[ST_ELEC] += s3 - s2;
+            stageNs[ST_SAVE] += s4 - s3;
+            stageNs[ST_PUBLISH] += s5 - s4;
+            stageNs[ST_RECORD] += s6 - s5;
+            if (newFuel | newElec) {
+                newEff = 1;
+                published = s5;
+            }
+        }
+
+        uint64_t t4 = mono_ns();
+        calc_fan(&snap);
+        uint64_t t5 = mono_ns();
+        calc_publish_fan(store);
+        uint64_t t6 = mono_ns();
+        calc_record(store);
+        uint64_t t7 = mono_ns();
+
+        stageNs[ST_FAN] += t5 - t4;
+        stageNs[ST_PUBLISH] += t6 - t5;
+        stageNs[ST_RECORD] += t7 - t6;
+        passes++;
+
+        // arrival to the last efficiency the batch published, for every frame of a batch that moved it
+        if (newEff)
+        {
+            for (int k = 0; k < n; k++)
+                latency[nLatency++] = (uint32_t) (published - t0);
+        }
+    }
+
+    uint64_t elapsed = mono_ns() - start;
+    uint64_t allocs = allocCount - allocStart;
+
+    // files written out after the clock stopped, the drops show whether the writer kept up
+    calc_log_close();
+    flight_rec_close(&flight);
+
+    qsort(latency, nLatency, sizeof(uint32_t), cmp_u32);
+
+    FILE *out = stdout;
+    if (outFile != NULL && (out = fopen(outFile, "w")) == NULL)
+    {
+        printf("could not create %s: %s\n", outFile, strerror(errno));
+        return 1;
+    }
+
+    fprintf(out, "{\"source\":\"%s\",\"frames\":%llu,\"batch\":%d,\"passes\":%llu,",
+            haveTrace ? traceFile : "synthetic", (unsigned long long) frames, batch, (unsigned long long) passes);
+    fprintf(out, "\"elapsed_ns\":%llu,\"frames_per_s\":%.0f,",
+            (unsigned long long) elapsed, frames ? (double) frames * 1e9 / (double) elapsed : 0.0);
+    fprintf(out, "\"stage_ns_per_frame\":{");
+    for (int s = 0; s < ST_COUNT; s++)
+        fprintf(out, "%s\"%s\":%.1f", s ? "," : "", stageName[s], frames ? (double) stageNs[s] / (double) frames : 0.0);
+    fprintf(out, "},\"latency_ns\":{\"samples\":%llu,\"p50\":%u,\"p99\":%u,\"p999\":%u,\"max\":%u},",
+            (unsigned long long) nLatency,
+            percentile(latency, nLatency, 0.50), percentile(latency, nLatency, 0.99),
+            percentile(latency, nLatency, 0.999), nLatency ? latency[nLatency - 1] : 0);
+    fprintf(out, "\"allocs\":%llu,\"allocs_per_frame\":%.6f,",
+            (unsigned long long) allocs, frames ? (double) allocs / (double) frames : 0.0);
+    fprintf(out, "\"tlog\":{\"samples\":%llu,\"chunks\":%llu,\"bytes\":%llu,\"dropped_chunks\":%llu},",
+            (unsigned long long) tlog.samples, (unsigned long long) tlog.chunks, (unsigned long long) tlog.bytes,
+            (unsigned long long) tlog.dropped_chunks);
+    fprintf(out, "\"flight\":{\"records\":%llu,\"syncs\":%llu,\"sync_us_p99\":%llu},",
+            (unsigned long long) flight.records, (unsigned long long) atomic_load(&flight.syncs),
+            (unsigned long long) hist_percentile(&flight.sync_us, 0.99));
+    fprintf(out, "\"log\":{\"records\":%llu,\"bytes\":%llu,\"dropped\":%llu,\"blocks\":%llu,\"write_us_p99\":%llu}}\n",
+            (unsigned long long) logw.records, (unsigned long long) logw.bytes_in, (unsigned long long) logw.dropped,
+            (unsigned long long) atomic_load(&logw.blocks_written), (unsigned long long) hist_percentile(&logw.write_us, 0.99));
+
+    if (out != stdout)
+        fclose(out);
+    if (haveTrace)
+        can_trace_close(&trace);
+    free(latency);
+    free(work);
+    free(input);
+    free(store);
+    return 0;
+}
@@ -0,0 +1,176 @@
+// Name: Bench_Ring
+// Description: Stress test of the frame ring (Frame_Ring.c) - a producer thread against the
+//              consumer as in main.c, checking nothing is lost, reordered or torn
+
+// The producer pushes frames numbered 1, 2, 3 ... with the number and a pattern derived from
+// it in the payload. By default it waits for room when the ring is full, like a replay in
+// main.c, so every frame goes through and each one is checked: numbers must go up one at a
+// time and all N must be popped. With a set rate (-r) or a slow consumer (-d) it pushes the
+// way the CAN reader does and the drop path is stressed instead: every number the consumer
+// never sees must have been counted as dropped, and frames offered = popped + dropped must
+// hold. Prints one JSON object, exits 1 on an error.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "Frame_Ring.h"
+#include "Log_Hist.h"
+
+#define BENCH_FRAMES 10000000ull
+
+// frames taken out per pop, as CAN_RX_BATCH in main.c
+#define BENCH_BATCH 64
+
+typedef struct benchRing {
+    frameRing ring;
+    uint64_t frames;
+    uint64_t rate;                  // frames per second, 0 = as fast as it can
+    int lossless;                   // producer waits for room instead of dropping
+    _Atomic int done;               // producer has offered every frame
+} benchRing;
+
+// payload of frame seq - number first, then bytes the consumer can check
+static void fill_frame(canFrame *f, uint64_t seq)
+{
+    f->time_ns = seq;
+    f->id = (uint32_t) (seq & 0x7FF);
+    f->flags = 0;
+    f->len = 8 + (uint8_t) (seq % 57);
+    f->bus = (uint8_t) (seq & 3);
+    memcpy(f->data, &seq, sizeof(seq));
+    for (int i = 8; i < f->len; i++)
+        f->data[i] = (uint8_t) (seq * 31 + i);
+}
+
+static int frame_ok(const canFrame *f, uint64_t seq)
+{
+    canFrame want;
+    fill_frame(&want, seq);
+    return f->time_ns == want.time_ns && f->id == want.id && f->len == want.len && f->bus == want.bus
+           && memcmp(f->data, want.data, want.len) == 0;
+}
+
+static void *producer(void *arg)
+{
+    benchRing *b = arg;
+    canFrame f;
+    uint64_t start = mono_ns();
+
+    for (uint64_t seq = 1; seq <= b->frames; seq++)
+    {
+        // spinning, a sleep is far coarser than the gap between two frames
+        if (b->rate > 0)
+            while (mono_ns() - start < seq * 1000000000ull / b->rate)
+                ;
+        fill_frame(&f, seq);
+        if (b->lossless)
+            while (frame_ring_count(&b->ring) >= FRAME_RING_SIZE)
+                sched_yield();
+        frame_ring_push(&b->ring, &f);
+    }
+    atomic_store_explicit(&b->done, 1, memory_order_release);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t frames = BENCH_FRAMES;
+    int batch = BENCH_BATCH;
+    uint64_t rate = 0;
+    useconds_t delay = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:b:r:d:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': frames = strtoull(optarg, NULL, 10); break;
+            case 'b': batch = atoi(optarg); break;
+            case 'r': rate = strtoull(optarg, NULL, 10); break;
+            case 'd': delay = (useconds_t) atoi(optarg); break;
+            default:
+                printf("usage: %s [-n frames] [-b frames per pop] [-r frames per second] [-d us the consumer sleeps after a pop]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    benchRing *b = aligned_alloc(CACHE_LINE, (sizeof(benchRing) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+    canFrame *out = malloc((batch > 0 ? batch : 1) * sizeof(canFrame));
+    if (b == NULL || out == NULL || batch <= 0)
+    {
+        printf("out of memory or bad batch size\n");
+        return 1;
+    }
+    frame_ring_init(&b->ring);
+    b->frames = frames;
+    b->rate = rate;
+    b->lossless = (rate == 0 && delay == 0);
+    atomic_init(&b->done, 0);
+
+    pthread_t thread;
+    uint64_t t0 = mono_ns();
+    if (pthread_create(&thread, NULL, producer, b) != 0)
+    {
+        printf("could not start the producer\n");
+        return 1;
+    }
+
+    // the producer's counters are only complete once it is done, the ring is drained after that
+    uint64_t popped = 0, last = 0, missing = 0, orderErrors = 0, dataErrors = 0, pops = 0;
+    for (;;)
+    {
+        int done = atomic_load_explicit(&b->done, memory_order_acquire);
+        int n = frame_ring_pop(&b->ring, out, batch);
+        for (int i = 0; i < n; i++)
+        {
+            uint64_t seq;
+            memcpy(&seq, out[i].data, sizeof(seq));
+            if (seq <= last)
+                orderErrors++;
+            else {
+                missing += seq - last - 1;
+                last = seq;
+            }
+            if (!frame_ok(&out[i], seq))
+                dataErrors++;
+        }
+        popped += (uint64_t) n;
+        pops += (n > 0);
+        if (n == 0 && done)
+            break;
+        if (n > 0 && delay > 0)
+            usleep(delay);
+    }
+    uint64_t t1 = mono_ns();
+    pthread_join(thread, NULL);
+
+    // the numbers after the last one popped were dropped as well
+    missing += frames - last;
+
+    uint64_t pushed = atomic_load(&b->ring.pushed);
+    uint64_t dropped = atomic_load(&b->ring.dropped);
+    uint64_t ringPopped = atomic_load(&b->ring.popped);
+    int ok = (frames == popped + dropped) && (pushed == popped) && (ringPopped == popped)
+             && (missing == dropped) && orderErrors == 0 && dataErrors == 0
+             && (!b->lossless || popped == frames);
+
+    double s = (double) (t1 - t0) * 1e-9;
+    printf("{\"frames\":%llu,\"batch\":%d,\"lossless\":%s,\"rate\":%llu,\"delay_us\":%u,\"seconds\":%.3f,\"frames_per_s\":%.0f,",
+           (unsigned long long) frames, batch, b->lossless ? "true" : "false", (unsigned long long) rate, (unsigned) delay, s,
+           s > 0 ? (double) popped / s : 0.0);
+    printf("\"pushed\":%llu,\"popped\":%llu,\"dropped\":%llu,\"pops\":%llu,\"missing\":%llu,",
+           (unsigned long long) pushed, (unsigned long long) popped, (unsigned long long) dropped,
+           (unsigned long long) pops, (unsigned long long) missing);
+    printf("\"order_errors\":%llu,\"data_errors\":%llu,\"ok\":%s}\n",
+           (unsigned long long) orderErrors, (unsigned long long) dataErrors, ok ? "true" : "false");
+
+    free(out);
+    free(b);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,280 @@
+// Name: Bench_Tlog
+// Description: Telemetry log (Telemetry_Log.c) write throughput and size against the CSV lines,
+//              a check that every sample reads back exactly, and window query time
+
+// The session is synthetic: motor, fuel cell and speed signals at 50 Hz, the calculated signals
+// at 10 Hz and the cabin signals at 1 Hz, each with a little timestamp jitter and a random walk
+// of its value. Every signal draws from its own generator, so the reader can replay each
+// column on its own to check it. Queries are 20 s windows of three signals at random times,
+// through the time index and again walking the chunks from the start. Prints one JSON object.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "Telemetry_Log.h"
+#include "Log_Writer.h"
+
+// default session length, an endurance event
+#define BENCH_SECONDS   (3 * 3600)
+
+// base tick the schedules count in
+#define TICK_US         10000
+
+// window queries timed, and their length
+#define BENCH_QUERIES   200
+#define QUERY_US        20000000ull
+
+typedef struct genState {
+    uint64_t rng;
+    uint32_t period;                // ticks
+    uint32_t step;                  // largest change of the value per sample
+    uint64_t tick;
+    int64_t q;
+} genState;
+
+typedef struct queryCount {
+    uint64_t samples;
+    uint64_t sum;
+} queryCount;
+
+static void count_sample(int signal, uint64_t time_us, int64_t q, void *ctx)
+{
+    queryCount *c = ctx;
+    c->samples++;
+    c->sum += (uint64_t) signal + time_us + (uint64_t) q;
+}
+
+static uint32_t next_rand(genState *g)
+{
+    // xorshift64*
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return (uint32_t) ((g->rng * 2685821657736338717ull) >> 32);
+}
+
+static void gen_init(genState *g, int s)
+{
+    memset(g, 0, sizeof(*g));
+    g->rng = 0x9E3779B97F4A7C15ull * (uint64_t) (s + 1);
+
+    if (signalInfos[s].decoded && s != SIG_DRV_TEMP && s != SIG_DRV_HUMD && s != SIG_H2_ALARM) {
+        g->period = 2;                              // 50 Hz bus signals, raw 1/10000 units
+        g->step = 200;
+        g->q = 200000 + next_rand(g) % 400000;
+    } else if (signalInfos[s].decoded) {
+        g->period = 100;                            // 1 Hz cabin and alarm
+        g->step = 1;
+        g->q = (s == SIG_H2_ALARM) ? 0 : 25;
+    } else {
+        g->period = 10;                             // 10 Hz calculated
+        g->step = 20;
+        g->q = next_rand(g) % 50000;
+    }
+    g->tick = next_rand(g) % g->period;
+}
+
+// next sample of the signal: time in ns and value in integer units
+static uint64_t gen_next(genState *g, int64_t *q)
+{
+    uint64_t t = 1700000000000000000ull + (g->tick * TICK_US + next_rand(g) % 500) * 1000ull;
+    g->q += (int64_t) (next_rand(g) % (2 * g->step + 1)) - g->step;
+    if (g->q < 0)
+        g->q = -g->q;
+    *q = g->q;
+    g->tick += g->period;
+    return t;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = "bench.tlg";
+    uint64_t seconds = BENCH_SECONDS;
+    int opt;
+    static genState gen[SIG_COUNT];
+    static tlogWriter tlog;
+    logWriter w;
+
+    while ((opt = getopt(argc, argv, "d:o:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd': seconds = strtoull(optarg, NULL, 10); break;
+            case 'o': path = optarg; break;
+            default:
+                printf("usage: %s [-d seconds] [-o file.tlg]\n", argv[0]);
+                return 1;
+        }
+    }
+    uint64_t ticks = seconds * (1000000 / TICK_US);
+
+    // generating alone, taken off the write time below - also counts the CSV bytes
+    uint64_t samples = 0, csvBytes = 0;
+    uint64_t g0 = mono_ns();
+    for (int s = 0; s < SIG_COUNT; s++)
+        gen_init(&gen[s], s);
+    for (uint64_t k = 0; k < ticks; k++)
+    {
+        for (int s = 0; s < SIG_COUNT; s++)
+        {
+            while (gen[s].tick <= k)
+            {
+                int64_t q;
+                uint64_t t = gen_next(&gen[s], &q);
+                char line[64];
+                csvBytes += snprintf(line, sizeof(line), "%d,%0.3f,%0.3f\n", (int) gen[s].tick,
+                                     (double) (t / 1000000) * 1e-3, (double) q * signalInfos[s].scale);
+                samples++;
+            }
+        }
+    }
+    uint64_t genNs = mono_ns() - g0;
+
+    // only encoding left to time: the same samples without the CSV lines
+    g0 = mono_ns();
+    for (int s = 0; s < SIG_COUNT; s++)
+        gen_init(&gen[s], s);
+    uint64_t plainSamples = 0;
+    for (uint64_t k = 0; k < ticks; k++)
+    {
+        for (int s = 0; s < SIG_COUNT; s++)
+        {
+            while (gen[s].tick <= k)
+            {
+                int64_t q;
+                volatile uint64_t t = gen_next(&gen[s], &q);
+                (void) t;
+                plainSamples++;
+            }
+        }
+    }
+    genNs = mono_ns() - g0;
+
+    char idxPath[512];
+    snprintf(idxPath, sizeof(idxPath), "%s%s", path, TLOG_INDEX_SUFFIX);
+    unlink(path);
+    unlink(idxPath);
+    if (log_writer_open(&w, LOG_FSYNC_NEVER, 0, LOG_FULL_WAIT) < 0 || tlog_open(&tlog, &w, path) < 0)
+    {
+        printf("could not create %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    uint64_t w0 = mono_ns();
+    for (int s = 0; s < SIG_COUNT; s++)
+        gen_init(&gen[s], s);
+    for (uint64_t k = 0; k < ticks; k++)
+    {
+        for (int s = 0; s < SIG_COUNT; s++)
+        {
+            while (gen[s].tick <= k)
+            {
+                int64_t q;
+                uint64_t t = gen_next(&gen[s], &q);
+                tlog_sample(&tlog, s, t, q);
+            }
+        }
+    }
+    tlog_flush(&tlog);
+    uint64_t writeNs = mono_ns() - w0;
+    uint64_t encodeNs = (writeNs > genNs) ? writeNs - genNs : 0;
+    tlog_close(&tlog);
+    log_writer_close(&w);
+
+    // reading back, every column replayed from its own generator
+    tlogReader r;
+    if (tlog_read_open(&r, path) < 0)
+    {
+        printf("could not read %s back: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    static uint64_t time_us[TLOG_COL_BYTES / 2];
+    static int64_t q[TLOG_COL_BYTES / 2];
+    uint64_t readSamples = 0, mismatch = 0, chunks = 0;
+    size_t offset = r.data_off;
+    tlogChunkView c;
+
+    for (int s = 0; s < SIG_COUNT; s++)
+        gen_init(&gen[s], s);
+    uint64_t r0 = mono_ns();
+    while (tlog_next_chunk(&r, &offset, &c))
+    {
+        chunks++;
+        for (int i = 0; i < c.hdr.columns; i++)
+        {
+            tlogColumn col;
+            memcpy(&col, &c.cols[i], sizeof(col));
+            uint32_t n = tlog_decode(&c, i, time_us, q, TLOG_COL_BYTES / 2);
+            readSamples += n;
+            for (uint32_t k = 0; k < n; k++)
+            {
+                int64_t want;
+                uint64_t t = gen_next(&gen[col.signal], &want);
+                if (t / 1000 != time_us[k] || want != q[k])
+                    mismatch++;
+            }
+        }
+    }
+    uint64_t readNs = mono_ns() - r0;
+    uint64_t fileBytes = r.map_size;
+
+    // the same windows with the index and without, both must find the same samples
+    int qsig[3] = { SIG_FC_VOLT, SIG_FC_CURR, SIG_H2_ALARM };
+    uint64_t first = tlog_first_us(&r);
+    uint64_t span = ticks * TICK_US;
+    uint64_t qrng = 0x2545F4914F6CDD1Dull;
+    uint64_t idxNs = 0, walkNs = 0, idxChunks = 0, querySamples = 0, walkHeaders = 0;
+    size_t idxCount = r.idx_count;
+    for (int k = 0; k < BENCH_QUERIES && span > QUERY_US; k++)
+    {
+        qrng ^= qrng << 13;
+        qrng ^= qrng >> 7;
+        qrng ^= qrng << 17;
+        uint64_t from = first + qrng % (span - QUERY_US);
+        queryCount a = { 0 }, b = { 0 };
+
+        r.idx_count = idxCount;
+        uint64_t q0 = mono_ns();
+        idxChunks += (uint64_t) tlog_query(&r, from, from + QUERY_US, qsig, 3, count_sample, &a);
+        uint64_t q1 = mono_ns();
+        r.idx_count = 0;
+        tlog_query(&r, from, from + QUERY_US, qsig, 3, count_sample, &b);
+        uint64_t q2 = mono_ns();
+
+        idxNs += q1 - q0;
+        walkNs += q2 - q1;
+        querySamples += a.samples;
+        if (a.samples != b.samples || a.sum != b.sum)
+            mismatch++;
+
+        // chunk headers read before the window without the index - a page each off the card
+        size_t off = r.data_off;
+        while (tlog_next_chunk(&r, &off, &c) && c.hdr.last_us < from)
+            walkHeaders++;
+    }
+    r.idx_count = idxCount;
+    tlog_read_close(&r);
+
+    printf("{\"seconds\":%llu,\"samples\":%llu,\"chunks\":%llu,\"file_bytes\":%llu,\"bytes_per_sample\":%.3f,",
+           (unsigned long long) seconds, (unsigned long long) samples, (unsigned long long) chunks,
+           (unsigned long long) fileBytes, samples ? (double) fileBytes / (double) samples : 0.0);
+    printf("\"csv_bytes\":%llu,\"ratio_vs_csv\":%.1f,\"ratio_vs_struct\":%.1f,",
+           (unsigned long long) csvBytes, fileBytes ? (double) csvBytes / (double) fileBytes : 0.0,
+           fileBytes ? (double) samples * sizeof(dataStruct) / (double) fileBytes : 0.0);
+    printf("\"encode_ns_per_sample\":%.1f,\"write_samples_per_s\":%.0f,\"decode_ns_per_sample\":%.1f,",
+           samples ? (double) encodeNs / (double) samples : 0.0,
+           writeNs ? (double) samples * 1e9 / (double) writeNs : 0.0,
+           readSamples ? (double) readNs / (double) readSamples : 0.0);
+    printf("\"index_entries\":%llu,\"query_us\":%.1f,\"query_chunks\":%.1f,\"query_samples\":%.0f,\"query_walk_us\":%.1f,\"query_walk_headers\":%.0f,",
+           (unsigned long long) idxCount, (double) idxNs / BENCH_QUERIES * 1e-3, (double) idxChunks / BENCH_QUERIES,
+           (double) querySamples / BENCH_QUERIES, (double) walkNs / BENCH_QUERIES * 1e-3,
+           (double) walkHeaders / BENCH_QUERIES);
+    printf("\"read_back\":%llu,\"mismatch\":%llu}\n", (unsigned long long) readSamples,
+           (unsigned long long) (mismatch + (readSamples != samples) + (plainSamples != samples)));
+    return 0;
+}
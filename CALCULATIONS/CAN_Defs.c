@@ -0,0 +1,212 @@
+// Generated from signals.dbc by gen_signals.py - do not edit, change signals.dbc and run it again
+// Every field of a message is read at a fixed offset with a fixed width, so each decoder is
+// straight line code with one length check; a frame too short for all of them goes through
+// the table driven CAN_decode_message() like any other registered message.
+#include <stddef.h>
+#include <stdint.h>
+#include "CAN_Sort.h"
+
+static const canField fd_fetpack_fields[] = {
+    { SIG_H2_ALARM, 0, 4, 0, 1.0f, 0.0f },
+};
+static const canMessage fd_fetpack_msg = { 1, fd_fetpack_fields };
+
+static const canField motor_fields[] = {
+    { SIG_MTR_VOLT, 4, 4, 0, 0.0001f, 0.0f },
+    { SIG_MTR_CURR, 0, 4, 0, 0.0001f, 0.0f },
+};
+static const canMessage motor_msg = { 2, motor_fields };
+
+static const canField fc_energy_fields[] = {
+    { SIG_FC_JOULES, 4, 4, 0, 0.0001f, 0.0f },
+};
+static const canMessage fc_energy_msg = { 1, fc_energy_fields };
+
+static const canField fc_power_fields[] = {
+    { SIG_FC_VOLT, 4, 4, 0, 0.0001f, 0.0f },
+    { SIG_FC_CURR, 0, 4, 0, 0.0001f, 0.0f },
+};
+static const canMessage fc_power_msg = { 2, fc_power_fields };
+
+static const canField driver_env_fields[] = {
+    { SIG_DRV_TEMP, 4, 4, 0, 1.0f, 0.0f },
+    { SIG_DRV_HUMD, 0, 4, 0, 1.0f, 0.0f },
+};
+static const canMessage driver_env_msg = { 2, driver_env_fields };
+
+static const canField speed_fields[] = {
+    { SIG_SPEED, 0, 4, 0, 0.0001f, 0.0f },
+};
+static const canMessage speed_msg = { 1, speed_fields };
+
+static const canField fdcan_battpack_fields[] = {
+    { SIG_BATT_VOLT, 0, 4, 0, 0.0001f, 0.0f },
+    { SIG_BATT_JOULES, 4, 4, 0, 0.0001f, 0.0f },
+};
+static const canMessage fdcan_battpack_msg = { 2, fdcan_battpack_fields };
+
+static const canField tx_fan_fields[] = {
+    { SIG_FAN_RPM, 0, 4, 0, 1.0f, 0.0f },
+};
+const canMessage CAN_msg_tx_fan = { 1, tx_fan_fields };
+
+static const canField tx_elec_eff_fields[] = {
+    { SIG_ELEC_EFF, 0, 4, 0, 0.0001f, 0.0f },
+    { SIG_ELEC_EFF_AVG, 4, 4, 0, 0.0001f, 0.0f },
+};
+const canMessage CAN_msg_tx_elec_eff = { 2, tx_elec_eff_fields };
+
+static const canField tx_fuel_eff_fields[] = {
+    { SIG_FUEL_EFF, 0, 4, 0, 0.0001f, 0.0f },
+    { SIG_FUEL_EFF_AVG, 4, 4, 0, 0.0001f, 0.0f },
+};
+const canMessage CAN_msg_tx_fuel_eff = { 2, tx_fuel_eff_fields };
+
+// 0x010 FD_FETPACK - H2 alarm as read by the calculations, FETPACK in Receive-ECOCAR.py
+static void decode_fd_fetpack(const canFrame *frame, void *ctx)
+{
+    const canBinding *b = ctx;
+    const uint8_t *d = frame->data;
+
+    if (frame->len < 4) {
+        CAN_decode_message(frame, ctx);
+        return;
+    }
+    if (b->store->start_ns == 0)
+        b->store->start_ns = frame->time_ns;
+
+    uint32_t h2_alarm = CAN_get_le32(d);
+    signal_store_set(b->store, SIG_H2_ALARM, h2_alarm, (float) h2_alarm, frame->time_ns);
+}
+
+// 0x150 MOTOR
+static void decode_motor(const canFrame *frame, void *ctx)
+{
+    const canBinding *b = ctx;
+    const uint8_t *d = frame->data;
+
+    if (frame->len < 8) {
+        CAN_decode_message(frame, ctx);
+        return;
+    }
+    if (b->store->start_ns == 0)
+        b->store->start_ns = frame->time_ns;
+
+    uint32_t mtr_volt = CAN_get_le32(d + 4);
+    uint32_t mtr_curr = CAN_get_le32(d);
+    signal_store_set(b->store, SIG_MTR_VOLT, mtr_volt, (float) mtr_volt * 0.0001f, frame->time_ns);
+    signal_store_set(b->store, SIG_MTR_CURR, mtr_curr, (float) mtr_curr * 0.0001f, frame->time_ns);
+}
+
+// 0x140 FC_ENERGY - Capacitor energy level in bytes 0 - 3 is not used
+static void decode_fc_energy(const canFrame *frame, void *ctx)
+{
+    const canBinding *b = ctx;
+    const uint8_t *d = frame->data;
+
+    if (frame->len < 8) {
+        CAN_decode_message(frame, ctx);
+        return;
+    }
+    if (b->store->start_ns == 0)
+        b->store->start_ns = frame->time_ns;
+
+    uint32_t fc_joules = CAN_get_le32(d + 4);
+    signal_store_set(b->store, SIG_FC_JOULES, fc_joules, (float) fc_joules * 0.0001f, frame->time_ns);
+}
+
+// 0x170 FC_POWER
+static void decode_fc_power(const canFrame *frame, void *ctx)
+{
+    const canBinding *b = ctx;
+    const uint8_t *d = frame->data;
+
+    if (frame->len < 8) {
+        CAN_decode_message(frame, ctx);
+        return;
+    }
+    if (b->store->start_ns == 0)
+        b->store->start_ns = frame->time_ns;
+
+    uint32_t fc_volt = CAN_get_le32(d + 4);
+    uint32_t fc_curr = CAN_get_le32(d);
+    signal_store_set(b->store, SIG_FC_VOLT, fc_volt, (float) fc_volt * 0.0001f, frame->time_ns);
+    signal_store_set(b->store, SIG_FC_CURR, fc_curr, (float) fc_curr * 0.0001f, frame->time_ns);
+}
+
+// 0x220 DRIVER_ENV
+static void decode_driver_env(const canFrame *frame, void *ctx)
+{
+    const canBinding *b = ctx;
+    const uint8_t *d = frame->data;
+
+    if (frame->len < 8) {
+        CAN_decode_message(frame, ctx);
+        return;
+    }
+    if (b->store->start_ns == 0)
+        b->store->start_ns = frame->time_ns;
+
+    uint32_t drv_temp = CAN_get_le32(d + 4);
+    uint32_t drv_humd = CAN_get_le32(d);
+    signal_store_set(b->store, SIG_DRV_TEMP, drv_temp, (float) drv_temp, frame->time_ns);
+    signal_store_set(b->store, SIG_DRV_HUMD, drv_humd, (float) drv_humd, frame->time_ns);
+}
+
+// 0x990 SPEED - 0x990 does not fit in 11 bits, so speed comes in with a 29 bit ID
+static void decode_speed(const canFrame *frame, void *ctx)
+{
+    const canBinding *b = ctx;
+    const uint8_t *d = frame->data;
+
+    if (frame->len < 4) {
+        CAN_decode_message(frame, ctx);
+        return;
+    }
+    if (b->store->start_ns == 0)
+        b->store->start_ns = frame->time_ns;
+
+    uint32_t speed = CAN_get_le32(d);
+    signal_store_set(b->store, SIG_SPEED, speed, (float) speed * 0.0001f, frame->time_ns);
+}
+
+// 0x050 FDCAN_BATTPACK - Same word layout as the fuel cell messages - check against the pack firmware
+static void decode_fdcan_battpack(const canFrame *frame, void *ctx)
+{
+    const canBinding *b = ctx;
+    const uint8_t *d = frame->data;
+
+    if (frame->len < 8) {
+        CAN_decode_message(frame, ctx);
+        return;
+    }
+    if (b->store->start_ns == 0)
+        b->store->start_ns = frame->time_ns;
+
+    uint32_t batt_volt = CAN_get_le32(d);
+    uint32_t batt_joules = CAN_get_le32(d + 4);
+    signal_store_set(b->store, SIG_BATT_VOLT, batt_volt, (float) batt_volt * 0.0001f, frame->time_ns);
+    signal_store_set(b->store, SIG_BATT_JOULES, batt_joules, (float) batt_joules * 0.0001f, frame->time_ns);
+}
+
+const canMessageDef CAN_rx_messages[CAN_RX_MESSAGES] = {
+    { CAN_ID_H2_ALARM, 0, 0, "H2_ALARM", NULL, NULL },
+    { CAN_ID_FD_FETPACK, 0, 0, "FD_FETPACK", &fd_fetpack_msg, decode_fd_fetpack },
+    { CAN_ID_MOTOR, 0, 8, "MOTOR", &motor_msg, decode_motor },
+    { CAN_ID_FC_ENERGY, 0, 8, "FC_ENERGY", &fc_energy_msg, decode_fc_energy },
+    { CAN_ID_FC_POWER, 0, 8, "FC_POWER", &fc_power_msg, decode_fc_power },
+    { CAN_ID_DRIVER_ENV, 0, 8, "DRIVER_ENV", &driver_env_msg, decode_driver_env },
+    { CAN_ID_SPEED, 1, 8, "SPEED", &speed_msg, decode_speed },
+    { CAN_ID_FDCAN_BATTPACK, 0, 8, "FDCAN_BATTPACK", &fdcan_battpack_msg, decode_fdcan_battpack },
+    { CAN_ID_FD_RELPACKMTR, 0, 0, "FD_RELPACKMTR", NULL, NULL },
+    { CAN_ID_FDCAN_RELPACK, 0, 0, "FDCAN_RELPACK", NULL, NULL },
+    { CAN_ID_FDCAN_RELPACKFC, 0, 0, "FDCAN_RELPACKFC", NULL, NULL },
+    { CAN_ID_FDCAN_FCCPACK1, 0, 0, "FDCAN_FCCPACK1", NULL, NULL },
+    { CAN_ID_FDCAN_FCCPACK2, 0, 0, "FDCAN_FCCPACK2", NULL, NULL },
+    { CAN_ID_FDCAN_FCCPACK3, 0, 0, "FDCAN_FCCPACK3", NULL, NULL },
+    { CAN_ID_ECOCAN_H2_PACK1, 0, 0, "ECOCAN_H2_PACK1", NULL, NULL },
+    { CAN_ID_ECOCAN_H2_PACK2, 0, 0, "ECOCAN_H2_PACK2", NULL, NULL },
+    { CAN_ID_ECOCAN_H2_ARM_ALARM, 0, 0, "ECOCAN_H2_ARM_ALARM", NULL, NULL },
+    { CAN_ID_FDCAN_BOOSTPACK, 0, 0, "FDCAN_BOOSTPACK", NULL, NULL },
+    { CAN_ID_FDCAN_BOOSTPACK2, 0, 0, "FDCAN_BOOSTPACK2", NULL, NULL },
+};
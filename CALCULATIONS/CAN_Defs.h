@@ -0,0 +1,41 @@
+// Generated from signals.dbc by gen_signals.py - do not edit, change signals.dbc and run it again
+// included by CAN_Sort.h
+#ifndef CAN_DEFS_H
+#define CAN_DEFS_H
+
+// IDs received
+#define CAN_ID_H2_ALARM              0x001
+#define CAN_ID_FD_FETPACK            0x010
+#define CAN_ID_MOTOR                 0x150
+#define CAN_ID_FC_ENERGY             0x140
+#define CAN_ID_FC_POWER              0x170
+#define CAN_ID_DRIVER_ENV            0x220
+#define CAN_ID_SPEED                 0x990       // 29 bit ID
+#define CAN_ID_FDCAN_BATTPACK        0x050
+#define CAN_ID_FD_RELPACKMTR         0x015
+#define CAN_ID_FDCAN_RELPACK         0x016
+#define CAN_ID_FDCAN_RELPACKFC       0x017
+#define CAN_ID_FDCAN_FCCPACK1        0x020
+#define CAN_ID_FDCAN_FCCPACK2        0x021
+#define CAN_ID_FDCAN_FCCPACK3        0x022
+#define CAN_ID_ECOCAN_H2_PACK1       0x030
+#define CAN_ID_ECOCAN_H2_PACK2       0x031
+#define CAN_ID_ECOCAN_H2_ARM_ALARM   0x032
+#define CAN_ID_FDCAN_BOOSTPACK       0x040
+#define CAN_ID_FDCAN_BOOSTPACK2      0x041
+
+// IDs the results are published on (CAN_Transmit.c)
+#define CAN_ID_TX_FAN                0x300
+#define CAN_ID_TX_ELEC_EFF           0x301
+#define CAN_ID_TX_FUEL_EFF           0x302
+
+// every received message, decoded or only counted
+#define CAN_RX_MESSAGES 19
+extern const canMessageDef CAN_rx_messages[CAN_RX_MESSAGES];
+
+// field tables of the messages EDAS sends, for CAN_Transmit.c
+extern const canMessage CAN_msg_tx_fan;
+extern const canMessage CAN_msg_tx_elec_eff;
+extern const canMessage CAN_msg_tx_fuel_eff;
+
+#endif
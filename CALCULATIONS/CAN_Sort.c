@@ -1,141 +1,328 @@
-// Assuming all the data is coming in through an array of data
-// IncomingDATA is the pointer pointing to where the data is 
+// Assuming all the data is coming in as one CAN frame at a time
+// frame is the pointer pointing to where the received frame is
+// Each bus and ID has its own decoder in a lookup table, so a frame costs one table
+// read no matter how many IDs are decoded
 #include <stdio.h>
 #include <stdint.h>
 #include "typedefs.h"
+#include "CAN_Sort.h"
 
-void CAN_sort(  float timeD, uint32_t *IncomingDATA, 
-                float *mtrV_time, uint32_t *mtr_volt, uint32_t *mtr_curr, float *mtrC_time,
-                float *fcE_time, uint32_t *fc_joules, float *fcV_time, float *fcI_time,
-                uint32_t *fc_volt, uint32_t *fc_curr, uint32_t *drv_temp, uint32_t *drv_humd,
-                rData *SpeedVal, int *H2_Alarm)
-{    
-    uint32_t identifier;
-    // Assumming CAN 2.0A standard thus 11 bit identifier
-    // "identifier" is 2 array uint8_t
-    identifier = ((IncomingDATA[0] & 0x007F) << 4) | (IncomingDATA[1] & 0x00F0);
-
-    // setting up filter for accepting data
-    if (identifier == 0x0010) {                                              // indicating H2 alarm has been triggered
-        *H2_Alarm = IncomingDATA;
-    
-    } else if (identifier == 0x0150) {                                       // ID to get motor voltage and current
-        *mtrV_time = timeD;
-        *mtrC_time = timeD;
-        *mtr_volt = IncomingDATA[1];
-        *mtr_curr = IncomingDATA[0];
-    
-    } else if (identifier == 0x0140) {                                       // ID to get fuel cell energy amount left
-        *fcE_time = timeD;
-        *fc_joules = IncomingDATA[1];
-        // dont need Capacitor energy level in IncomingDATA[0];
-    
-    } else if (identifier == 0x0170) {                                       // ID to get fuel cell voltage and current
-        *fcV_time = timeD;
-        *fcI_time = timeD;
-        *fc_volt = IncomingDATA[1];
-        *fc_curr = IncomingDATA[0];
-    
-    } else if (identifier == 0x0220) {                                      // ID to get driver side temperature and humidity data
-        *drv_temp = IncomingDATA[1];
-        *drv_humd = IncomingDATA[0];
-    
-    } else if (identifier == 0x0990) {                                      // passing vehicle speed
-        SpeedVal -> time = timeD;
-        SpeedVal -> value = IncomingDATA[0];
+// one decoder per (bus, ID)
+typedef struct canEntry {
+    uint32_t key;               // 29 bit table: bus in the top 3 bits, ID below
+    uint8_t specific;           // registered for this bus only, not overwritten by any-bus registrations
+    canHandler fn;
+    void *ctx;
+} canEntry;
+
+// 11 bit IDs index one table per bus directly
+static canEntry CAN_std_table[CAN_MAX_BUSES][CAN_STD_IDS];
+
+// 29 bit IDs go into a small open addressed hash table keyed by bus and ID
+static canEntry CAN_ext_table[CAN_EXT_SLOTS];
+static int CAN_ext_count;
+
+// frames with no decoder registered
+uint64_t CAN_unhandled;
+uint64_t CAN_errors;
+
+// told when the registered ID set changes
+static canRegisterHook CAN_hook;
+static void *CAN_hook_ctx;
+
+static uint32_t CAN_ext_key(int bus, uint32_t id)
+{
+    return ((uint32_t) bus << 29) | (id & 0x1FFFFFFF);
+}
+
+// hashing bus + 29 bit ID to starting slot (Fibonacci hashing)
+static uint32_t CAN_ext_slot(uint32_t key)
+{
+    return (key * 2654435761u) >> (32 - CAN_EXT_BITS);
+}
+
+// entry set for bus and ID, NULL if there is no room - old gets the entry as it was before
+static canEntry *CAN_register_entry(int bus, uint32_t id, int extended, int specific, canHandler fn, void *ctx, canEntry *old)
+{
+    canEntry *e = NULL;
+
+    if (!extended) {
+        if (id >= CAN_STD_IDS)
+            return NULL;
+        e = &CAN_std_table[bus][id];
+        *old = *e;
+
+    } else {
+        uint32_t key = CAN_ext_key(bus, id);
+        uint32_t slot = CAN_ext_slot(key);
+
+        // linear probing, replace if already registered
+        for (int i = 0; i < CAN_EXT_SLOTS; i++)
+        {
+            canEntry *p = &CAN_ext_table[(slot + i) & (CAN_EXT_SLOTS - 1)];
+
+            if (p->fn != NULL && p->key == key) {
+                *old = *p;
+                e = p;
+                break;
+            }
+            if (p->fn == NULL) {
+                // keeping table at most half full so lookups stay short
+                if (CAN_ext_count >= CAN_EXT_SLOTS / 2)
+                    return NULL;
+                *old = *p;
+                p->key = key;
+                CAN_ext_count++;
+                e = p;
+                break;
+            }
+        }
+        if (e == NULL)
+            return NULL;
+    }
+
+    // a decoder for one bus wins over a decoder for every bus
+    if (e->fn != NULL && e->specific && !specific)
+        return e;
+
+    e->fn = fn;
+    e->ctx = ctx;
+    e->specific = specific;
+    return e;
+}
+
+// putting an entry back as it was before CAN_register_entry() - a 29 bit slot it took is free
+// again, which keeps the probe chains as they were as long as the latest entries go back first
+static void CAN_restore_entry(canEntry *e, int extended, const canEntry *old)
+{
+    if (extended && old->fn == NULL && e->fn != NULL)
+        CAN_ext_count--;
+    *e = *old;
+}
+
+int CAN_register_bus(int bus, uint32_t id, int extended, canHandler fn, void *ctx)
+{
+    canEntry *set[CAN_MAX_BUSES];
+    canEntry old[CAN_MAX_BUSES];
+    int ret = 0;
+
+    if (bus == CAN_BUS_ANY) {
+        // all buses or none - the buses done before one that failed are put back
+        for (int b = 0; b < CAN_MAX_BUSES; b++)
+        {
+            set[b] = CAN_register_entry(b, id, extended, 0, fn, ctx, &old[b]);
+            if (set[b] == NULL) {
+                while (b-- > 0)
+                    CAN_restore_entry(set[b], extended, &old[b]);
+                ret = -1;
+                break;
+            }
+        }
+    } else if (bus >= 0 && bus < CAN_MAX_BUSES) {
+        ret = (CAN_register_entry(bus, id, extended, 1, fn, ctx, &old[0]) != NULL) ? 0 : -1;
+    } else {
+        ret = -1;
+    }
+
+    if (ret == 0 && CAN_hook != NULL)
+        CAN_hook(CAN_hook_ctx);
+
+    return ret;
+}
+
+int CAN_register(uint32_t id, int extended, canHandler fn, void *ctx)
+{
+    return CAN_register_bus(CAN_BUS_ANY, id, extended, fn, ctx);
+}
+
+void CAN_set_register_hook(canRegisterHook fn, void *ctx)
+{
+    CAN_hook = fn;
+    CAN_hook_ctx = ctx;
+}
+
+int CAN_registered_ids(int bus, uint32_t *ids, int max)
+{
+    int n = 0;
+
+    for (uint32_t id = 0; id < CAN_STD_IDS; id++)
+    {
+        if (CAN_std_table[bus][id].fn == NULL)
+            continue;
+        if (n < max)
+            ids[n] = id;
+        n++;
+    }
+
+    for (int i = 0; i < CAN_EXT_SLOTS; i++)
+    {
+        const canEntry *e = &CAN_ext_table[i];
+        if (e->fn == NULL || (int) (e->key >> 29) != bus)
+            continue;
+        if (n < max)
+            ids[n] = (e->key & 0x1FFFFFFF) | CAN_ID_EXT_BIT;
+        n++;
     }
-    
+
+    return n;
 }
 
+void CAN_sort(const canFrame *frame)
+{
+    const canEntry *e = NULL;
+    int bus = frame->bus & (CAN_MAX_BUSES - 1);
 
+    // error frame IDs are error classes, not arbitration IDs
+    if (frame->flags & CAN_FRAME_ERR) {
+        CAN_errors++;
+        return;
+    }
 
+    if (!(frame->flags & CAN_FRAME_EFF)) {
+        e = &CAN_std_table[bus][frame->id & (CAN_STD_IDS - 1)];
 
+    } else {
+        uint32_t key = CAN_ext_key(bus, frame->id);
+        uint32_t slot = CAN_ext_slot(key);
+        for (int i = 0; i < CAN_EXT_SLOTS; i++)
+        {
+            const canEntry *p = &CAN_ext_table[(slot + i) & (CAN_EXT_SLOTS - 1)];
+            if (p->fn == NULL)
+                break;
+            if (p->key == key) {
+                e = p;
+                break;
+            }
+        }
+    }
 
+    if (e == NULL || e->fn == NULL) {
+        CAN_unhandled++;
+        return;
+    }
 
+    e->fn(frame, e->ctx);
+}
 
+/******************************************************************************************/
+// CAN FD payload lengths
+
+// DLC code -> payload bytes, DLC 9-15 are only valid for CAN FD
+const uint8_t CAN_dlc2len[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64 };
 
+// payload bytes -> smallest DLC code that holds them
+const uint8_t CAN_len2dlc[65] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8,                              // 0 - 8
+    9, 9, 9, 9,                                             // 9 - 12
+    10, 10, 10, 10,                                         // 13 - 16
+    11, 11, 11, 11,                                         // 17 - 20
+    12, 12, 12, 12,                                         // 21 - 24
+    13, 13, 13, 13, 13, 13, 13, 13,                         // 25 - 32
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,     // 33 - 48
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15      // 49 - 64
+};
 
 /******************************************************************************************/
-// draft code
-/* 
-    // for CAN FD
-    size_t byte2Extract;
-    switch (CAN_data_length)
+// message decoding - every field of a message pulled out of the payload in one pass,
+// read in place from the received frame, nothing allocated
+
+static canBinding CAN_bindings[CAN_MAX_MESSAGES];
+static int CAN_binding_count;
+
+// frames shorter than a field needs
+uint64_t CAN_short_frames;
+
+// remembering first frame time for seconds-since-start values
+static void CAN_time(signalStore *store, const canFrame *frame)
+{
+    if (store->start_ns == 0)
+        store->start_ns = frame->time_ns;
+}
+
+// reading one field of 1 - 4 bytes, little endian unless flagged
+static uint32_t CAN_field_raw(const uint8_t *p, const canField *f)
+{
+    uint32_t raw = 0;
+
+    if (f->flags & CAN_FIELD_BIG_ENDIAN) {
+        for (int i = 0; i < f->width; i++)
+            raw = (raw << 8) | p[i];
+    } else {
+        for (int i = f->width - 1; i >= 0; i--)
+            raw = (raw << 8) | p[i];
+    }
+
+    return raw;
+}
+
+void CAN_decode_message(const canFrame *frame, void *ctx)
+{
+    const canBinding *b = ctx;
+    const canMessage *msg = b->msg;
+
+    CAN_time(b->store, frame);
+
+    for (int i = 0; i < msg->n_fields; i++)
     {
-        case 0:
-            byte2Extract = 0;
-            break;
-
-        case 1:
-            byte2Extract = 1;
-            break;
-
-        case 2:
-            byte2Extract = 2;
-            break;
-            
-        case 3:
-            byte2Extract = 3;
-            break;
-        
-        case 4:
-            byte2Extract = 4;
-            break;
-        
-        case 5:
-            byte2Extract = 5;
-            break;
-
-        case 6:
-            byte2Extract = 6;
-            break;
-
-        case 7:
-            byte2Extract = 7;
-            break;
-
-        case 8:
-            byte2Extract = 8;
-            break;
-
-        case 9:
-            byte2Extract = 12;
-            break;
-        
-        case 10:
-            byte2Extract = 16;
-            break;
-
-        case 11:
-            byte2Extract = 20;
-            break;
-
-        case 12:
-            byte2Extract = 24;
-            break;
-
-        case 13:
-            byte2Extract = 32;
-            break;
-
-        case 14:
-            byte2Extract = 48;
-            break;
-
-        case 15:
-            byte2Extract = 64;
-            break;
+        const canField *f = &msg->fields[i];
+
+        // field not in this frame, leave the signal as it was
+        if (f->offset + f->width > frame->len) {
+            CAN_short_frames++;
+            continue;
+        }
+
+        uint32_t raw = CAN_field_raw(&frame->data[f->offset], f);
+        float value;
+
+        if (f->flags & CAN_FIELD_SIGNED) {
+            // sign extending from the field width
+            int shift = 32 - 8 * f->width;
+            value = (float) ((int32_t) (raw << shift) >> shift);
+        } else {
+            value = (float) raw;
+        }
+
+        signal_store_set(b->store, f->signal, raw, value * f->scale + f->offset_val, frame->time_ns);
     }
+}
+
+int CAN_register_decoder(int bus, uint32_t id, int extended, const canMessage *msg, canHandler fn, signalStore *store)
+{
+    if (CAN_binding_count >= CAN_MAX_MESSAGES)
+        return -1;
 
-    size_t bit2Extract = byte2Extract * 8;
-    data -> WRK_data_size = byte2Extract;
+    canBinding *b = &CAN_bindings[CAN_binding_count];
+    b->msg = msg;
+    b->store = store;
 
-    // Allocating 1 byte more than required memory space
-    size_t byteSpace = byte2Extract + 1;
-    data -> WRK_data = (uint8_t *) malloc (byteSpace);
+    if (CAN_register_bus(bus, id, extended, fn, b) < 0)
+        return -1;
+
+    CAN_binding_count++;
+    return 0;
+}
 
-    for (size_t i = 0; i < byteSpace; i++)
+int CAN_register_message(int bus, uint32_t id, int extended, const canMessage *msg, signalStore *store)
+{
+    return CAN_register_decoder(bus, id, extended, msg, CAN_decode_message, store);
+}
+
+/******************************************************************************************/
+// messages from signals.dbc - each with the decoder generated for its fields (CAN_Defs.c)
+
+int CAN_sort_init(signalStore *store)
+{
+    int ret = 0;
+
+    for (int i = 0; i < CAN_RX_MESSAGES; i++)
     {
-        data -> WRK_data[i] = IncomingDATA[2 + i];
+        const canMessageDef *m = &CAN_rx_messages[i];
+
+        // IDs only counted by the statistics have nothing to decode
+        if (m->decode != NULL && CAN_register_decoder(CAN_BUS_ANY, m->id, m->extended, m->msg, m->decode, store) < 0)
+            ret = -1;
     }
-    */
\ No newline at end of file
+
+    return ret;
+}
@@ -0,0 +1,129 @@
+#ifndef CAN_SORT_H
+#define CAN_SORT_H
+
+#include <stdint.h>
+#include "typedefs.h"
+#include "Signal_Store.h"
+
+// CAN IDs and the decoder tables are generated from signals.dbc into CAN_Defs.h / .c (included below)
+
+// lookup table sizes
+#define CAN_STD_IDS     2048            // every 11 bit ID has its own slot
+#define CAN_EXT_BITS    9
+#define CAN_EXT_SLOTS   (1 << CAN_EXT_BITS)     // 29 bit (bus, ID) pairs, at most half of this can be registered
+
+// register for every bus
+#define CAN_BUS_ANY     (-1)
+
+// set in IDs returned by CAN_registered_ids() for 29 bit IDs
+#define CAN_ID_EXT_BIT  0x80000000u
+
+// decoder called for every frame with its ID
+typedef void (*canHandler)(const canFrame *frame, void *ctx);
+
+// how a field is stored in the payload
+#define CAN_FIELD_SIGNED        0x01
+#define CAN_FIELD_BIG_ENDIAN    0x02
+
+// most messages that can be registered with CAN_register_message()
+#define CAN_MAX_MESSAGES        64
+
+// one signal inside a CAN / CAN FD payload
+// value = raw * scale + offset_val
+typedef struct canField {
+    uint8_t signal;             // signalId the value goes to
+    uint8_t offset;             // first byte in the payload (0 - 63)
+    uint8_t width;              // bytes, 1 - 4
+    uint8_t flags;              // CAN_FIELD_*
+    float scale;
+    float offset_val;
+} canField;
+
+// every field carried by one ID
+typedef struct canMessage {
+    uint8_t n_fields;
+    const canField *fields;
+} canMessage;
+
+// a registered message and the store its signals go to - ctx of every message decoder
+typedef struct canBinding {
+    const canMessage *msg;
+    signalStore *store;
+} canBinding;
+
+// one received message from signals.dbc (CAN_rx_messages in CAN_Defs.c)
+typedef struct canMessageDef {
+    uint32_t id;
+    uint8_t extended;
+    uint8_t len;                // payload length from the description, 0 = not known
+    const char *name;
+    const canMessage *msg;      // its fields, NULL if nothing in it is decoded
+    canHandler decode;          // decoder generated for exactly these fields, ctx is a canBinding
+} canMessageDef;
+
+// called after the set of registered IDs changed
+typedef void (*canRegisterHook)(void *ctx);
+
+
+// frames that had no decoder registered
+extern uint64_t CAN_unhandled;
+
+// error frames from the controller, never passed to decoders
+extern uint64_t CAN_errors;
+
+// frames too short for a field of their message
+extern uint64_t CAN_short_frames;
+
+// CAN FD DLC code <-> payload length - the receiver rounds an FD length up to a DLC step,
+// the transmitter sets the DLC code from the length
+extern const uint8_t CAN_dlc2len[16];
+extern const uint8_t CAN_len2dlc[65];
+
+// register decoder for one ID on every bus, replaces the previous one - call at startup
+// returns 0 or -1 if ID is out of range or the 29 bit table is full
+int CAN_register(uint32_t id, int extended, canHandler fn, void *ctx);
+
+// same for one bus (0 - CAN_MAX_BUSES-1) or CAN_BUS_ANY
+// a decoder for one bus is not replaced by a later CAN_BUS_ANY registration
+// returns -1 if there is no room, nothing is registered then (on no bus for CAN_BUS_ANY)
+int CAN_register_bus(int bus, uint32_t id, int extended, canHandler fn, void *ctx);
+
+// copy every ID registered for bus into ids (29 bit IDs have CAN_ID_EXT_BIT set)
+// returns total number registered, which can be more than max
+int CAN_registered_ids(int bus, uint32_t *ids, int max);
+
+// hook called whenever a decoder is added, e.g. to update the kernel filters
+void CAN_set_register_hook(canRegisterHook fn, void *ctx);
+
+// register a table driven decoder for bus (or CAN_BUS_ANY) - every field of msg is extracted
+// in one pass and written into the signal store, msg must stay valid (normally a static const table)
+int CAN_register_message(int bus, uint32_t id, int extended, const canMessage *msg, signalStore *store);
+
+// same with a decoder of its own for the message (ctx is a canBinding of msg and store)
+int CAN_register_decoder(int bus, uint32_t id, int extended, const canMessage *msg, canHandler fn, signalStore *store);
+
+// table driven decoder behind CAN_register_message(), also the fallback of the generated
+// decoders for frames too short for every field - fields past the end are skipped and counted
+void CAN_decode_message(const canFrame *frame, void *ctx);
+
+// fields read from the payload, the compiler turns these into single loads
+static inline uint32_t CAN_get_le8(const uint8_t *p) { return p[0]; }
+static inline uint32_t CAN_get_be8(const uint8_t *p) { return p[0]; }
+static inline uint32_t CAN_get_le16(const uint8_t *p) { return (uint32_t) p[0] | (uint32_t) p[1] << 8; }
+static inline uint32_t CAN_get_be16(const uint8_t *p) { return (uint32_t) p[0] << 8 | (uint32_t) p[1]; }
+static inline uint32_t CAN_get_le24(const uint8_t *p) { return CAN_get_le16(p) | (uint32_t) p[2] << 16; }
+static inline uint32_t CAN_get_be24(const uint8_t *p) { return CAN_get_be16(p) << 8 | (uint32_t) p[2]; }
+static inline uint32_t CAN_get_le32(const uint8_t *p) { return CAN_get_le24(p) | (uint32_t) p[3] << 24; }
+static inline uint32_t CAN_get_be32(const uint8_t *p) { return CAN_get_be24(p) << 8 | (uint32_t) p[3]; }
+
+// register the decoders of every message in signals.dbc, writing into the signal store
+// decoders only set values - wrap CAN_sort() calls in signal_store_write_begin()/end()
+// returns -1 if one of them could not be registered, the others are in place
+int CAN_sort_init(signalStore *store);
+
+// pass frame to the decoder registered for its ID
+void CAN_sort(const canFrame *frame);
+
+#include "CAN_Defs.h"
+
+#endif
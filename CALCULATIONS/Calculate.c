@@ -0,0 +1,333 @@
+// Name: Calculate
+// Description: One calculation pass over the latest signals - efficiencies, fan control,
+//              publishing results and queueing them for the CSV files
+
+// Split into stages so the benchmark can time each one on its own
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include "Elec_Efficiency.h"
+#include "Fuel_Efficiency.h"
+#include "Fan_Control.h"
+#include "SaveArray2Data.h"
+#include "Resample.h"
+#include "Lap_Engine.h"
+#include "Energy_Integrator.h"
+#include "Range_Estimator.h"
+#include "Telemetry_Log.h"
+#include "Flight_Recorder.h"
+#include "Calculate.h"
+
+// previous and latest sample for the fuel efficiency
+rData SpeedVal[2], fuelVal[2];
+
+// storing calculated data from program
+dataStruct Fuel_Eff, Elec_Eff;
+uint32_t fan_RPM;
+
+// cabin fan loop, on its own thread once main.c opens its timer
+fanLoop fan;
+
+// for storing calculated running average values
+float PreCal_FEff = 0;
+float inst_FEff;
+runStats FEff_run;
+
+float PreCal_EEff;
+float inst_EEff;
+runStats EEff_run;
+
+// fuel efficiency over the last CALC_WINDOW_S seconds
+winStats FEff_window;
+
+// laps from the integrated speed or the lap marker, per lap results and efficiency
+lapEngine laps;
+double lapTrack_m = CALC_TRACK_M;
+int lapMarker = 0;
+uint32_t lapsSaved;
+
+// motor, fuel cell and speed aligned onto one tick for the efficiencies
+resampler aligner;
+
+// motor and fuel cell energy from the powers, checked against fc_joules
+energyInt energy;
+
+// distance and laps left from the fuel cell and battery energy
+rangeEst range;
+
+// tick each efficiency was last calculated for, and the last tick (distance, energy, range)
+uint64_t fuelTick_ns, elecTick_ns, lastTick_ns;
+
+// CSV files, written out by the log writer's own thread - streams are -1 until opened
+logWriter logw;
+int EEff_log = -1, FEff_log = -1, lap_log = -1;
+
+// every signal compressed into one file through the same writer, stream -1 until opened
+tlogWriter tlog = { .stream = -1 };
+
+// last minutes of every signal in a mapped file, written in place - hdr NULL until opened
+flightRec flight;
+
+void initializeSpeedVal() {
+    SpeedVal[0].time    = 0.0;
+    SpeedVal[1].time    = 0.0;
+    fuelVal[0].time     = 0.0;
+    fuelVal[1].time     = 0.0;
+
+    SpeedVal[0].value   = 0;
+    SpeedVal[1].value   = 0;
+    fuelVal[0].value    = 0;
+    fuelVal[1].value    = 0;
+
+    PreCal_FEff = 0;
+    PreCal_EEff = 0;
+    run_stats_init(&FEff_run);
+    run_stats_init(&EEff_run);
+    win_stats_init(&FEff_window, (uint64_t) CALC_WINDOW_S * 1000000000ull);
+    lap_engine_init(&laps, lapTrack_m, LAP_MIN_S, lapMarker);
+    lapsSaved = 0;
+    energy_int_init(&energy, CALC_WINDOW_S);
+    range_est_init(&range);
+    range.lap_m = lapTrack_m;
+    fan_loop_init(&fan, NULL, NULL);
+
+    resample_init(&aligner, RESAMPLE_TICK_MS);
+}
+
+int calc_resample(const signalStore *store) {
+    // new motor, fuel cell and speed samples of the frame just decoded go into the history
+    return resample_store(&aligner, store);
+}
+
+int calc_fuel(signalStore *store, const alignedSample *a) {
+    // keeping previous and latest tick for the fuel efficiency
+    SpeedVal[0] = SpeedVal[1];
+    fuelVal[0] = fuelVal[1];
+    SpeedVal[1].time = signal_store_seconds(store, a->time_ns);
+    SpeedVal[1].value = (uint32_t) (a->raw[RS_SPEED] + 0.5);
+    fuelVal[1].time = SpeedVal[1].time;
+    fuelVal[1].value = (uint32_t) (a->raw[RS_FC_JOULES] + 0.5);
+
+    // distance and lap from the same tick, raw values are in 1/10000 units
+    if (lap_engine_sample(&laps, a->time_ns, a->raw[RS_SPEED] * SIG_SPEED_SCALE, a->raw[RS_FC_JOULES] * SIG_FC_JOULES_SCALE))
+        range_est_lap(&range, lap_engine_result(&laps, 0));
+
+    // fuel cell energy only, the same basis as the lap energy - the battery (0x050) joins once
+    // its layout is confirmed and its drop is counted per lap as well
+    range_est_sample(&range, laps.distance_m, a->raw[RS_FC_JOULES] * SIG_FC_JOULES_SCALE);
+    lastTick_ns = a->time_ns;
+
+    // need two ticks to get a distance
+    if (SpeedVal[0].time == 0)
+        return 0;
+
+    // Calculate efficiency - instant and running average
+    float inst;
+    PreCal_FEff = fuel_efficiency(  SpeedVal[0].value,
+                                    SpeedVal[1].value,
+                                    fuelVal[0].value,
+                                    fuelVal[1].value,
+                                    SpeedVal[0].time,
+                                    SpeedVal[1].time,
+                                    fuelVal[0].time,
+                                    fuelVal[1].time,
+                                    &FEff_run, &inst);
+
+    // no fuel used this tick - nothing to average or save, the last reading stays published
+    if (isnan(inst))
+        return 0;
+    inst_FEff = inst;
+    Fuel_Eff.index_num = (int) FEff_run.n;
+
+    // same instant value into the recent and per lap averages
+    win_stats_add(&FEff_window, a->time_ns, inst_FEff);
+    lap_engine_eff(&laps, inst_FEff);
+    Fuel_Eff.time = SpeedVal[1].time;
+    fuelTick_ns = a->time_ns;
+    return 1;
+}
+
+int calc_elec(signalStore *store, const alignedSample *a) {
+    float tick_T = signal_store_seconds(store, a->time_ns);
+
+    // motor and fuel cell values are at the same instant now
+    float inst;
+    PreCal_EEff = elec_efficiency(  (uint32_t) (a->raw[RS_MTR_VOLT] + 0.5), (uint32_t) (a->raw[RS_MTR_CURR] + 0.5),
+                                    (uint32_t) (a->raw[RS_FC_VOLT] + 0.5), (uint32_t) (a->raw[RS_FC_CURR] + 0.5),
+                                    (uint32_t) (a->raw[RS_FC_JOULES] + 0.5),
+                                    tick_T, tick_T, &EEff_run, &inst);
+
+    // powers from the raw values, fc_joules as reported - also while the fuel cell is off
+    energy_int_sample(&energy, a->time_ns,
+                      a->raw[RS_MTR_VOLT] * a->raw[RS_MTR_CURR] * (SIG_MTR_VOLT_SCALE * SIG_MTR_CURR_SCALE),
+                      a->raw[RS_FC_VOLT] * a->raw[RS_FC_CURR] * (SIG_FC_VOLT_SCALE * SIG_FC_CURR_SCALE),
+                      a->raw[RS_FC_JOULES] * SIG_FC_JOULES_SCALE);
+    lastTick_ns = a->time_ns;
+
+    // fuel cell gives no power - nothing to save, the last reading stays published
+    if (isnan(inst))
+        return 0;
+    inst_EEff = inst;
+    Elec_Eff.index_num = (int) EEff_run.n;
+    Elec_Eff.time = tick_T;
+    elecTick_ns = a->time_ns;
+    return 1;
+}
+
+int calc_fan(const signalSnapshot *snap) {
+    // without the loop thread (benchmark) the controller steps once per pass instead
+    if (fan.tfd < 0)
+        fan_loop_step(&fan, snap, mono_ns());
+
+    uint32_t rpm = atomic_load_explicit(&fan.rpm, memory_order_relaxed);
+    int changed = (rpm != fan_RPM);
+
+    // Controlling driver fan
+    fan_RPM = rpm;
+    return changed;
+}
+
+void calc_publish(signalStore *store) {
+    // publishing the results of the latest tick, efficiencies stamped with the tick they were
+    // calculated for - a tick without one leaves the old value under its old time, so the logs
+    // and the GUI do not take it for a new one
+    signal_store_write_begin(store);
+    if (elecTick_ns != 0) {
+        signal_store_set(store, SIG_ELEC_EFF, 0, inst_EEff, elecTick_ns);
+        signal_store_set(store, SIG_ELEC_EFF_AVG, 0, PreCal_EEff, elecTick_ns);
+    }
+    if (fuelTick_ns != 0) {
+        signal_store_set(store, SIG_FUEL_EFF, 0, inst_FEff, fuelTick_ns);
+        signal_store_set(store, SIG_FUEL_EFF_AVG, 0, PreCal_FEff, fuelTick_ns);
+        signal_store_set(store, SIG_FUEL_EFF_WIN, 0, win_stats_mean(&FEff_window), fuelTick_ns);
+        signal_store_set(store, SIG_FUEL_EFF_LAP, 0, run_stats_mean(&laps.eff.current), fuelTick_ns);
+    }
+    if (lastTick_ns != 0) {
+        signal_store_set(store, SIG_LAP_NUM, laps.laps + 1, (float) (laps.laps + 1), lastTick_ns);
+        signal_store_set(store, SIG_LAP_DIST, 0, (float) lap_engine_lap_m(&laps), lastTick_ns);
+        signal_store_set(store, SIG_MTR_ENERGY, 0, (float) energy_int_motor(&energy), lastTick_ns);
+        signal_store_set(store, SIG_FC_ENERGY, 0, (float) energy_int_fc(&energy), lastTick_ns);
+        signal_store_set(store, SIG_ENERGY_DRIFT, 0, (float) energy_int_drift(&energy), lastTick_ns);
+        signal_store_set(store, SIG_ENERGY_RATIO, 0, (float) energy_int_consistency(&energy), lastTick_ns);
+    }
+    signal_store_write_end(store);
+
+    double left_m = range_est_distance_left(&range);
+    if (lastTick_ns != 0 && left_m >= 0) {
+        double left_laps = range_est_laps_left(&range);
+        signal_store_write_begin(store);
+        signal_store_set(store, SIG_RANGE_M, 0, (float) left_m, lastTick_ns);
+        if (left_laps >= 0)
+            signal_store_set(store, SIG_LAPS_LEFT, (uint32_t) left_laps, (float) left_laps, lastTick_ns);
+        signal_store_write_end(store);
+    }
+
+    // last finished lap, stamped with the time it finished
+    const lapResult *lap = lap_engine_result(&laps, 0);
+    if (lap != NULL) {
+        signal_store_write_begin(store);
+        signal_store_set(store, SIG_LAP_TIME, lap->lap, lap->time_s, lap->end_ns);
+        signal_store_set(store, SIG_LAP_ENERGY, lap->lap, lap->energy_j, lap->end_ns);
+        signal_store_set(store, SIG_LAP_SPEED, lap->lap, lap->avg_speed, lap->end_ns);
+        signal_store_set(store, SIG_LAP_EFF, lap->lap, lap->avg_eff, lap->end_ns);
+        signal_store_write_end(store);
+    }
+}
+
+void calc_publish_fan(signalStore *store) {
+    // fan output of the latest loop step, stamped with the temperature it worked from
+    uint64_t fan_ns = atomic_load_explicit(&fan.time_ns, memory_order_acquire);
+    float heat = atomic_load_explicit(&fan.heat_mc, memory_order_relaxed) * 1e-3f;
+    float setpoint = atomic_load_explicit(&fan.setpoint_mc, memory_order_relaxed) * 1e-3f;
+    signal_store_write_begin(store);
+    signal_store_set(store, SIG_FAN_RPM, fan_RPM, (float) fan_RPM, fan_ns);
+    signal_store_set(store, SIG_FAN_SETPOINT, (uint32_t) lroundf(setpoint), setpoint, fan_ns);
+    signal_store_set(store, SIG_HEAT_INDEX, (heat > 0) ? (uint32_t) lroundf(heat) : 0, heat, fan_ns);
+    signal_store_write_end(store);
+}
+
+int calc_lap(uint64_t time_ns) {
+    if (!lap_engine_marker(&laps, time_ns))
+        return 0;
+    range_est_lap(&range, lap_engine_result(&laps, 0));
+    return 1;
+}
+
+int calc_log_open(logFsync sync, uint32_t fsync_ms, logFull full) {
+    if (log_writer_open(&logw, sync, fsync_ms, full) < 0)
+        return -1;
+
+    EEff_log = saveFileOpen(&logw, 1);
+    FEff_log = saveFileOpen(&logw, 2);
+    lap_log = saveFileOpen(&logw, 3);
+    return (EEff_log < 0 || FEff_log < 0 || lap_log < 0) ? -1 : 0;
+}
+
+int calc_tlog_open(const char *path) {
+    if (!logw.running)
+        return -1;
+    return tlog_open(&tlog, &logw, path);
+}
+
+void calc_log_close(void) {
+    // last part chunk of the telemetry log before the writer stops
+    tlog_close(&tlog);
+    log_writer_close(&logw);
+    EEff_log = FEff_log = lap_log = -1;
+}
+
+int calc_save(int newFuel, int newElec) {
+    int saved = 0;
+
+    // a copy into the writer's block, the file is written on its thread
+    if (newFuel)
+        saved |= saveSample2File(&logw, FEff_log, &Fuel_Eff, inst_FEff);
+    if (newElec)
+        saved |= saveSample2File(&logw, EEff_log, &Elec_Eff, inst_EEff);
+
+    // one line per finished lap, oldest first
+    while (lapsSaved < laps.laps) {
+        const lapResult *lap = lap_engine_result(&laps, laps.laps - 1 - lapsSaved);
+        if (lap != NULL)
+            saved |= saveLap2File(&logw, lap_log, lap);
+        lapsSaved++;
+    }
+
+    // blocks that have waited too long go out part full
+    if (logw.running)
+        log_writer_poll(&logw);
+
+    return saved;
+}
+
+void calc_record(const signalStore *store) {
+    // the store is only written from this thread, so it is read as it is - after each frame
+    // for the decoded signals, after each tick for the results
+    tlog_store(&tlog, store);
+    flight_rec_store(&flight, store);
+}
+
+void calculate(signalStore *store) {
+    signalSnapshot snap;
+
+    // one consistent view of all the signals for this pass - this thread is the writer, so the
+    // store is never busy here and the snapshot always succeeds
+    signal_store_snapshot(store, &snap);
+
+    // efficiencies once for every tick all the inputs have reached (calc_resample() ran after
+    // every frame), each tick's results published and recorded before the next one replaces them
+    alignedSample a;
+    while (resample_next(&aligner, &a))
+    {
+        int newFuel = calc_fuel(store, &a);
+        int newElec = calc_elec(store, &a);
+        calc_save(newFuel, newElec);
+        calc_publish(store);
+        calc_record(store);
+    }
+
+    calc_fan(&snap);
+    calc_publish_fan(store);
+    calc_record(store);
+}
@@ -0,0 +1,73 @@
+#ifndef CALCULATE_H
+#define CALCULATE_H
+
+#include <stdint.h>
+#include "typedefs.h"
+#include "Signal_Store.h"
+#include "Resample.h"
+#include "Stream_Stats.h"
+#include "Lap_Engine.h"
+#include "Energy_Integrator.h"
+#include "Range_Estimator.h"
+#include "Fan_Control.h"
+#include "Log_Writer.h"
+#include "Telemetry_Log.h"
+#include "Flight_Recorder.h"
+
+// length of the recent fuel efficiency average in seconds
+#define CALC_WINDOW_S 60
+
+// default track length in metres, 0 = laps only from the lap marker
+#define CALC_TRACK_M 0
+
+// results of the last pass
+extern dataStruct Fuel_Eff, Elec_Eff;
+extern float inst_FEff, PreCal_FEff;
+extern float inst_EEff, PreCal_EEff;
+extern uint32_t fan_RPM;
+extern fanLoop fan;                 // fan_loop_open() it after initializeSpeedVal() to run it on a thread
+extern resampler aligner;
+extern runStats FEff_run, EEff_run;
+extern winStats FEff_window;
+extern lapEngine laps;
+extern double lapTrack_m;          // set before initializeSpeedVal()
+extern int lapMarker;              // a lap marker is watched, laps close only there - set before initializeSpeedVal()
+extern energyInt energy;
+extern rangeEst range;
+extern logWriter logw;              // calc_log_open() it for the CSV files
+extern tlogWriter tlog;             // calc_tlog_open() it for the telemetry log
+extern flightRec flight;            // flight_rec_open() it to keep the last minutes through a crash
+
+// function to initialize values so calculation can start now
+void initializeSpeedVal();
+
+// stages of one calculation pass, in order - each returns 1 if it produced a new value
+// calc_resample() feeds the samples of one frame to the aligner, calc_fuel() / calc_elec() /
+// calc_save() / calc_publish() / calc_record() then run for every tick resample_next() gives out
+int calc_resample(const signalStore *store);
+int calc_fuel(signalStore *store, const alignedSample *a);
+int calc_elec(signalStore *store, const alignedSample *a);
+int calc_fan(const signalSnapshot *snap);
+void calc_publish(signalStore *store);
+void calc_publish_fan(signalStore *store);
+int calc_save(int newFuel, int newElec);
+void calc_record(const signalStore *store);
+
+// calc_resample() and calc_record() are called after every frame the decoder takes, so a message
+// that comes more than once in a batch is used and recorded every time, not only with its last value
+
+// starting the writer of Elec_Eff.csv, Fuel_Eff.csv and Laps.csv - without it nothing is saved
+int calc_log_open(logFsync sync, uint32_t fsync_ms, logFull full);
+void calc_log_close(void);
+
+// every signal into the telemetry log at path as well, after calc_log_open() - off until then
+int calc_tlog_open(const char *path);
+
+// lap marker passed - returns 1 if it closed a lap (not a bounce)
+int calc_lap(uint64_t time_ns);
+
+// Running the calculations on the latest data - all stages above but calc_resample(), which
+// the caller runs after each frame as it decodes it
+void calculate(signalStore *store);
+
+#endif
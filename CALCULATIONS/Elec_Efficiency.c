@@ -1,65 +1,68 @@
 // Assumptions are: 
 // (1) speed value is directly presented by sensor
-// (2) time data is in uint32_t format
+// (2) time data is in seconds (float), both values taken at the same instant
 // ---------------------------
 // Value returned directly: average electrical efficiency
-// Values returned through pointers: Count and Instant electrical Efficiency
+// Values returned through pointers: Instant electrical Efficiency (NaN if the fuel cell gives no
+// power or it is out of range - the average is then left alone), running statistics updated in avg_EEff
 /* ------------------------------------------------------------------------------------------------------------- */
 
 #include <stdio.h>
 #include <stdint.h>
+#include <math.h>
+#include "Stream_Stats.h"
+#include "Fixed_Point.h"
+
+// the fixed point powers assume every input has the same raw scale (signals.dbc)
+_Static_assert(SIG_MTR_CURR_DIV == Q16_RAW_SCALE && SIG_FC_VOLT_DIV == Q16_RAW_SCALE &&
+               SIG_FC_CURR_DIV == Q16_RAW_SCALE, "power inputs need the raw scale of Fixed_Point.h");
 
 // Acceptable time difference of incoming fuel data and speed data
-float setD_Time = 0.5;
+static float setD_Time = 0.5;
 
 // main program to calculate electrical efficiency
-float elec_efficiency(uint32_t mtr_volt, uint32_t mtr_curr, uint32_t fc_volt, uint32_t fc_curr, uint32_t fc_joules, uint32_t time_MTR, uint32_t time_FC, float PreCal_EEff, float* instant_EEff, int* data_Ecnt)
+float elec_efficiency(uint32_t mtr_volt, uint32_t mtr_curr, uint32_t fc_volt, uint32_t fc_curr, uint32_t fc_joules, float time_MTR, float time_FC, runStats* avg_EEff, float* instant_EEff)
 {
-    // keeping count for data storage
-    int count = *data_Ecnt;
-
-    // data processing variables
-    // motor voltage and current
-    float mtr_V = ((float) mtr_volt) / 10000;
-    float mtr_I = ((float) mtr_curr) / 10000;
-
-    // fuel cell voltage and current
-    float fc_V = ((float) fc_volt) / 10000;
-    float fc_I = ((float) fc_curr) / 10000;
-
-    // energy in Joules
-    float fc_E = ((float) fc_joules) / 10000;
+    // voltages and currents stay raw (1/10000 units) - powers are formed in fixed point (Fixed_Point.h)
+    // energy is integrated from the powers and checked against fc_joules in Energy_Integrator.c
+    (void) fc_joules;
 
     // making sure time of data is within reason
     float timeMT_f = (float) time_MTR;
     float timeFC_f = (float) time_FC;
 
-    // for basic calculations
-    float mtr_PWR, fc_PWR, elec_Eff;
-    float avg_EEff;
+    // for basic calculations, Q16.16
+    q16_t mtr_PWR, fc_PWR;
 
     float instant_eff;
 
     // "while" loop to make sure data are within acceptable time frame since most data wont be synchronized
-    while (abs(timeMT_f - timeFC_f) < setD_Time)
+    while (fabsf(timeMT_f - timeFC_f) < setD_Time)
     {
         // Pre-calculation of powers
-        mtr_PWR = mtr_V * mtr_I;
-        fc_PWR = fc_V * fc_I;
+        mtr_PWR = q16_power_raw(mtr_volt, mtr_curr);
+        fc_PWR = q16_power_raw(fc_volt, fc_curr);
+
+        // Instant efficiency calculation from the raw values (rounded once) - saturates if the fuel cell gives no power
+        q16_t eff = (fc_PWR > 0) ? q16_power_ratio_raw(mtr_volt, mtr_curr, fc_volt, fc_curr)
+                                 : q16_div_sat(mtr_PWR, fc_PWR);
 
-        // Instant efficiency calculation
-        instant_eff = mtr_PWR / fc_PWR;
+        // fuel cell off: no reading, the averages keep what they have
+        if (fc_PWR <= 0 || q16_no_result(eff)) {
+            *instant_EEff = NAN;
+            return run_stats_mean(avg_EEff);
+        }
+        instant_eff = q16_to_float(eff);
 
         // Updating Average efficiency calculation
-        avg_EEff = (PreCal_EEff * count + instant_eff)/(count + 1);
-        
+        run_stats_add(avg_EEff, instant_eff);
+
         // Updating other info through pointers
-        (*data_Ecnt)++;
         *instant_EEff = instant_eff;
 
-        return avg_EEff;
+        return run_stats_mean(avg_EEff);
     }
     
-    // if "while" condition not met, then return 0
-    exit ();
+    // if "while" condition not met, then keep previous average
+    return run_stats_mean(avg_EEff);
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+// Name: Energy_Integrator
+// Description: Motor (0x150) and fuel cell (0x170) power integrated into energy, cross-checked
+//              against the fuel cell energy reported in 0x140
+
+// fc_joules used to be read and then ignored. Powers are integrated with the trapezoid rule on
+// the aligned ticks into Kahan sums, so a multi-hour run does not lose the small steps; the
+// same intervals of reported fc_joules are summed next to them. Their difference is the drift,
+// their ratio over the last window shows whether the two still agree. Fixed size, O(1) per sample.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "Energy_Integrator.h"
+
+void energy_int_init(energyInt *e, uint32_t window_s)
+{
+    memset(e, 0, sizeof(*e));
+    win_stats_init(&e->fc_win, (uint64_t) window_s * 1000000000ull);
+    win_stats_init(&e->reported_win, (uint64_t) window_s * 1000000000ull);
+}
+
+void energy_int_sample(energyInt *e, uint64_t time_ns, double mtr_w, double fc_w, double joules)
+{
+    if (e->last_ns != 0 && time_ns <= e->last_ns)
+        return;
+
+    if (e->last_ns != 0) {
+        uint64_t dt_ns = time_ns - e->last_ns;
+
+        if (dt_ns > (uint64_t) ENERGY_MAX_GAP_MS * 1000000ull) {
+            // dropout - start again from this sample
+            e->gaps++;
+        } else {
+            double dt = (double) dt_ns * 1e-9;
+            double fc_step = (e->last_fc_w + fc_w) * 0.5 * dt;
+            double reported_step = e->last_joules - joules;
+
+            kahan_add(&e->mtr_j, &e->mtr_c, (e->last_mtr_w + mtr_w) * 0.5 * dt);
+            kahan_add(&e->fc_j, &e->fc_c, fc_step);
+            kahan_add(&e->reported_j, &e->reported_c, reported_step);
+            win_stats_add(&e->fc_win, time_ns, fc_step);
+            win_stats_add(&e->reported_win, time_ns, reported_step);
+        }
+    }
+
+    e->last_ns = time_ns;
+    e->last_mtr_w = mtr_w;
+    e->last_fc_w = fc_w;
+    e->last_joules = joules;
+    e->samples++;
+}
+
+double energy_int_motor(const energyInt *e)
+{
+    return e->mtr_j;
+}
+
+double energy_int_fc(const energyInt *e)
+{
+    return e->fc_j;
+}
+
+double energy_int_reported(const energyInt *e)
+{
+    return e->reported_j;
+}
+
+double energy_int_drift(const energyInt *e)
+{
+    return e->fc_j - e->reported_j;
+}
+
+double energy_int_consistency(const energyInt *e)
+{
+    // both windows hold the same intervals, so the ratio of means is the ratio of sums
+    double fc = win_stats_mean(&e->fc_win);
+    return (fc > 0) ? win_stats_mean(&e->reported_win) / fc : 0.0;
+}
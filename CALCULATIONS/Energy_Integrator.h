@@ -0,0 +1,46 @@
+#ifndef ENERGY_INTEGRATOR_H
+#define ENERGY_INTEGRATOR_H
+
+#include <stdint.h>
+#include "Stream_Stats.h"
+
+// two samples further apart than this are not integrated across, same as the resampler
+#define ENERGY_MAX_GAP_MS   1000
+
+// motor and fuel cell power integrated into energy, checked against the reported fc_joules
+typedef struct energyInt {
+    uint64_t last_ns;           // previous sample, 0 = none yet
+    double last_mtr_w, last_fc_w;
+    double last_joules;         // fc_joules at the previous sample
+
+    // compensated totals since the start, J
+    double mtr_j, mtr_c;
+    double fc_j, fc_c;
+    double reported_j, reported_c;  // drop in fc_joules over the same intervals
+
+    // both over the last window, their ratio is the consistency
+    winStats fc_win;
+    winStats reported_win;
+
+    uint64_t samples;
+    uint64_t gaps;              // intervals longer than ENERGY_MAX_GAP_MS, left out of every total
+} energyInt;
+
+void energy_int_init(energyInt *e, uint32_t window_s);
+
+// powers in W and fc_joules in J at the same instant - O(1), no allocation
+void energy_int_sample(energyInt *e, uint64_t time_ns, double mtr_w, double fc_w, double joules);
+
+double energy_int_motor(const energyInt *e);        // J used by the motor
+double energy_int_fc(const energyInt *e);           // J delivered by the fuel cell
+double energy_int_reported(const energyInt *e);     // J drop in fc_joules
+
+// integrated fuel cell energy - reported drop since the start, J
+double energy_int_drift(const energyInt *e);
+
+// reported drop / integrated fuel cell energy over the window, 0 without fuel cell energy
+// steady when the two agree - 1 if fc_joules counts fuel cell output, above 1 by the
+// fuel cell losses if it counts stored energy
+double energy_int_consistency(const energyInt *e);
+
+#endif
@@ -1,40 +1,205 @@
 // Program to control Fan speed inside driver cockpit
 // Assuming both fan speed will be set to same RPM
 
+// The fan used to be a three step function of the heat index, called on every calculation
+// pass, and chattered between steps around each threshold. It now runs as a PI controller on
+// heat index - setpoint with hysteresis for switching on and off and a slew rate limit on the
+// speed, on its own thread woken by an absolute timerfd so the period does not depend on how
+// busy the bus is. Period jitter, lateness and step time are kept in log2 histograms.
+/* ---------------------------------------------------------------------------- */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "Fan_Control.h"
+
+#define PERIOD_NS ((uint64_t) FAN_PERIOD_MS * 1000000ull)
 
 // setting up max fan speed
 uint32_t FAN_maxRPM = 1000;
 
-// unified fan speed - change if fan is in different area
-uint32_t FAN;
+double fan_heat_index(double temp_c, double humid)
+{
+    // simple NWS (Steadman) heat index, worked in F - close to the temperature in a mild cockpit
+    double t = temp_c * 1.8 + 32.0;
+    double hi = 0.5 * (t + 61.0 + (t - 68.0) * 1.2 + humid * 0.094);
+    return (hi - 32.0) / 1.8;
+}
 
-uint32_t Fan_Ctrl(uint32_t driver_temp, uint32_t driver_humid)
+void fan_ctrl_init(fanCtrl *c)
 {
-    // calculate Humidity Index value for temperature felt by driver
-    float HI = 1.98 * driver_temp + 0.047 * driver_humid + 24.9;
+    memset(c, 0, sizeof(*c));
+}
 
-    // controlling fan based on humidity index
-    // assuming max acceptable temperature is 32C
-    if (HI > 32)
-    {
-        // blast both fans - assuming 1000 is max rpm
-        FAN = FAN_maxRPM;
+uint32_t fan_ctrl_step(fanCtrl *c, double heat_c, double setpoint_c, double dt)
+{
+    double err = heat_c - setpoint_c;
+    double target = 0;
+
+    // switching on and off only outside the band, so noise around the setpoint does not toggle it
+    if (!c->on && err > FAN_HYST_C) {
+        c->on = 1;
+        c->integral = 0;
+    }
+
+    if (c->on) {
+        double u = FAN_KP * err + c->integral;
+
+        if (err < -FAN_HYST_C && u <= FAN_MIN_RPM) {
+            c->on = 0;
+            c->integral = 0;
+        } else {
+            // integrating only while the output is not pinned the same way (anti-windup)
+            if (!(u >= FAN_maxRPM && err > 0) && !(u <= FAN_MIN_RPM && err < 0))
+                c->integral += FAN_KI * err * dt;
+            target = FAN_KP * err + c->integral;
+            target = (target < FAN_MIN_RPM) ? FAN_MIN_RPM : (target > FAN_maxRPM) ? FAN_maxRPM : target;
+        }
+    }
+
+    // no step in speed either way, not even switching off
+    double step = FAN_SLEW_RPM_S * dt;
+    if (target > c->rpm + step)
+        c->rpm += step;
+    else if (target < c->rpm - step)
+        c->rpm -= step;
+    else
+        c->rpm = target;
 
-    } else if (HI > 27 && HI <= 32) {
-        // have fan run at 50% max speed
-        FAN = FAN_maxRPM / 2;
+    return (uint32_t) (c->rpm + 0.5);
+}
 
-    } else if (HI > 23 && HI <= 27) {
-        // run both fans at 25% max speed
-        FAN = FAN_maxRPM / 4;
+void fan_loop_init(fanLoop *f, signalStore *store, signalControl *control)
+{
+    memset(f, 0, sizeof(*f));
+    f->tfd = -1;
+    f->store = store;
+    f->control = control;
+    fan_ctrl_init(&f->ctrl);
+}
+
+int fan_loop_open(fanLoop *f, signalStore *store, signalControl *control)
+{
+    fan_loop_init(f, store, control);
+
+    f->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (f->tfd < 0)
+        return -1;
+
+    f->next_tick = (mono_ns() / PERIOD_NS + 1) * PERIOD_NS;
+    struct itimerspec its = {
+        .it_interval = { .tv_sec = PERIOD_NS / 1000000000ull, .tv_nsec = PERIOD_NS % 1000000000ull },
+        .it_value = { .tv_sec = f->next_tick / 1000000000ull, .tv_nsec = f->next_tick % 1000000000ull },
+    };
+    if (timerfd_settime(f->tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        int err = errno;
+        close(f->tfd);
+        f->tfd = -1;
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+void fan_loop_step(fanLoop *f, const signalSnapshot *snap, uint64_t now_ns)
+{
+    double setpoint = CONTROL_FAN_SETPOINT_C;
+    double dt = (f->last_step != 0) ? (double) (now_ns - f->last_step) * 1e-9 : FAN_PERIOD_MS * 1e-3;
 
-    } else {
-        // turn OFF fan if temperature low or HI value is invalid
-        FAN = 0;
+    f->last_step = now_ns;
 
+    if (f->control != NULL) {
+        int32_t mc = atomic_load_explicit(&f->control->fan_setpoint_mc, memory_order_relaxed);
+        if (mc != 0)
+            setpoint = mc * 1e-3;
     }
+    setpoint = (setpoint < FAN_SETPOINT_MIN_C) ? FAN_SETPOINT_MIN_C : (setpoint > FAN_SETPOINT_MAX_C) ? FAN_SETPOINT_MAX_C : setpoint;
 
-    return FAN;
-}
\ No newline at end of file
+    // no temperature yet - treated as cool, the fan stays off
+    double heat = setpoint;
+    if (snap->sig[SIG_DRV_TEMP].time_ns != 0)
+        heat = fan_heat_index(snap->sig[SIG_DRV_TEMP].raw, snap->sig[SIG_DRV_HUMD].raw);
+
+    atomic_store_explicit(&f->rpm, fan_ctrl_step(&f->ctrl, heat, setpoint, dt), memory_order_relaxed);
+    atomic_store_explicit(&f->heat_mc, (int32_t) lround(heat * 1000.0), memory_order_relaxed);
+    atomic_store_explicit(&f->setpoint_mc, (int32_t) lround(setpoint * 1000.0), memory_order_relaxed);
+    atomic_store_explicit(&f->time_ns, snap->sig[SIG_DRV_TEMP].time_ns, memory_order_release);
+}
+
+int fan_loop_tick(fanLoop *f)
+{
+    uint64_t expirations;
+
+    if (read(f->tfd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return (errno == EINTR) ? 0 : -1;
+
+    uint64_t wake = mono_ns();
+    uint64_t due = f->next_tick + (expirations - 1) * PERIOD_NS;
+    f->next_tick = due + PERIOD_NS;
+    bump(&f->ticks, 1);
+    bump(&f->missed_ticks, expirations - 1);
+
+    hist_add(&f->late, wake > due ? (wake - due) / 1000 : 0);
+    if (f->last_step != 0) {
+        uint64_t interval = (wake - f->last_step) / 1000;
+        uint64_t period = PERIOD_NS / 1000;
+        hist_add(&f->jitter, interval > period ? interval - period : period - interval);
+    }
+
+    // SCHED_FIFO here - spinning on the seqlock could starve the writer it preempted, so a
+    // write in progress means this step runs on the previous snapshot
+    if (signal_store_try_snapshot(f->store, &f->snap) < 0)
+        bump(&f->stale_snapshots, 1);
+    fan_loop_step(f, &f->snap, wake);
+    hist_add(&f->exec, (mono_ns() - wake) / 1000);
+    return 1;
+}
+
+void fan_loop_run(fanLoop *f, volatile sig_atomic_t *run)
+{
+    while (*run)
+    {
+        if (fan_loop_tick(f) < 0)
+        {
+            printf("fan loop timer error: %s\n", strerror(errno));
+            break;
+        }
+    }
+}
+
+void fan_loop_report(const fanLoop *f, FILE *fp)
+{
+    fprintf(fp, "fan loop: %llu ticks (%llu missed, %llu on the previous snapshot) every %d ms, late p99 %llu us max %llu us, "
+                "jitter p99 %llu us max %llu us, step p99 %llu us max %llu us\n",
+            (unsigned long long) atomic_load(&f->ticks), (unsigned long long) atomic_load(&f->missed_ticks),
+            (unsigned long long) atomic_load(&f->stale_snapshots), FAN_PERIOD_MS,
+            (unsigned long long) hist_percentile(&f->late, 0.99), (unsigned long long) f->late.max,
+            (unsigned long long) hist_percentile(&f->jitter, 0.99), (unsigned long long) f->jitter.max,
+            (unsigned long long) hist_percentile(&f->exec, 0.99), (unsigned long long) f->exec.max);
+}
+
+void fan_loop_print_json(const fanLoop *f, FILE *fp)
+{
+    fprintf(fp, "{\"unit\":\"us\",\"period_ms\":%d,\"ticks\":%llu,\"missed\":%llu,\"stale_snapshots\":%llu,\"late\":",
+            FAN_PERIOD_MS, (unsigned long long) atomic_load(&f->ticks), (unsigned long long) atomic_load(&f->missed_ticks),
+            (unsigned long long) atomic_load(&f->stale_snapshots));
+    hist_print_json(fp, &f->late);
+    fprintf(fp, ",\"jitter\":");
+    hist_print_json(fp, &f->jitter);
+    fprintf(fp, ",\"exec\":");
+    hist_print_json(fp, &f->exec);
+    fprintf(fp, "}\n");
+}
+
+void fan_loop_close(fanLoop *f)
+{
+    if (f->tfd >= 0)
+        close(f->tfd);
+    f->tfd = -1;
+}
@@ -1,6 +1,97 @@
 #ifndef FAN_CONTROL_H
 #define FAN_CONTROL_H
 
-uint32_t Fan_Ctrl(uint32_t driver_temp, uint32_t driver_humid);
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include "Signal_Store.h"
+#include "Log_Hist.h"
 
-#endif
\ No newline at end of file
+// control loop period
+#define FAN_PERIOD_MS       100
+
+// PI gains on heat index - setpoint: RPM per C and RPM per C per second
+#define FAN_KP              150.0
+#define FAN_KI              15.0
+
+// fan starts above setpoint + FAN_HYST_C and stops below setpoint - FAN_HYST_C
+#define FAN_HYST_C          0.5
+
+// slowest the fans run while on, and the most the speed may change per second either way
+#define FAN_MIN_RPM         200
+#define FAN_SLEW_RPM_S      250.0
+
+// setpoints the GUI can ask for
+#define FAN_SETPOINT_MIN_C  15
+#define FAN_SETPOINT_MAX_C  35
+
+// loop timing written here at exit
+#define FAN_LOOP_FILE       "fan_loop.json"
+
+// setting up max fan speed
+extern uint32_t FAN_maxRPM;
+
+// PI controller with on/off hysteresis and a rate limited output
+typedef struct fanCtrl {
+    int on;
+    double integral;            // RPM
+    double rpm;                 // output after the rate limit
+} fanCtrl;
+
+// one fan loop, run on its own thread by fan_loop_run() or a step at a time by fan_loop_step()
+typedef struct fanLoop {
+    int tfd;                    // -1 = no timer, steps come from the caller
+    signalStore *store;         // read by the timer thread, the calculation thread publishes the results
+    signalControl *control;     // setpoint from the GUI, NULL = CONTROL_FAN_SETPOINT_C
+    fanCtrl ctrl;
+    uint64_t last_step;         // CLOCK_MONOTONIC ns of the previous step
+    uint64_t next_tick;         // when the timer is due next
+
+    // latest output for the calculation thread
+    _Atomic uint32_t rpm;
+    _Atomic int32_t heat_mc;        // heat index in 1/1000 C
+    _Atomic int32_t setpoint_mc;
+    _Atomic uint64_t time_ns;       // receive time of the temperature the step used
+
+    // latest snapshot of the store, stepped on again while the store is being written
+    signalSnapshot snap;
+
+    // written by the loop thread, reported by the calculation thread while it runs
+    _Atomic uint64_t ticks;
+    _Atomic uint64_t missed_ticks;      // timer expirations the thread was too late to see
+    _Atomic uint64_t stale_snapshots;   // steps on the previous snapshot
+    logHist late;               // wake up - tick, microseconds
+    logHist jitter;             // |interval between steps - period|, microseconds
+    logHist exec;               // wake up - output set, microseconds
+} fanLoop;
+
+// heat index in C felt by the driver from temperature in C and relative humidity in %
+double fan_heat_index(double temp_c, double humid);
+
+void fan_ctrl_init(fanCtrl *c);
+
+// one controller step dt seconds after the previous one, returns the fan speed in RPM
+uint32_t fan_ctrl_step(fanCtrl *c, double heat_c, double setpoint_c, double dt);
+
+// timer ticking every FAN_PERIOD_MS on absolute time, -1 if it could not be created
+int fan_loop_open(fanLoop *f, signalStore *store, signalControl *control);
+
+// same loop without a timer, for calling fan_loop_step() from the calculation pass
+void fan_loop_init(fanLoop *f, signalStore *store, signalControl *control);
+
+// steps the controller on the temperature and humidity in snap and the setpoint, publishes the output
+// now_ns is CLOCK_MONOTONIC
+void fan_loop_step(fanLoop *f, const signalSnapshot *snap, uint64_t now_ns);
+
+// waits for the next tick and steps, -1 on a timer error
+int fan_loop_tick(fanLoop *f);
+
+// ticks until *run is cleared
+void fan_loop_run(fanLoop *f, volatile sig_atomic_t *run);
+
+void fan_loop_report(const fanLoop *f, FILE *fp);
+void fan_loop_print_json(const fanLoop *f, FILE *fp);
+void fan_loop_close(fanLoop *f);
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+// Q16.16 fixed point for the scaled CAN signals
+// Raw bus values are integers in units of 1/10000 (scale 0.0001 in signals.dbc). They are exact as
+// integers, so products and ratios are formed from the raw values in 64 bit and rounded once
+// into Q16.16 - no float divide per field. Results only become float for the display, the
+// signal store and the CSV files (q16_to_float).
+//
+// Q16.16 covers -32768 .. 32767.99998 with a step of 1/65536 (~1.5e-5), so every result is
+// within 0.5 step of the exact value unless it saturates. Out of range results and division
+// by zero saturate to Q16_MAX / Q16_MIN instead of wrapping - a saturated efficiency is no
+// reading (q16_no_result) and is kept out of the averages.
+
+#include <stdint.h>
+#include "Signal_Defs.h"
+
+typedef int32_t q16_t;
+
+#define Q16_ONE     65536
+#define Q16_MAX     INT32_MAX
+#define Q16_MIN     INT32_MIN
+
+// raw values per unit on the bus - the Elec/Fuel efficiency code checks its inputs share it
+#define Q16_RAW_SCALE SIG_MTR_VOLT_DIV
+
+static inline q16_t q16_sat(int64_t v)
+{
+    return (v > Q16_MAX) ? Q16_MAX : (v < Q16_MIN) ? Q16_MIN : (q16_t) v;
+}
+
+// rounding a / b to the nearest integer, b > 0
+static inline int64_t q16_div_round(int64_t a, int64_t b)
+{
+    return (a >= 0) ? (a + b / 2) / b : -((-a + b / 2) / b);
+}
+
+// saturated or divided by zero, not a value to use
+static inline int q16_no_result(q16_t q)
+{
+    return q == Q16_MAX || q == Q16_MIN;
+}
+
+// raw bus value (1/10000 units) -> Q16.16, divide by a constant is a multiply for the compiler
+static inline q16_t q16_from_raw(int64_t raw)
+{
+    return q16_sat(q16_div_round(raw * Q16_ONE, Q16_RAW_SCALE));
+}
+
+static inline q16_t q16_from_float(float f)
+{
+    float v = f * (float) Q16_ONE;
+    if (v >= 2147483647.0f)
+        return Q16_MAX;
+    if (v <= -2147483648.0f)
+        return Q16_MIN;
+    return (q16_t) (v + ((v >= 0) ? 0.5f : -0.5f));
+}
+
+// only at the display / file boundary - multiply by an exact power of 2
+static inline float q16_to_float(q16_t q)
+{
+    return (float) q * (1.0f / Q16_ONE);
+}
+
+static inline q16_t q16_mul_sat(q16_t a, q16_t b)
+{
+    int64_t p = (int64_t) a * b;
+    return q16_sat((p + ((p >= 0) ? 0x8000 : -0x8000)) / Q16_ONE);
+}
+
+static inline q16_t q16_div_sat(q16_t a, q16_t b)
+{
+    if (b == 0)
+        return (a >= 0) ? Q16_MAX : Q16_MIN;
+    if (b < 0) {
+        a = -a;
+        b = -b;
+    }
+    return q16_sat(q16_div_round((int64_t) a * Q16_ONE, b));
+}
+
+// power V * I from two raw values, rounded once: raw product is in 1e-8 units
+static inline q16_t q16_power_raw(int64_t raw_v, int64_t raw_i)
+{
+    int64_t p = raw_v * raw_i;                      // |p| < 2^63 for 32 bit raw values
+
+    // beyond 2^47 * 1e-8 / 2^16 the result is out of Q16.16 range anyway
+    if (p > ((int64_t) 1 << 47) || p < -((int64_t) 1 << 47))
+        return (p > 0) ? Q16_MAX : Q16_MIN;
+    return q16_sat(q16_div_round(p * Q16_ONE, (int64_t) Q16_RAW_SCALE * Q16_RAW_SCALE));
+}
+
+// ratio of two powers (a_v * a_i) / (b_v * b_i) from raw values, rounded once
+// used for efficiencies so a small denominator power does not magnify a rounding step
+static inline q16_t q16_power_ratio_raw(int64_t a_v, int64_t a_i, int64_t b_v, int64_t b_i)
+{
+    int64_t num = a_v * a_i;
+    int64_t den = b_v * b_i;
+
+    if (den < 0) {
+        den = -den;
+        num = -num;
+    }
+    if (den == 0)
+        return (num >= 0) ? Q16_MAX : Q16_MIN;
+    if (num > ((int64_t) 1 << 47) || num < -((int64_t) 1 << 47))
+        return q16_sat(q16_div_round(num, den) * Q16_ONE);
+    return q16_sat(q16_div_round(num * Q16_ONE, den));
+}
+
+// distance / energy from raw speeds and energies: (s1 + s2) / 2 * dt / (e1 - e2)
+// the 1/10000 scale of speed and energy cancels out, dt in microseconds (up to ~100 s)
+static inline q16_t q16_fuel_ratio_raw(int64_t s1, int64_t s2, int64_t e1, int64_t e2, int64_t dt_us)
+{
+    int64_t den = 2 * (e1 - e2) * 1000000;
+    int64_t num = (s1 + s2) * dt_us * Q16_ONE;
+
+    if (den == 0)
+        return (num >= 0) ? Q16_MAX : Q16_MIN;
+    if (den < 0) {
+        den = -den;
+        num = -num;
+    }
+    return q16_sat(q16_div_round(num, den));
+}
+
+#endif
@@ -0,0 +1,114 @@
+// Name: Flight_Dump
+// Description: Reading the flight recorder (Flight_Recorder.c) back as CSV, after a crash
+//              or while edas is still running
+
+// Prints the complete records oldest first, one "seq,time_s,signal,raw,value" row each; a
+// "start" row marks where a run of edas began. Records that do not check out (cut off by a
+// power loss, or overwritten while being read) are left out and counted.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "Flight_Recorder.h"
+
+int main(int argc, char *argv[])
+{
+    const char *only = NULL;
+    uint64_t lastN = 0;
+    int opt;
+    frecReader r;
+    static int selected[SIG_COUNT];
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': lastN = strtoull(optarg, NULL, 10); break;
+            case 's': only = optarg; break;
+            default:
+                printf("usage: %s [-n last records] [-s signal,signal,...] flight.rec [out.csv]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        printf("usage: %s [-n last records] [-s signal,signal,...] flight.rec [out.csv]\n", argv[0]);
+        return 1;
+    }
+
+    // every signal, or the ones asked for - start markers always
+    for (int i = 0; i < SIG_COUNT; i++)
+        selected[i] = (only == NULL);
+    if (only != NULL)
+    {
+        char names[1024];
+        snprintf(names, sizeof(names), "%s", only);
+        for (char *name = strtok(names, ","); name != NULL; name = strtok(NULL, ","))
+        {
+            int s = 0;
+            while (s < SIG_COUNT && strcmp(signalInfos[s].name, name) != 0)
+                s++;
+            if (s == SIG_COUNT)
+            {
+                printf("no signal %s\n", name);
+                return 1;
+            }
+            selected[s] = 1;
+        }
+    }
+
+    if (frec_read_open(&r, argv[optind]) < 0)
+    {
+        printf("could not open flight recorder %s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+    if (r.hdr->signals != SIG_COUNT)
+    {
+        printf("%s was written with %u signals, this build has %d\n", argv[optind], r.hdr->signals, SIG_COUNT);
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (optind + 1 < argc && (out = fopen(argv[optind + 1], "w")) == NULL)
+    {
+        printf("could not create %s: %s\n", argv[optind + 1], strerror(errno));
+        return 1;
+    }
+
+    uint64_t first = r.first;
+    if (lastN > 0 && r.last >= lastN && r.last - lastN + 1 > first)
+        first = r.last - lastN + 1;
+
+    fprintf(out, "seq,time_s,signal,raw,value\n");
+    uint64_t rows = 0, bad = 0;
+    for (uint64_t seq = first; seq != 0 && seq <= r.last; seq++)
+    {
+        frecRecord rec;
+        if (!frec_get(&r, seq, &rec))
+        {
+            bad++;
+            continue;
+        }
+        if (rec.signal == FREC_SIG_START)
+            fprintf(out, "%llu,%llu.%09llu,start,,\n", (unsigned long long) seq,
+                    (unsigned long long) (rec.time_ns / 1000000000ull), (unsigned long long) (rec.time_ns % 1000000000ull));
+        else if (rec.signal < SIG_COUNT && selected[rec.signal])
+            fprintf(out, "%llu,%llu.%09llu,%s,%u,%g\n", (unsigned long long) seq,
+                    (unsigned long long) (rec.time_ns / 1000000000ull), (unsigned long long) (rec.time_ns % 1000000000ull),
+                    signalInfos[rec.signal].name, rec.raw, (double) rec.value);
+        else
+            continue;
+        rows++;
+    }
+
+    FILE *info = (out == stdout) ? stderr : stdout;
+    if (out != stdout)
+        fclose(out);
+    fprintf(info, "records %llu - %llu, %llu rows written, %llu did not check out\n",
+            (unsigned long long) first, (unsigned long long) r.last, (unsigned long long) rows, (unsigned long long) bad);
+    frec_read_close(&r);
+    return 0;
+}
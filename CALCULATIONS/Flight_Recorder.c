@@ -0,0 +1,383 @@
+// Name: Flight_Recorder
+// Description: Last minutes of every signal in a fixed size file mapped into memory, kept
+//              through a crash or a power cut
+
+// The CSV files and the telemetry log hold their data in memory until a block is full, so
+// whatever happened just before a crash or a power cut is lost. Here every signal change is
+// stored straight into a shared file mapping: a crash loses nothing, since the page cache
+// keeps the mapping's pages, and a thread of its own msyncs it every FREC_SYNC_MS so a power
+// cut loses at most that much. Records go round a ring of fixed slots, record seq in slot
+// seq % slots. Each carries its sequence number, stored last, and a CRC-32 covering it, so a
+// record half written when the power went, or a slot of another round, does not check out.
+// The header keeps the newest sequence number as a hint; the newest complete record is found
+// from there by stepping back over records that never made it to the card and forward over
+// those the header had not seen, without reading the whole ring.
+/* ---------------------------------------------------------------------------- */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "Flight_Recorder.h"
+
+static uint32_t crcTable[256];
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+
+static void crc_init(void)
+{
+    // CRC-32 (IEEE 802.3), reflected
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crcTable[i] = c;
+    }
+}
+
+static uint32_t crc_update(uint32_t c, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    while (len--)
+        c = crcTable[(c ^ *p++) & 0xFF] ^ (c >> 8);
+    return c;
+}
+
+static uint32_t rec_crc(uint64_t seq, const frecRecord *r)
+{
+    uint32_t c = crc_update(0xFFFFFFFFu, &seq, sizeof(seq));
+    c = crc_update(c, &r->time_ns, offsetof(frecRecord, crc) - offsetof(frecRecord, time_ns));
+    return ~c;
+}
+
+static uint32_t schema_crc(void)
+{
+    uint32_t c = 0xFFFFFFFFu;
+    for (int i = 0; i < SIG_COUNT; i++)
+        c = crc_update(c, signalInfos[i].name, strlen(signalInfos[i].name) + 1);
+    return ~c;
+}
+
+/*-------------------------------------------------------------*/
+// recovery, shared by the writer at open and the readers
+
+// record seq as it is in its slot, checked - also safe against a writer in another process
+static int rec_read(const frecRecord *ring, uint32_t slots, uint64_t seq, frecRecord *out)
+{
+    const frecRecord *r = &ring[seq % slots];
+
+    if (seq == 0 || atomic_load_explicit(&r->seq, memory_order_acquire) != seq)
+        return 0;
+    out->time_ns = r->time_ns;
+    out->signal = r->signal;
+    out->reserved = r->reserved;
+    out->raw = r->raw;
+    out->value = r->value;
+    out->crc = r->crc;
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&r->seq, memory_order_relaxed) != seq)
+        return 0;
+    atomic_init(&out->seq, seq);
+    return rec_crc(seq, out) == out->crc;
+}
+
+// newest complete record, 0 if there is none
+static uint64_t find_last(const frecHeader *hdr, const frecRecord *ring, uint32_t slots)
+{
+    frecRecord tmp;
+    uint64_t s = atomic_load_explicit(&hdr->head, memory_order_acquire);
+
+    // header got onto the card ahead of its last records - back to the newest that did
+    for (uint32_t k = 0; s > 0 && k < slots && !rec_read(ring, slots, s, &tmp); k++)
+        s--;
+
+    // header never got out at all, the one time every slot is read
+    if (s == 0 || !rec_read(ring, slots, s, &tmp))
+    {
+        s = 0;
+        for (uint32_t i = 0; i < slots; i++)
+        {
+            uint64_t x = atomic_load_explicit(&ring[i].seq, memory_order_relaxed);
+            if (x > s && x % slots == i && rec_read(ring, slots, x, &tmp))
+                s = x;
+        }
+        if (s == 0)
+            return 0;
+    }
+
+    // records written after the header was last saved
+    for (uint32_t k = 0; k < slots && rec_read(ring, slots, s + 1, &tmp); k++)
+        s++;
+    return s;
+}
+
+static int header_ok(const frecHeader *hdr, uint32_t slots)
+{
+    return memcmp(hdr->magic, FREC_MAGIC, sizeof(hdr->magic)) == 0 && hdr->version == FREC_VERSION
+        && hdr->rec_size == sizeof(frecRecord) && hdr->slots > 0 && (slots == 0 || hdr->slots == slots);
+}
+
+/*-------------------------------------------------------------*/
+// writer
+
+static void *sync_thread(void *arg)
+{
+    flightRec *f = arg;
+
+    for (;;)
+    {
+        // on the monotonic clock - the Pi has no RTC, a wall clock set back by NTP would put
+        // the next sync off for as long as it went back
+        struct timespec due;
+        clock_gettime(CLOCK_MONOTONIC, &due);
+        uint64_t ns = (uint64_t) due.tv_nsec + (uint64_t) FREC_SYNC_MS * 1000000ull;
+        due.tv_sec += ns / 1000000000ull;
+        due.tv_nsec = ns % 1000000000ull;
+        while (sem_clockwait(&f->wake, CLOCK_MONOTONIC, &due) < 0 && errno == EINTR)
+            ;
+
+        // only the pages written since the last one go out
+        uint64_t t0 = mono_ns();
+        if (msync(f->hdr, f->map_size, MS_SYNC) < 0)
+            bump(&f->sync_errors, 1);
+        hist_add(&f->sync_us, (mono_ns() - t0) / 1000);
+        bump(&f->syncs, 1);
+
+        if (atomic_load_explicit(&f->stop, memory_order_acquire))
+            break;
+    }
+    return NULL;
+}
+
+// path opened read-write and sized for slots, a new file is allocated on the card up front
+// so a full card fails here and not as a SIGBUS on a store later
+static int open_file(const char *path, uint32_t slots, size_t size)
+{
+    struct stat st;
+    frecHeader hdr;
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0)
+        goto fail;
+
+    if (st.st_size != 0)
+    {
+        // reused only by the same layout and schema, anything else is kept aside
+        if (pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && header_ok(&hdr, slots)
+            && hdr.signals == SIG_COUNT && hdr.schema_crc == schema_crc() && (size_t) st.st_size == size)
+            return fd;
+
+        char old[512];
+        snprintf(old, sizeof(old), "%s.old", path);
+        close(fd);
+        if (rename(path, old) < 0)
+            return -1;
+        if ((fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644)) < 0)
+            return -1;
+    }
+
+    int err = posix_fallocate(fd, 0, size);
+    if (err != 0) {
+        errno = err;
+        goto fail;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, FREC_MAGIC, sizeof(hdr.magic));
+    hdr.version = FREC_VERSION;
+    hdr.rec_size = sizeof(frecRecord);
+    hdr.slots = slots;
+    hdr.signals = SIG_COUNT;
+    hdr.schema_crc = schema_crc();
+    hdr.created_ns = (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || fdatasync(fd) < 0)
+        goto fail;
+    return fd;
+
+fail:
+    {
+        int e = errno;
+        close(fd);
+        errno = e;
+    }
+    return -1;
+}
+
+int flight_rec_open(flightRec *f, const char *path, uint32_t slots)
+{
+    memset(f, 0, sizeof(*f));
+    pthread_once(&crcOnce, crc_init);
+
+    if (slots == 0)
+        slots = FREC_SLOTS;
+    size_t size = FREC_HEADER_BYTES + (size_t) slots * sizeof(frecRecord);
+
+    int fd = open_file(path, slots, size);
+    if (fd < 0)
+        return -1;
+
+    // every page faulted in now, not on the first store into it
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+
+    f->hdr = p;
+    f->rec = (frecRecord *) ((uint8_t *) p + FREC_HEADER_BYTES);
+    f->map_size = size;
+    f->slots = slots;
+
+    // carrying on after the last run
+    uint64_t last = find_last(f->hdr, f->rec, slots);
+    if (last > 0) {
+        f->recovered_last = last;
+        f->recovered_first = (last >= slots) ? last - slots + 1 : 1;
+    }
+    f->next_seq = last + 1;
+
+    if (sem_init(&f->wake, 0, 0) < 0)
+        goto fail;
+    int err = pthread_create(&f->thread, NULL, sync_thread, f);
+    if (err != 0) {
+        sem_destroy(&f->wake);
+        errno = err;
+        goto fail;
+    }
+    f->running = 1;
+
+    // start of this run
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    flight_rec_put(f, FREC_SIG_START, 0, 0.0f, (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec);
+    return 0;
+
+fail:
+    {
+        int e = errno;
+        munmap(p, size);
+        memset(f, 0, sizeof(*f));
+        errno = e;
+    }
+    return -1;
+}
+
+void flight_rec_put(flightRec *f, int signal, uint32_t raw, float value, uint64_t time_ns)
+{
+    uint64_t seq = f->next_seq++;
+    frecRecord *r = &f->rec[seq % f->slots];
+
+    // a reader of the live file skips the slot while it changes
+    atomic_store_explicit(&r->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    r->time_ns = time_ns;
+    r->signal = (uint16_t) signal;
+    r->reserved = 0;
+    r->raw = raw;
+    r->value = value;
+    r->crc = rec_crc(seq, r);
+    atomic_store_explicit(&r->seq, seq, memory_order_release);
+    atomic_store_explicit(&f->hdr->head, seq, memory_order_release);
+    f->records++;
+}
+
+void flight_rec_store(flightRec *f, const signalStore *store)
+{
+    if (f->hdr == NULL)
+        return;
+
+    for (int i = 0; i < SIG_COUNT; i++)
+    {
+        const signalSample *s = &store->sig[i];
+        if (s->time_ns == 0 || s->time_ns == f->seen_ns[i])
+            continue;
+        f->seen_ns[i] = s->time_ns;
+        flight_rec_put(f, i, s->raw, s->value, s->time_ns);
+    }
+}
+
+void flight_rec_report(const flightRec *f, FILE *fp)
+{
+    fprintf(fp, "flight recorder: %llu records (up to %llu), %llu syncs p99 %llu us max %llu us, %llu errors\n",
+            (unsigned long long) f->records, (unsigned long long) (f->next_seq - 1),
+            (unsigned long long) atomic_load(&f->syncs),
+            (unsigned long long) hist_percentile(&f->sync_us, 0.99), (unsigned long long) f->sync_us.max,
+            (unsigned long long) atomic_load(&f->sync_errors));
+}
+
+void flight_rec_close(flightRec *f)
+{
+    if (f->hdr == NULL)
+        return;
+
+    // the thread syncs once more on its way out
+    if (f->running) {
+        atomic_store_explicit(&f->stop, 1, memory_order_release);
+        sem_post(&f->wake);
+        pthread_join(f->thread, NULL);
+        sem_destroy(&f->wake);
+        f->running = 0;
+    }
+    munmap(f->hdr, f->map_size);
+    f->hdr = NULL;
+    f->rec = NULL;
+}
+
+/*-------------------------------------------------------------*/
+// reader
+
+int frec_read_open(frecReader *r, const char *path)
+{
+    struct stat st;
+    frecHeader hdr;
+
+    memset(r, 0, sizeof(*r));
+    pthread_once(&crcOnce, crc_init);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || !header_ok(&hdr, 0)
+        || (size_t) st.st_size != FREC_HEADER_BYTES + (size_t) hdr.slots * sizeof(frecRecord))
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    // shared, so a file edas is still writing reads as it goes
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+
+    r->hdr = p;
+    r->rec = (const frecRecord *) ((const uint8_t *) p + FREC_HEADER_BYTES);
+    r->map_size = st.st_size;
+    r->slots = hdr.slots;
+    r->last = find_last(r->hdr, r->rec, r->slots);
+    r->first = (r->last == 0) ? 0 : (r->last >= r->slots) ? r->last - r->slots + 1 : 1;
+    return 0;
+}
+
+void frec_read_close(frecReader *r)
+{
+    if (r->hdr != NULL)
+        munmap((void *) r->hdr, r->map_size);
+    memset(r, 0, sizeof(*r));
+}
+
+int frec_get(const frecReader *r, uint64_t seq, frecRecord *out)
+{
+    return rec_read(r->rec, r->slots, seq, out);
+}
@@ -0,0 +1,112 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "Signal_Store.h"
+#include "Log_Hist.h"
+
+// Flight recorder file, mapped shared and written in place
+//   page 0:   frecHeader
+//   then:     slots fixed size records, record with sequence number seq lives in slot seq % slots
+// Everything little endian.
+#define FREC_MAGIC          "EDASFRC1"
+#define FREC_VERSION        1
+#define FREC_HEADER_BYTES   4096
+
+#define FREC_FILE           "flight.rec"
+
+// 32 MiB of records, about 25 minutes at ~700 records a second - every field of every frame
+// decoded (9 bus signals at 50 Hz) and the results of every 100 ms tick, less on a busier bus
+#define FREC_SLOTS          (1u << 20)
+
+// how often the sync thread forces the mapping onto the card - at most this much is lost
+// on a power cut, nothing on a crash
+#define FREC_SYNC_MS        1000
+
+// signal of the record written when a recorder is opened, marks the start of a run
+#define FREC_SIG_START      0xFFFF
+
+typedef struct frecHeader {
+    char magic[8];
+    uint16_t version;
+    uint16_t rec_size;              // sizeof(frecRecord)
+    uint32_t slots;
+    uint32_t signals;               // SIG_COUNT of the build that created the file
+    uint32_t schema_crc;            // of the signal names, the file is only reused by the same schema
+    uint64_t created_ns;            // CLOCK_REALTIME
+    _Atomic uint64_t head;          // seq of the latest record - a hint, may lag the records
+} frecHeader;
+
+// one signal change, one store apart from the others
+typedef struct frecRecord {
+    _Atomic uint64_t seq;           // 1, 2, 3 ... - 0 = never written, set last
+    uint64_t time_ns;               // sample time from the store (CLOCK_REALTIME)
+    uint16_t signal;                // signalId, FREC_SIG_START for a start marker
+    uint16_t reserved;
+    uint32_t raw;
+    float value;
+    uint32_t crc;                   // CRC-32 of everything above with seq as written
+} frecRecord;
+
+// writer side - one thread calls flight_rec_put() / flight_rec_store(), the sync thread msyncs
+typedef struct flightRec {
+    frecHeader *hdr;                // NULL = not open
+    frecRecord *rec;
+    size_t map_size;
+    uint32_t slots;
+    uint64_t next_seq;
+    uint64_t seen_ns[SIG_COUNT];    // store time of the last sample taken
+
+    // what was found in the file at open
+    uint64_t recovered_first;       // 0 = nothing recovered
+    uint64_t recovered_last;
+
+    uint64_t records;
+    sem_t wake;
+    _Atomic int stop;
+    pthread_t thread;
+    int running;
+    _Atomic uint64_t syncs;
+    _Atomic uint64_t sync_errors;
+    logHist sync_us;                // msync time, written by the sync thread
+} flightRec;
+
+// reader side - the file mapped read-only, works on a file another process is writing
+typedef struct frecReader {
+    const frecHeader *hdr;
+    const frecRecord *rec;
+    size_t map_size;
+    uint32_t slots;
+    uint64_t first;                 // oldest and newest complete record, first = 0 if empty
+    uint64_t last;
+} frecReader;
+
+// maps path (created FREC_SLOTS slots big if new) and carries on after its newest complete
+// record; a file of another layout or schema is kept as path.old and a new one started
+// slots = 0 takes FREC_SLOTS
+int flight_rec_open(flightRec *f, const char *path, uint32_t slots);
+
+// stores the record into its slot - no system call, safe to crash at any point
+void flight_rec_put(flightRec *f, int signal, uint32_t raw, float value, uint64_t time_ns);
+
+// every signal of the store that changed since the last call
+// call from the thread writing the store, after every frame decoded so no sample is overwritten first
+void flight_rec_store(flightRec *f, const signalStore *store);
+
+void flight_rec_report(const flightRec *f, FILE *fp);
+void flight_rec_close(flightRec *f);
+
+// returns 0 or -1 with errno set (EINVAL = not a flight recorder file)
+int frec_read_open(frecReader *r, const char *path);
+void frec_read_close(frecReader *r);
+
+// copies record seq, 1 if it is complete and checks out, 0 if it was overwritten, cut by a
+// crash or never written
+int frec_get(const frecReader *r, uint64_t seq, frecRecord *out);
+
+#endif
@@ -0,0 +1,84 @@
+// Name: Frame_Ring
+// Description: Lock-free single producer / single consumer ring of CAN frames
+//              between the CAN reader thread and the calculation thread
+
+// Only the producer writes head and only the consumer writes tail.
+// Each side keeps a cached copy of the other index and only re-reads the
+// shared one when the cache says the ring is full/empty.
+// push and pop never wait: a full ring drops the new frame and counts it.
+/* ---------------------------------------------------------------------------- */
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "Frame_Ring.h"
+
+#define RING_MASK (FRAME_RING_SIZE - 1)
+
+void frame_ring_init(frameRing *ring)
+{
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->pushed, 0);
+    atomic_init(&ring->dropped, 0);
+    atomic_init(&ring->popped, 0);
+    ring->tail_cache = 0;
+    ring->head_cache = 0;
+}
+
+int frame_ring_push(frameRing *ring, const canFrame *frame)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    // looks full, check where the consumer really is
+    if (head - ring->tail_cache >= FRAME_RING_SIZE) {
+        ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->tail_cache >= FRAME_RING_SIZE) {
+            atomic_store_explicit(&ring->dropped, atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1, memory_order_relaxed);
+            return 0;
+        }
+    }
+
+    ring->slots[head & RING_MASK] = *frame;
+
+    // release: frame contents visible before the new head
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    atomic_store_explicit(&ring->pushed, atomic_load_explicit(&ring->pushed, memory_order_relaxed) + 1, memory_order_relaxed);
+    return 1;
+}
+
+int frame_ring_pop(frameRing *ring, canFrame *out, int max)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t avail = ring->head_cache - tail;
+
+    // looks empty, check where the producer really is
+    if (avail == 0) {
+        ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+        avail = ring->head_cache - tail;
+        if (avail == 0)
+            return 0;
+    }
+
+    if (avail > (uint32_t) max)
+        avail = max;
+
+    // copying in at most two pieces when the frames wrap around the end
+    uint32_t first = tail & RING_MASK;
+    uint32_t n1 = FRAME_RING_SIZE - first;
+    if (n1 > avail)
+        n1 = avail;
+    memcpy(out, &ring->slots[first], n1 * sizeof(canFrame));
+    memcpy(out + n1, &ring->slots[0], (avail - n1) * sizeof(canFrame));
+
+    // release: done reading the slots before producer may reuse them
+    atomic_store_explicit(&ring->tail, tail + avail, memory_order_release);
+    atomic_store_explicit(&ring->popped, atomic_load_explicit(&ring->popped, memory_order_relaxed) + avail, memory_order_relaxed);
+    return (int) avail;
+}
+
+uint32_t frame_ring_count(frameRing *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return head - tail;
+}
@@ -0,0 +1,41 @@
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "typedefs.h"
+
+// number of frames the ring holds - must be a power of 2
+// 4096 frames is ~0.4 s of a fully loaded 1 Mbit/s bus
+#define FRAME_RING_SIZE 4096
+
+// Single producer / single consumer ring of received frames
+// producer = CAN reader thread, consumer = calculation thread
+// head and tail sit on their own cache lines so the two cores do not fight over them
+typedef struct frameRing {
+    // written by producer only
+    _Alignas(CACHE_LINE) _Atomic uint32_t head;
+    uint32_t tail_cache;                    // producer's last look at tail
+    _Atomic uint64_t pushed;                // frames put in the ring
+    _Atomic uint64_t dropped;               // frames lost because the ring was full
+
+    // written by consumer only
+    _Alignas(CACHE_LINE) _Atomic uint32_t tail;
+    uint32_t head_cache;                    // consumer's last look at head
+    _Atomic uint64_t popped;                // frames taken out of the ring
+
+    _Alignas(CACHE_LINE) canFrame slots[FRAME_RING_SIZE];
+} frameRing;
+
+void frame_ring_init(frameRing *ring);
+
+// producer side - returns 1 if stored, 0 if ring full (frame counted as dropped)
+int frame_ring_push(frameRing *ring, const canFrame *frame);
+
+// consumer side - copy up to max frames into out, returns how many (0 = empty)
+int frame_ring_pop(frameRing *ring, canFrame *out, int max);
+
+// frames currently waiting, safe to call from either side
+uint32_t frame_ring_count(frameRing *ring);
+
+#endif
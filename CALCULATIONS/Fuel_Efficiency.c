@@ -1,62 +1,63 @@
 // Assumptions are: 
 // (1) speed value is directly presented by sensor
 // (2) fuel amount is given in terms of remaining amount of energy -> in joules thus km/joule
-// (3) time data is in uint32_t format
+// (3) time data is in seconds (float), speed_T2 / fuel_T2 being the later sample
 // ---------------------------
 // Values returned directly: Overall Average Efficiency
-// Values returned through pointers: Count and Instant Efficiency
+// Values returned through pointers: Instant Efficiency (NaN if no fuel was used or it is out of
+// range - the average is then left alone), running statistics updated in avg_FEff
 /* ------------------------------------------------------------------------------------------------------------- */
 
 #include <stdio.h>
 #include <stdint.h>
+#include <math.h>
+#include "Stream_Stats.h"
+#include "Fixed_Point.h"
+
+// the fixed point ratio assumes speed and energy share the raw scale (signals.dbc)
+_Static_assert(SIG_SPEED_DIV == Q16_RAW_SCALE && SIG_FC_JOULES_DIV == Q16_RAW_SCALE,
+               "speed and fc_joules need the raw scale of Fixed_Point.h");
 
 // Acceptable time difference of incoming fuel data and speed data
-float setD_Time = 0.5;
+static float setD_Time = 0.5;
 
-float fuel_efficiency(uint32_t speed1, uint32_t speed2, uint32_t fuel1, uint32_t fuel2, uint32_t speed_T1, uint32_t speed_T2, uint32_t fuel_T1, uint32_t fuel_T2, float PreCal_FEff, float* inst_FEff, int* data_Fcnt)
+float fuel_efficiency(uint32_t speed1, uint32_t speed2, uint32_t fuel1, uint32_t fuel2, float speed_T1, float speed_T2, float fuel_T1, float fuel_T2, runStats* avg_FEff, float* inst_FEff)
 {
-    // Data from CAN Bus
-    int count = *data_Fcnt;
-
-    // data processing variables
-    float speed1_f = ((float) speed1) / 10000;
-    float speed2_f = ((float) speed2) / 10000;
-    
-    float fuel1_f = ((float) fuel1) / 10000;
-    float fuel2_f = ((float) fuel2) / 10000;
-
+    // speeds and energies stay raw (1/10000 units) - the ratio is formed in fixed point (Fixed_Point.h)
     float Tspeed_f1 = (float) speed_T1;
     float Tspeed_f2 = (float) speed_T2;
 
     float Tfuel_f1 = (float) fuel_T1;
     float Tfuel_f2 = (float) fuel_T2;
     
-    float avg_speed, dist_traveled, fuel_used, time_diff;
+    float time_diff;
     float instant_eff;
-    float avg_FEff;
 
     // verifying if data coming in at the same time
-    while (abs(Tspeed_f1 - Tfuel_f1) < setD_Time || abs(Tspeed_f2 - Tfuel_f2) < setD_Time)
+    while (fabsf(Tspeed_f1 - Tfuel_f1) < setD_Time || fabsf(Tspeed_f2 - Tfuel_f2) < setD_Time)
     {
         // Basic calculations
-        avg_speed = (speed1_f + speed2_f)/2;
-        fuel_used = fuel1_f - fuel2_f;
-        time_diff = Tspeed_f1 - Tspeed_f2;
-        
-        // Instant efficiency calculation
-        dist_traveled = avg_speed * time_diff;
-        instant_eff = dist_traveled/fuel_used;
+        time_diff = Tspeed_f2 - Tspeed_f1;
+
+        // Instant efficiency calculation - average speed * time / fuel used, saturates if no fuel was used
+        q16_t eff = q16_fuel_ratio_raw(speed1, speed2, fuel1, fuel2, (int64_t) lroundf(time_diff * 1e6f));
+
+        // parked or coasting on the battery: no reading, the averages keep what they have
+        if (q16_no_result(eff)) {
+            *inst_FEff = NAN;
+            return run_stats_mean(avg_FEff);
+        }
+        instant_eff = q16_to_float(eff);
 
         // Updating Average efficiency calculation
-        avg_FEff = (PreCal_FEff * count + instant_eff)/(count + 1);
-        
+        run_stats_add(avg_FEff, instant_eff);
+
         // Updating other info through pointers
-        (*data_Fcnt)++;
         *inst_FEff = instant_eff;
 
-        return avg_FEff;
+        return run_stats_mean(avg_FEff);
     }
 
-    // if "while" condition above not met
-    exit ();
+    // if "while" condition above not met, then keep previous average
+    return run_stats_mean(avg_FEff);
 }
\ No newline at end of file
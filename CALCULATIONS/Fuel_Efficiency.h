@@ -1,6 +1,9 @@
 #ifndef Fuel_Efficiency
 #define Fuel_Efficiency
 
-float fuel_efficiency(uint32_t speed1, uint32_t speed2, uint32_t fuel1, uint32_t fuel2, uint32_t time1, uint32_t time2, float PreCal_FEff, float* inst_FEff, int* data_Fcnt);
+#include <stdint.h>
+#include "Stream_Stats.h"
+
+float fuel_efficiency(uint32_t speed1, uint32_t speed2, uint32_t fuel1, uint32_t fuel2, float speed_T1, float speed_T2, float fuel_T1, float fuel_T2, runStats* avg_FEff, float* inst_FEff);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,110 @@
+// Name: Lap_Engine
+// Description: Lap detection from integrated distance or a lap marker, with per lap results
+
+// Speed (0x990) is integrated into distance on every aligned tick. A lap closes when the
+// distance passes the track length, or - if there is one - only when the lap marker is passed. Energy, time, distance
+// and efficiency of the lap are running values, so closing a lap is O(1) and the GUI and the
+// logger read the finished result instead of going back over the samples.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "Lap_Engine.h"
+
+#define MASK (LAP_HISTORY - 1)
+
+void lap_engine_init(lapEngine *le, double track_m, uint32_t min_lap_s, int marker)
+{
+    memset(le, 0, sizeof(*le));
+    le->track_m = (track_m > 0) ? track_m : 0;
+    le->marker = marker;
+    le->min_lap_ns = (uint64_t) min_lap_s * 1000000000ull;
+    lap_stats_init(&le->eff);
+}
+
+// lap in progress finished at end_ns with the distance and energy there
+static void close_lap(lapEngine *le, uint64_t end_ns, double end_m, double end_joules)
+{
+    lapResult *r = &le->hist[le->laps & MASK];
+
+    r->lap = le->laps + 1;
+    r->start_ns = le->start_ns;
+    r->end_ns = end_ns;
+    r->time_s = (float) ((double) (end_ns - le->start_ns) * 1e-9);
+    r->distance_m = (float) (end_m - le->start_m);
+    r->energy_j = (float) (le->start_joules - end_joules);
+    r->avg_speed = (r->time_s > 0) ? r->distance_m / r->time_s * 3.6f : 0;
+    r->avg_eff = (float) run_stats_mean(&le->eff.current);
+    lap_stats_next(&le->eff);
+    le->laps++;
+
+    le->start_ns = end_ns;
+    le->start_m = end_m;
+    le->start_joules = end_joules;
+}
+
+int lap_engine_sample(lapEngine *le, uint64_t time_ns, double speed, double joules)
+{
+    // first sample starts the first lap
+    if (le->last_ns == 0) {
+        le->last_ns = time_ns;
+        le->last_speed = speed;
+        le->last_joules = joules;
+        le->start_ns = time_ns;
+        le->start_joules = joules;
+        return 0;
+    }
+    if (time_ns <= le->last_ns)
+        return 0;
+
+    double dt = (double) (time_ns - le->last_ns) * 1e-9;
+    double prev_m = le->distance_m;
+    le->distance_m += (le->last_speed + speed) * 0.5 * dt / 3.6;
+
+    // crossing point interpolated within this step, whatever is left over counts for the next lap
+    // the marker is where the lap really ends, integrated distance drifts
+    int closed = 0;
+    if (le->track_m > 0 && !le->marker && le->distance_m - le->start_m >= le->track_m && le->distance_m > prev_m) {
+        double end_m = le->start_m + le->track_m;
+        double f = (end_m - prev_m) / (le->distance_m - prev_m);
+        uint64_t end_ns = le->last_ns + (uint64_t) (f * (double) (time_ns - le->last_ns));
+        close_lap(le, end_ns, end_m, le->last_joules + f * (joules - le->last_joules));
+        closed = 1;
+    }
+
+    le->last_ns = time_ns;
+    le->last_speed = speed;
+    le->last_joules = joules;
+    return closed;
+}
+
+void lap_engine_eff(lapEngine *le, double eff)
+{
+    lap_stats_add(&le->eff, eff);
+}
+
+int lap_engine_marker(lapEngine *le, uint64_t time_ns)
+{
+    // no sample yet, nothing to close
+    if (le->last_ns == 0)
+        return 0;
+    if (time_ns < le->start_ns + le->min_lap_ns) {
+        le->bounces++;
+        return 0;
+    }
+
+    close_lap(le, time_ns, le->distance_m, le->last_joules);
+    return 1;
+}
+
+double lap_engine_lap_m(const lapEngine *le)
+{
+    return le->distance_m - le->start_m;
+}
+
+const lapResult *lap_engine_result(const lapEngine *le, uint32_t back)
+{
+    if (back >= le->laps || back >= LAP_HISTORY)
+        return NULL;
+    return &le->hist[(le->laps - 1 - back) & MASK];
+}
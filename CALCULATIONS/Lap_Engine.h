@@ -0,0 +1,70 @@
+#ifndef LAP_ENGINE_H
+#define LAP_ENGINE_H
+
+#include <stdint.h>
+#include "Stream_Stats.h"
+
+// finished laps kept for the logger and the GUI - must be a power of 2
+#define LAP_HISTORY     64
+
+// a lap marker sooner than this after the lap started is a bounce, not a lap
+#define LAP_MIN_S       10
+
+// one finished lap, worked out when it closed
+typedef struct lapResult {
+    uint32_t lap;               // 1 = first lap
+    uint64_t start_ns, end_ns;
+    float time_s;
+    float distance_m;
+    float energy_j;             // fuel cell energy used (drop in fc_joules)
+    float avg_speed;            // km/h, distance / time
+    float avg_eff;              // mean fuel efficiency over the lap
+} lapResult;
+
+typedef struct lapEngine {
+    double track_m;             // lap length, 0 = laps only from the marker
+    int marker;                 // a marker is watched - only it closes laps, track_m is left to the range
+    uint64_t min_lap_ns;
+
+    // speed integrated into distance (trapezoid between samples)
+    double distance_m;          // since the start
+    uint64_t last_ns;           // previous sample, 0 = none yet
+    double last_speed;          // km/h
+    double last_joules;         // J
+
+    // lap in progress
+    uint64_t start_ns;
+    double start_m;
+    double start_joules;
+    lapStats eff;               // fuel efficiency this lap and the one before
+
+    // finished laps, newest is laps - 1
+    uint32_t laps;
+    lapResult hist[LAP_HISTORY];
+
+    uint64_t bounces;           // markers ignored because the lap was shorter than min_lap_ns
+} lapEngine;
+
+// marker = 1 when a lap marker is watched: the marker is then the only thing that closes a lap,
+// so a distance close can never race it and leave the marker as a bounce
+void lap_engine_init(lapEngine *le, double track_m, uint32_t min_lap_s, int marker);
+
+// new speed (km/h) and fuel cell energy (J) sample - O(1)
+// returns 1 if the distance completed a lap of track_m, the lap ends where it was crossed
+// (never with a marker)
+int lap_engine_sample(lapEngine *le, uint64_t time_ns, double speed, double joules);
+
+// fuel efficiency into the lap average
+void lap_engine_eff(lapEngine *le, double eff);
+
+// lap marker passed (e.g. GPIO beacon) - returns 1 if it closed a lap, 0 for a bounce
+// the distance is resynchronised to the marker
+int lap_engine_marker(lapEngine *le, uint64_t time_ns);
+
+// distance into the lap in progress
+double lap_engine_lap_m(const lapEngine *le);
+
+// back = 0 for the last finished lap, NULL if there is no such lap any more
+const lapResult *lap_engine_result(const lapEngine *le, uint32_t back);
+
+#endif
@@ -0,0 +1,68 @@
+// Name: Log_Hist
+// Description: Fixed bucket log2 histogram for latencies and intervals
+
+// Bucket index is the bit length of the value, so adding a sample is a count-leading-zeros
+// and an increment. Resolution is a factor of 2, plenty to see where the time goes.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+#include "Log_Hist.h"
+
+static inline uint64_t get(const _Atomic uint64_t *c)
+{
+    return atomic_load_explicit(c, memory_order_relaxed);
+}
+
+void hist_add(logHist *h, uint64_t v)
+{
+    int b = (v == 0) ? 0 : 64 - __builtin_clzll(v);
+
+    if (b >= HIST_BUCKETS)
+        b = HIST_BUCKETS - 1;
+
+    // the single writer's plain loads and stores, no locked instruction
+    bump(&h->bucket[b], 1);
+    bump(&h->count, 1);
+    bump(&h->sum, v);
+    if (v > get(&h->max))
+        atomic_store_explicit(&h->max, v, memory_order_relaxed);
+}
+
+uint64_t hist_percentile(const logHist *h, double p)
+{
+    uint64_t count = get(&h->count);
+    uint64_t max = get(&h->max);
+    uint64_t target = (uint64_t) (p * (double) count);
+    uint64_t seen = 0;
+
+    if (count == 0)
+        return 0;
+
+    for (int b = 0; b < HIST_BUCKETS; b++)
+    {
+        seen += get(&h->bucket[b]);
+        if (seen > target) {
+            // top of the bucket, but never above the largest value seen
+            uint64_t upper = (b == 0) ? 0 : ((uint64_t) 1 << b) - 1;
+            return (upper < max) ? upper : max;
+        }
+    }
+
+    return max;
+}
+
+void hist_print_json(FILE *fp, const logHist *h)
+{
+    uint64_t count = get(&h->count);
+
+    fprintf(fp, "{\"count\":%llu,\"mean\":%.1f,\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu,\"buckets\":[",
+            (unsigned long long) count,
+            count ? (double) get(&h->sum) / (double) count : 0.0,
+            (unsigned long long) hist_percentile(h, 0.50),
+            (unsigned long long) hist_percentile(h, 0.99),
+            (unsigned long long) hist_percentile(h, 0.999),
+            (unsigned long long) get(&h->max));
+    for (int b = 0; b < HIST_BUCKETS; b++)
+        fprintf(fp, "%s%llu", b ? "," : "", (unsigned long long) get(&h->bucket[b]));
+    fprintf(fp, "]}");
+}
@@ -0,0 +1,45 @@
+#ifndef LOG_HIST_H
+#define LOG_HIST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <stdatomic.h>
+
+// bucket 0 holds 0, bucket i holds [2^(i-1), 2^i), the last bucket everything above
+#define HIST_BUCKETS 32
+
+// fixed size log2 histogram - O(1) add, no allocation
+// one writer only; every field is atomic so another thread can report it while samples come
+// in, it may see a count that is one sample behind the buckets
+typedef struct logHist {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+    _Atomic uint64_t bucket[HIST_BUCKETS];
+} logHist;
+
+void hist_add(logHist *h, uint64_t v);
+
+// upper bound of the bucket holding the p-th fraction of samples (p = 0.0 - 1.0)
+uint64_t hist_percentile(const logHist *h, double p);
+
+// write {"count":..,"mean":..,"p50":..,"p99":..,"p999":..,"max":..,"buckets":[..]}
+void hist_print_json(FILE *fp, const logHist *h);
+
+// CLOCK_MONOTONIC in ns, what every latency and interval above is measured on
+static inline uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// single writer increment of a counter other threads read - a plain load and store, no
+// locked read-modify-write
+static inline void bump(_Atomic uint64_t *c, uint64_t v)
+{
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+#endif
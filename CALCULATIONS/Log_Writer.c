@@ -0,0 +1,392 @@
+// Name: Log_Writer
+// Description: Background writer for the log files - the calculation thread fills memory
+//              blocks, a thread of its own writes them out
+
+// saveArray2File() used to reopen (and truncate) its CSV file and fprintf every value on the
+// calculation thread, which held up the calculations for as long as the SD card took.
+// Records are now copied into 64 KiB page aligned blocks; a full block goes to the writer
+// thread over a single producer / single consumer ring and comes back empty over a second
+// one, so the only shared state is two pairs of indices and a semaphore post per block.
+// Files are opened O_APPEND and written one whole block per write(). When the card falls
+// behind and every block is waiting, a record is dropped and counted (LOG_FULL_DROP) or the
+// caller waits for a block (LOG_FULL_WAIT), also counted.
+/* ---------------------------------------------------------------------------- */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "Log_Writer.h"
+
+#define RING_MASK (LOG_WRITER_BLOCKS - 1)
+
+/*-------------------------------------------------------------*/
+// writer thread
+
+static int write_all(int fd, const uint8_t *p, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void sync_streams(logWriter *w, uint32_t *dirty)
+{
+    // only streams with a block written, those were added before the block was handed over
+    for (int s = 0; s < LOG_WRITER_STREAMS; s++)
+    {
+        if (!(*dirty & (1u << s)))
+            continue;
+
+        uint64_t t0 = mono_ns();
+        if (fdatasync(w->streams[s].fd) < 0)
+            bump(&w->errors, 1);
+        hist_add(&w->fsync_us, (mono_ns() - t0) / 1000);
+        bump(&w->fsyncs, 1);
+    }
+    *dirty = 0;
+}
+
+static void *writer_thread(void *arg)
+{
+    logWriter *w = arg;
+    uint32_t dirty = 0;             // streams written since their last fsync
+    uint64_t dirty_ns = 0;          // when the oldest of those writes happened
+    uint64_t fsync_ns = (uint64_t) w->fsync_ms * 1000000ull;
+
+    for (;;)
+    {
+        // an fsync due wakes the thread up even without a new block
+        if (w->fsync == LOG_FSYNC_INTERVAL && dirty != 0)
+        {
+            // on the clock of dirty_ns, which a wall clock set back by NTP (no RTC) does not move
+            uint64_t due_ns = dirty_ns + fsync_ns;
+            struct timespec due = { .tv_sec = due_ns / 1000000000ull, .tv_nsec = due_ns % 1000000000ull };
+            while (sem_clockwait(&w->ready, CLOCK_MONOTONIC, &due) < 0 && errno == EINTR)
+                ;
+        }
+        else
+        {
+            while (sem_wait(&w->ready) < 0 && errno == EINTR)
+                ;
+        }
+
+        uint32_t tail = atomic_load_explicit(&w->full_tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&w->full_head, memory_order_acquire);
+
+        for (; tail != head; tail++)
+        {
+            logBlock *b = w->full_ring[tail & RING_MASK];
+            logStream *st = &w->streams[b->stream];
+
+            uint64_t t0 = mono_ns();
+            if (write_all(st->fd, b->data, b->len) < 0)
+                bump(&w->errors, 1);
+            else
+                bump(&w->bytes_written, b->len);
+            hist_add(&w->write_us, (mono_ns() - t0) / 1000);
+            bump(&w->blocks_written, 1);
+
+            if (dirty == 0)
+                dirty_ns = mono_ns();
+            dirty |= 1u << b->stream;
+            if (w->fsync == LOG_FSYNC_BLOCK)
+                sync_streams(w, &dirty);
+
+            // block back to the producer, then the slot of the full ring
+            uint32_t fh = atomic_load_explicit(&w->free_head, memory_order_relaxed);
+            w->free_ring[fh & RING_MASK] = b;
+            atomic_store_explicit(&w->free_head, fh + 1, memory_order_release);
+            atomic_store_explicit(&w->full_tail, tail + 1, memory_order_release);
+        }
+
+        if (w->fsync == LOG_FSYNC_INTERVAL && dirty != 0 && mono_ns() - dirty_ns >= fsync_ns)
+            sync_streams(w, &dirty);
+
+        if (atomic_load_explicit(&w->stop, memory_order_acquire)
+            && atomic_load_explicit(&w->full_head, memory_order_acquire) == tail)
+            break;
+    }
+
+    if (w->fsync != LOG_FSYNC_NEVER)
+        sync_streams(w, &dirty);
+    return NULL;
+}
+
+/*-------------------------------------------------------------*/
+// producer side
+
+int log_writer_open(logWriter *w, logFsync sync, uint32_t fsync_ms, logFull full)
+{
+    void *pool;
+
+    memset(w, 0, sizeof(*w));
+    w->fsync = sync;
+    w->fsync_ms = fsync_ms ? fsync_ms : LOG_WRITER_FSYNC_MS;
+    w->full = full;
+
+    // one allocation up front, nothing allocated while running
+    int err = posix_memalign(&pool, LOG_WRITER_ALIGN, (size_t) LOG_WRITER_BLOCKS * LOG_WRITER_BLOCK);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+
+    // every block starts out free
+    for (int i = 0; i < LOG_WRITER_BLOCKS; i++)
+    {
+        w->blocks[i].data = (uint8_t *) pool + (size_t) i * LOG_WRITER_BLOCK;
+        w->free_ring[i] = &w->blocks[i];
+    }
+    atomic_init(&w->free_head, LOG_WRITER_BLOCKS);
+
+    if (sem_init(&w->ready, 0, 0) < 0) {
+        free(pool);
+        return -1;
+    }
+    if ((err = pthread_create(&w->thread, NULL, writer_thread, w)) != 0) {
+        sem_destroy(&w->ready);
+        free(pool);
+        errno = err;
+        return -1;
+    }
+
+    w->running = 1;
+    return 0;
+}
+
+int log_writer_add(logWriter *w, const char *path, const char *header)
+{
+    struct stat st;
+
+    if (!w->running || w->nstreams >= LOG_WRITER_STREAMS) {
+        errno = w->running ? ENFILE : EBADF;
+        return -1;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    // header once, at start up before anything is queued for this file
+    uint64_t offset = st.st_size;
+    if (offset == 0 && header != NULL) {
+        size_t len = strlen(header);
+        if (write_all(fd, (const uint8_t *) header, len) < 0) {
+            close(fd);
+            return -1;
+        }
+        offset = len;
+    }
+
+    logStream *s = &w->streams[w->nstreams];
+    s->fd = fd;
+    s->path = path;
+    s->cur = NULL;
+    s->offset = offset;
+    return w->nstreams++;
+}
+
+static void hand_over(logWriter *w, logStream *st)
+{
+    logBlock *b = st->cur;
+    st->cur = NULL;
+
+    // never more blocks than slots, the full ring cannot overflow
+    uint32_t head = atomic_load_explicit(&w->full_head, memory_order_relaxed);
+    w->full_ring[head & RING_MASK] = b;
+    atomic_store_explicit(&w->full_head, head + 1, memory_order_release);
+    sem_post(&w->ready);
+}
+
+static logBlock *take_block(logWriter *w)
+{
+    uint32_t tail = atomic_load_explicit(&w->free_tail, memory_order_relaxed);
+    uint64_t t0 = 0;
+
+    while (atomic_load_explicit(&w->free_head, memory_order_acquire) == tail)
+    {
+        if (w->full == LOG_FULL_DROP)
+            return NULL;
+        if (t0 == 0) {
+            t0 = mono_ns();
+            w->waits++;
+        }
+        usleep(100);
+    }
+    if (t0 != 0)
+        hist_add(&w->wait_us, (mono_ns() - t0) / 1000);
+
+    logBlock *b = w->free_ring[tail & RING_MASK];
+    atomic_store_explicit(&w->free_tail, tail + 1, memory_order_release);
+    return b;
+}
+
+void *log_writer_reserve(logWriter *w, int stream, size_t len)
+{
+    logStream *st = &w->streams[stream];
+
+    if (len > LOG_WRITER_BLOCK)
+        return NULL;
+
+    // records are never split, a block that cannot take this one goes out as it is
+    if (st->cur != NULL && LOG_WRITER_BLOCK - st->cur->len < len)
+        hand_over(w, st);
+
+    if (st->cur == NULL)
+    {
+        st->cur = take_block(w);
+        if (st->cur == NULL) {
+            w->dropped++;
+            w->dropped_bytes += len;
+            return NULL;
+        }
+        st->cur->len = 0;
+        st->cur->stream = stream;
+        st->cur_ns = mono_ns();
+    }
+
+    return st->cur->data + st->cur->len;
+}
+
+void log_writer_commit(logWriter *w, int stream, size_t len)
+{
+    logStream *st = &w->streams[stream];
+
+    st->cur->len += len;
+    st->offset += len;
+    w->records++;
+    w->bytes_in += len;
+
+    if (st->cur->len == LOG_WRITER_BLOCK)
+        hand_over(w, st);
+}
+
+int log_writer_write(logWriter *w, int stream, const void *rec, size_t len)
+{
+    void *p = log_writer_reserve(w, stream, len);
+
+    if (p == NULL)
+        return 0;
+    memcpy(p, rec, len);
+    log_writer_commit(w, stream, len);
+    return 1;
+}
+
+int log_writer_printf(logWriter *w, int stream, const char *fmt, ...)
+{
+    logStream *st = &w->streams[stream];
+    size_t room = (st->cur != NULL) ? LOG_WRITER_BLOCK - st->cur->len : 0;
+    va_list ap;
+
+    // formatted straight into the block, again into a fresh one if it did not fit
+    va_start(ap, fmt);
+    int len = (room > 0) ? vsnprintf((char *) st->cur->data + st->cur->len, room, fmt, ap) : -1;
+    va_end(ap);
+
+    if (len >= 0 && (size_t) len < room) {
+        log_writer_commit(w, stream, len);
+        return 1;
+    }
+
+    if (len < 0) {
+        // length unknown until formatted once
+        va_start(ap, fmt);
+        len = vsnprintf(NULL, 0, fmt, ap);
+        va_end(ap);
+    }
+
+    // +1 for the terminator vsnprintf writes, not committed
+    char *p = log_writer_reserve(w, stream, (size_t) len + 1);
+    if (p == NULL)
+        return 0;
+    va_start(ap, fmt);
+    vsnprintf(p, (size_t) len + 1, fmt, ap);
+    va_end(ap);
+    log_writer_commit(w, stream, len);
+    return 1;
+}
+
+uint64_t log_writer_offset(const logWriter *w, int stream)
+{
+    return w->streams[stream].offset;
+}
+
+void log_writer_poll(logWriter *w)
+{
+    uint64_t now = 0;
+
+    for (int s = 0; s < w->nstreams; s++)
+    {
+        logStream *st = &w->streams[s];
+        if (st->cur == NULL || st->cur->len == 0)
+            continue;
+        if (now == 0)
+            now = mono_ns();
+        if (now - st->cur_ns >= (uint64_t) LOG_WRITER_FLUSH_MS * 1000000ull)
+            hand_over(w, st);
+    }
+}
+
+void log_writer_flush(logWriter *w)
+{
+    for (int s = 0; s < w->nstreams; s++)
+    {
+        logStream *st = &w->streams[s];
+        if (st->cur != NULL && st->cur->len > 0)
+            hand_over(w, st);
+    }
+}
+
+void log_writer_report(const logWriter *w, FILE *fp)
+{
+    fprintf(fp, "log writer: %llu records, %llu kB in, %llu kB written in %llu blocks, %llu dropped (%llu kB), "
+                "%llu waits, write p99 %llu us max %llu us, %llu fsyncs p99 %llu us max %llu us, %llu errors\n",
+            (unsigned long long) w->records, (unsigned long long) (w->bytes_in / 1024),
+            (unsigned long long) (atomic_load(&w->bytes_written) / 1024),
+            (unsigned long long) atomic_load(&w->blocks_written),
+            (unsigned long long) w->dropped, (unsigned long long) (w->dropped_bytes / 1024),
+            (unsigned long long) w->waits,
+            (unsigned long long) hist_percentile(&w->write_us, 0.99), (unsigned long long) w->write_us.max,
+            (unsigned long long) atomic_load(&w->fsyncs),
+            (unsigned long long) hist_percentile(&w->fsync_us, 0.99), (unsigned long long) w->fsync_us.max,
+            (unsigned long long) atomic_load(&w->errors));
+}
+
+void log_writer_close(logWriter *w)
+{
+    if (!w->running)
+        return;
+
+    log_writer_flush(w);
+    atomic_store_explicit(&w->stop, 1, memory_order_release);
+    sem_post(&w->ready);
+    pthread_join(w->thread, NULL);
+    w->running = 0;
+
+    for (int s = 0; s < w->nstreams; s++)
+        close(w->streams[s].fd);
+    w->nstreams = 0;
+
+    sem_destroy(&w->ready);
+    free(w->blocks[0].data);
+}
@@ -0,0 +1,127 @@
+#ifndef LOG_WRITER_H
+#define LOG_WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "typedefs.h"
+#include "Log_Hist.h"
+
+// blocks handed to the writer thread - whole pages, written with one write() each
+#define LOG_WRITER_BLOCK        65536
+#define LOG_WRITER_BLOCKS       8           // must be a power of 2
+#define LOG_WRITER_ALIGN        4096
+
+// files one writer appends to
+#define LOG_WRITER_STREAMS      8
+
+// a block that has waited this long is written out part full, bounds what a crash loses
+#define LOG_WRITER_FLUSH_MS     10000
+
+// default time between fsyncs for LOG_FSYNC_INTERVAL
+#define LOG_WRITER_FSYNC_MS     10000
+
+// when written data is forced onto the card
+typedef enum {
+    LOG_FSYNC_NEVER,            // left to the kernel
+    LOG_FSYNC_BLOCK,            // after every block
+    LOG_FSYNC_INTERVAL,         // at most every fsync_ms while there is unsynced data
+} logFsync;
+
+// what a record does when every block is waiting to be written
+typedef enum {
+    LOG_FULL_DROP,              // record dropped and counted, the caller never waits
+    LOG_FULL_WAIT,              // caller waits for a free block (backpressure)
+} logFull;
+
+typedef struct logBlock {
+    uint8_t *data;              // LOG_WRITER_BLOCK bytes, LOG_WRITER_ALIGN aligned
+    uint32_t len;
+    int stream;
+} logBlock;
+
+typedef struct logStream {
+    int fd;
+    const char *path;
+    logBlock *cur;              // block being filled, NULL = none taken yet
+    uint64_t cur_ns;            // CLOCK_MONOTONIC of the first byte in cur
+    uint64_t offset;            // file offset of the next byte appended
+} logStream;
+
+// Background file writer - one producer thread appends records, the writer thread
+// does every write() and fsync(). Full blocks go over one lock-free ring and come back
+// empty over another, so appending a record is a copy into memory.
+typedef struct logWriter {
+    logBlock blocks[LOG_WRITER_BLOCKS];
+    logStream streams[LOG_WRITER_STREAMS];
+    int nstreams;
+    logFsync fsync;
+    uint32_t fsync_ms;
+    logFull full;
+
+    // producer -> writer thread
+    _Alignas(CACHE_LINE) _Atomic uint32_t full_head;
+    _Atomic uint32_t full_tail;
+    logBlock *full_ring[LOG_WRITER_BLOCKS];
+
+    // writer thread -> producer
+    _Alignas(CACHE_LINE) _Atomic uint32_t free_head;
+    _Atomic uint32_t free_tail;
+    logBlock *free_ring[LOG_WRITER_BLOCKS];
+
+    sem_t ready;                // posted for every block handed over and to stop
+    _Atomic int stop;
+    pthread_t thread;
+    int running;
+
+    // producer side
+    uint64_t records;
+    uint64_t bytes_in;
+    uint64_t dropped;           // records lost because no block was free
+    uint64_t dropped_bytes;
+    uint64_t waits;             // records that had to wait for a free block (LOG_FULL_WAIT)
+    logHist wait_us;
+
+    // writer thread side
+    _Atomic uint64_t blocks_written;
+    _Atomic uint64_t bytes_written;
+    _Atomic uint64_t fsyncs;
+    _Atomic uint64_t errors;    // failed writes and fsyncs
+    logHist write_us;
+    logHist fsync_us;
+} logWriter;
+
+// allocates the blocks and starts the writer thread, -1 with errno set on failure
+int log_writer_open(logWriter *w, logFsync sync, uint32_t fsync_ms, logFull full);
+
+// appends to path, writing header first if the file is new - returns the stream or -1
+// call before the stream's first record
+int log_writer_add(logWriter *w, const char *path, const char *header);
+
+// room for len bytes (at most LOG_WRITER_BLOCK) at the end of stream, NULL if dropped
+// fill it and log_writer_commit() the bytes used before the next reserve
+void *log_writer_reserve(logWriter *w, int stream, size_t len);
+void log_writer_commit(logWriter *w, int stream, size_t len);
+
+// one record - returns 1 if stored, 0 if dropped
+int log_writer_write(logWriter *w, int stream, const void *rec, size_t len);
+int log_writer_printf(logWriter *w, int stream, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+// file offset the next record of stream will land at
+uint64_t log_writer_offset(const logWriter *w, int stream);
+
+// hands over part full blocks older than LOG_WRITER_FLUSH_MS, cheap enough for every pass
+void log_writer_poll(logWriter *w);
+
+// hands over every part full block
+void log_writer_flush(logWriter *w);
+
+void log_writer_report(const logWriter *w, FILE *fp);
+
+// writes everything out, fsyncs and closes the files
+void log_writer_close(logWriter *w);
+
+#endif
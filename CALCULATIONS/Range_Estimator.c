@@ -0,0 +1,111 @@
+// Name: Range_Estimator
+// Description: Distance and laps left from the fuel cell energy and recent consumption
+
+// Energy used is fitted against distance with an exponentially weighted least squares line,
+// so the slope (J/m) follows the last couple of km without keeping or refitting any history.
+// Older points fade with distance driven, not with time, so standing still does not wash
+// the fit out. Energy per lap is an exponentially weighted average of the finished laps.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "Range_Estimator.h"
+
+void ew_fit_init(ewFit *f)
+{
+    memset(f, 0, sizeof(*f));
+}
+
+// weighted Welford update - means and co-moments stay centred, no large sums to cancel
+void ew_fit_add(ewFit *f, double decay, double x, double y)
+{
+    f->w = f->w * decay + 1.0;
+    f->cxx *= decay;
+    f->cxy *= decay;
+
+    double dx = x - f->mx;
+    double dy = y - f->my;
+    f->mx += dx / f->w;
+    f->my += dy / f->w;
+    f->cxx += dx * (x - f->mx);
+    f->cxy += dx * (y - f->my);
+}
+
+double ew_fit_slope(const ewFit *f)
+{
+    return (f->cxx > 0) ? f->cxy / f->cxx : 0.0;
+}
+
+void range_est_init(rangeEst *r)
+{
+    memset(r, 0, sizeof(*r));
+    ew_fit_init(&r->perM);
+}
+
+void range_est_sample(rangeEst *r, double distance_m, double remaining_j)
+{
+    if (r->samples++ == 0) {
+        r->first_m = r->last_m = distance_m;
+        r->last_remaining = r->remaining_j = remaining_j;
+        ew_fit_add(&r->perM, 1.0, distance_m, 0.0);
+        return;
+    }
+
+    // energy can come back (battery charged, regeneration), a refill is left out
+    double used = r->last_remaining - remaining_j;
+    if (used < -RANGE_REFILL_J)
+        r->refills++;
+    else
+        r->used_j += used;
+
+    double decay = exp(-(distance_m - r->last_m) / RANGE_FIT_M);
+    ew_fit_add(&r->perM, decay, distance_m, r->used_j);
+
+    r->last_m = distance_m;
+    r->last_remaining = r->remaining_j = remaining_j;
+}
+
+void range_est_lap(rangeEst *r, const lapResult *lap)
+{
+    if (lap == NULL || lap->distance_m <= 0)
+        return;
+
+    if (r->laps == 0) {
+        r->lap_j = lap->energy_j;
+        r->lap_m = lap->distance_m;
+    } else {
+        r->lap_j += RANGE_LAP_ALPHA * (lap->energy_j - r->lap_j);
+        r->lap_m += RANGE_LAP_ALPHA * (lap->distance_m - r->lap_m);
+    }
+    r->laps++;
+}
+
+double range_est_per_m(const rangeEst *r)
+{
+    if (r->last_m - r->first_m < RANGE_MIN_M)
+        return 0.0;
+    return ew_fit_slope(&r->perM);
+}
+
+// energy left never counts below empty
+static double remaining(const rangeEst *r)
+{
+    return (r->remaining_j > 0) ? r->remaining_j : 0.0;
+}
+
+double range_est_distance_left(const rangeEst *r)
+{
+    double perM = range_est_per_m(r);
+    return (perM > 0) ? remaining(r) / perM : -1.0;
+}
+
+double range_est_laps_left(const rangeEst *r)
+{
+    // finished laps are the best measure, otherwise the distance left over the lap length
+    if (r->laps > 0 && r->lap_j > 0)
+        return remaining(r) / r->lap_j;
+
+    double left = range_est_distance_left(r);
+    return (left >= 0 && r->lap_m > 0) ? left / r->lap_m : -1.0;
+}
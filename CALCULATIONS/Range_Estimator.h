@@ -0,0 +1,63 @@
+#ifndef RANGE_ESTIMATOR_H
+#define RANGE_ESTIMATOR_H
+
+#include <stdint.h>
+#include "Lap_Engine.h"
+
+// distance over which older consumption fades to 1/e in the per metre fit
+#define RANGE_FIT_M         2000.0
+
+// weight of the newest lap in the per lap average
+#define RANGE_LAP_ALPHA     0.3
+
+// no estimate before the fit has seen this much distance
+#define RANGE_MIN_M         200.0
+
+// remaining energy rising by more than this in one sample is a refill, not consumption
+#define RANGE_REFILL_J      10000.0
+
+// exponentially weighted least squares line y = a + b x, O(1) per point
+typedef struct ewFit {
+    double w;                   // total weight
+    double mx, my;              // weighted means
+    double cxx, cxy;            // weighted co-moments about the means
+} ewFit;
+
+typedef struct rangeEst {
+    ewFit perM;                 // energy used against distance, slope in J/m
+    double first_m;             // distance at the first sample
+    double last_m;              // distance at the previous sample
+    double last_remaining;      // J at the previous sample
+    double used_j;              // energy used since the start (refills left out)
+
+    double lap_j;               // exponentially weighted energy per lap
+    double lap_m;               // and distance per lap
+    uint32_t laps;              // laps averaged so far
+
+    double remaining_j;         // latest fuel cell energy
+    uint64_t samples;
+    uint64_t refills;
+} rangeEst;
+
+void ew_fit_init(ewFit *f);
+// older points are scaled by decay (0 - 1] before adding x, y with weight 1
+void ew_fit_add(ewFit *f, double decay, double x, double y);
+double ew_fit_slope(const ewFit *f);                // 0 without spread in x
+
+void range_est_init(rangeEst *r);
+
+// distance travelled (m) and energy left (J) - O(1)
+// remaining_j must be on the same basis as lapResult.energy_j (fuel cell only) for the laps left
+void range_est_sample(rangeEst *r, double distance_m, double remaining_j);
+
+// a lap finished
+void range_est_lap(rangeEst *r, const lapResult *lap);
+
+// J per metre recently, 0 if not known yet
+double range_est_per_m(const rangeEst *r);
+
+// metres and laps left at the recent consumption, -1 if not known yet
+double range_est_distance_left(const rangeEst *r);
+double range_est_laps_left(const rangeEst *r);
+
+#endif
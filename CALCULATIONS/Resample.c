@@ -0,0 +1,140 @@
+// Name: Resample
+// Description: Aligns motor, fuel cell and speed signals onto one common tick
+
+// Motor, fuel cell and speed frames come in on unrelated schedules, so their timestamps are
+// hardly ever within setD_Time of each other and most samples were thrown away. Every channel
+// keeps its last few samples; once all of them have moved past the next tick, each one is
+// linearly interpolated at that tick and the efficiencies get one aligned set of values.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "Resample.h"
+
+#define MASK (RESAMPLE_HIST - 1)
+
+const uint8_t resample_signal[RS_COUNT] = {
+    SIG_MTR_VOLT, SIG_MTR_CURR, SIG_FC_VOLT, SIG_FC_CURR, SIG_FC_JOULES, SIG_SPEED,
+};
+
+void resample_init(resampler *rs, uint32_t tick_ms)
+{
+    memset(rs, 0, sizeof(*rs));
+    rs->tick_ns = (uint64_t) (tick_ms ? tick_ms : RESAMPLE_TICK_MS) * 1000000ull;
+}
+
+void resample_push(resampler *rs, int ch, uint64_t time_ns, double raw)
+{
+    resampleHist *h = &rs->ch[ch];
+
+    if (h->count > 0 && time_ns <= h->time_ns[(h->count - 1) & MASK])
+        return;
+
+    h->time_ns[h->count & MASK] = time_ns;
+    h->raw[h->count & MASK] = raw;
+    h->count++;
+}
+
+int resample_store(resampler *rs, const signalStore *store)
+{
+    int pushed = 0;
+
+    for (int c = 0; c < RS_COUNT; c++)
+    {
+        const signalSample *s = &store->sig[resample_signal[c]];
+        resampleHist *h = &rs->ch[c];
+
+        if (s->time_ns == 0 || (h->count > 0 && s->time_ns == h->time_ns[(h->count - 1) & MASK]))
+            continue;
+        resample_push(rs, c, s->time_ns, (double) s->raw);
+        pushed++;
+    }
+
+    return pushed;
+}
+
+// first tick every channel can be interpolated at - after the newest of the first samples
+static uint64_t first_tick(const resampler *rs)
+{
+    uint64_t start = 0;
+
+    for (int c = 0; c < RS_COUNT; c++)
+    {
+        const resampleHist *h = &rs->ch[c];
+        uint32_t oldest = (h->count > RESAMPLE_HIST) ? h->count - RESAMPLE_HIST : 0;
+
+        if (h->count == 0)
+            return 0;
+        if (h->time_ns[oldest & MASK] > start)
+            start = h->time_ns[oldest & MASK];
+    }
+
+    return (start + rs->tick_ns - 1) / rs->tick_ns * rs->tick_ns;
+}
+
+int resample_next(resampler *rs, alignedSample *out)
+{
+    uint64_t maxGap = (uint64_t) RESAMPLE_MAX_GAP_MS * 1000000ull;
+
+    if (rs->next_tick == 0 && (rs->next_tick = first_tick(rs)) == 0)
+        return 0;
+
+    for (;;)
+    {
+        uint64_t t = rs->next_tick;
+        uint64_t resume = 0;
+        int c;
+
+        // every channel needs a sample at or after the tick
+        for (c = 0; c < RS_COUNT; c++)
+        {
+            const resampleHist *h = &rs->ch[c];
+            if (h->time_ns[(h->count - 1) & MASK] < t)
+                return 0;
+        }
+
+        for (c = 0; c < RS_COUNT; c++)
+        {
+            const resampleHist *h = &rs->ch[c];
+            uint32_t oldest = (h->count > RESAMPLE_HIST) ? h->count - RESAMPLE_HIST : 0;
+            uint32_t i = h->count - 1;
+
+            // newest sample not after the tick - at most RESAMPLE_HIST steps back
+            while (i > oldest && h->time_ns[i & MASK] > t)
+                i--;
+
+            uint64_t t0 = h->time_ns[i & MASK];
+            if (t0 > t) {
+                // history already overwritten past this tick (calculations fell behind)
+                resume = t0;
+                break;
+            }
+            if (t0 == t || i == h->count - 1) {
+                out->raw[c] = h->raw[i & MASK];
+                continue;
+            }
+
+            uint64_t t1 = h->time_ns[(i + 1) & MASK];
+            if (t1 - t0 > maxGap) {
+                // dropout - carry on from the first sample after it
+                resume = t1;
+                break;
+            }
+
+            double f = (double) (t - t0) / (double) (t1 - t0);
+            out->raw[c] = h->raw[i & MASK] + (h->raw[(i + 1) & MASK] - h->raw[i & MASK]) * f;
+        }
+
+        if (c < RS_COUNT) {
+            uint64_t next = (resume + rs->tick_ns - 1) / rs->tick_ns * rs->tick_ns;
+            rs->gaps += (next - t) / rs->tick_ns;
+            rs->next_tick = (next > t) ? next : t + rs->tick_ns;
+            continue;
+        }
+
+        out->time_ns = t;
+        rs->next_tick = t + rs->tick_ns;
+        rs->ticks++;
+        return 1;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stdint.h>
+#include "Signal_Store.h"
+
+// samples kept per signal - must be a power of 2
+// more than a batch of frames (CAN_RX_BATCH), every frame's samples are in before the ticks are worked out
+#define RESAMPLE_HIST       128
+
+// common tick the efficiencies are calculated on
+#define RESAMPLE_TICK_MS    100
+
+// two samples further apart than this are a dropout, not interpolated across
+#define RESAMPLE_MAX_GAP_MS 1000
+
+// signals aligned onto the tick
+enum {
+    RS_MTR_VOLT,
+    RS_MTR_CURR,
+    RS_FC_VOLT,
+    RS_FC_CURR,
+    RS_FC_JOULES,
+    RS_SPEED,
+    RS_COUNT
+};
+
+// signalId of every channel
+extern const uint8_t resample_signal[RS_COUNT];
+
+// every channel at the same instant, raw units (as sent on the bus)
+typedef struct alignedSample {
+    uint64_t time_ns;
+    double raw[RS_COUNT];
+} alignedSample;
+
+// last RESAMPLE_HIST samples of one channel
+typedef struct resampleHist {
+    uint64_t time_ns[RESAMPLE_HIST];
+    double raw[RESAMPLE_HIST];
+    uint32_t count;                     // samples pushed so far, newest is count - 1
+} resampleHist;
+
+typedef struct resampler {
+    uint64_t tick_ns;
+    uint64_t next_tick;                 // 0 until every channel has a sample
+    resampleHist ch[RS_COUNT];
+
+    // statistics
+    uint64_t ticks;                     // aligned samples produced
+    uint64_t gaps;                      // ticks skipped over a dropout or lost history
+} resampler;
+
+void resample_init(resampler *rs, uint32_t tick_ms);
+
+// add one sample - O(1), times must increase per channel (older ones are ignored)
+void resample_push(resampler *rs, int ch, uint64_t time_ns, double raw);
+
+// add whatever is new in the store, returns number of samples pushed
+// called by the writer after every frame it decodes, so no sample is overwritten unseen
+int resample_store(resampler *rs, const signalStore *store);
+
+// next tick every channel has data on both sides of, interpolated linearly
+// returns 1 with out filled, 0 if the next tick is not covered yet
+int resample_next(resampler *rs, alignedSample *out);
+
+#endif
@@ -1,46 +1,53 @@
 // Name: SaveArray2Data
-// Description: Saving program's array stored in memory into file in CSV format
+// Description: Saving program's calculated data into files in CSV format
 
 // choice = 1 for Electrical Efficiency data
 // choice = 2 for Fuel Efficiency data
+// choice = 3 for finished laps
 // to write other data, add more choice values
+// lines are appended through the background log writer (Log_Writer.c), so nothing here
+// waits on the SD card - files are kept across runs, the header is written once when new
 /* ---------------------------------------------------------------------------- */
 #include <stdio.h>
 #include "typedefs.h"
+#include "Lap_Engine.h"
+#include "Signal_Defs.h"
+#include "Log_Writer.h"
+#include "SaveArray2Data.h"
 
-// main function
-void saveArray2File (int choice, dataStruct speedVal[], float *array,int arr_size, int data_points)
+// opening the file for choice on w, returns its stream or -1
+int saveFileOpen (logWriter *w, int choice)
 {
-    FILE *fp;
+    char header[64];
 
-    // Open or Create correct file to save relavant data into
+    // column named after the signal in signals.dbc
     if (choice == 1)
     {
-        fp = fopen("Elec_Eff.csv", "w");
+        snprintf(header, sizeof(header), "index,time_s,%s\n", signalInfos[SIG_ELEC_EFF].name);
+        return log_writer_add(w, "Elec_Eff.csv", header);
     } else if (choice == 2) {
-        fp = fopen("Fuel_Eff.csv", "w");
-    } else {
-        exit ();
+        snprintf(header, sizeof(header), "index,time_s,%s\n", signalInfos[SIG_FUEL_EFF].name);
+        return log_writer_add(w, "Fuel_Eff.csv", header);
+    } else if (choice == 3) {
+        return log_writer_add(w, "Laps.csv", "lap,time_s,distance_m,energy_j,avg_speed_kmh,avg_eff\n");
     }
 
-    // incase there is problem with opening said files
-    if (fp == NULL)
-    {
-        printf("Error handling file.\n");
-        exit(1);
-    }
-    
-    // writing data through loop
-    for (int i = 0; i < arr_size; i++)
-    {
-        for (int j = 0; j < data_points; j++)
-            fprintf(fp, "%d,%0.3f,%0.3f\n");
-        }
-    }
-    
-    // clearning array data since data has been stored in file
-    
+    return -1;
+}
 
-    // closing appropriate written file
-    fclose(fp);
-}
\ No newline at end of file
+// one sample, returns 0 if the writer had to drop it
+int saveSample2File (logWriter *w, int stream, const dataStruct *sample, float value)
+{
+    if (stream < 0)
+        return 0;
+    return log_writer_printf(w, stream, "%d,%0.3f,%0.3f\n", sample->index_num, sample->time, value);
+}
+
+// one finished lap
+int saveLap2File (logWriter *w, int stream, const lapResult *lap)
+{
+    if (stream < 0)
+        return 0;
+    return log_writer_printf(w, stream, "%u,%0.3f,%0.1f,%0.1f,%0.2f,%0.3f\n", lap->lap, lap->time_s,
+                             lap->distance_m, lap->energy_j, lap->avg_speed, lap->avg_eff);
+}
@@ -0,0 +1,12 @@
+#ifndef SAVEARRAY2DATA_H
+#define SAVEARRAY2DATA_H
+
+#include "typedefs.h"
+#include "Lap_Engine.h"
+#include "Log_Writer.h"
+
+int saveFileOpen (logWriter *w, int choice);
+int saveSample2File (logWriter *w, int stream, const dataStruct *sample, float value);
+int saveLap2File (logWriter *w, int stream, const lapResult *lap);
+
+#endif
@@ -0,0 +1,37 @@
+// Generated from signals.dbc by gen_signals.py - do not edit, change signals.dbc and run it again
+#include "Signal_Defs.h"
+
+const signalInfo signalInfos[SIG_COUNT] = {
+    [SIG_H2_ALARM] = { "h2_alarm", "", "%.4g", 1.0f, 0.0f, 1 },
+    [SIG_MTR_VOLT] = { "mtr_volt", "V", "%.4g", 0.0001f, 0.0f, 1 },
+    [SIG_MTR_CURR] = { "mtr_curr", "A", "%.4g", 0.0001f, 0.0f, 1 },
+    [SIG_FC_JOULES] = { "fc_joules", "J", "%.4g", 0.0001f, 0.0f, 1 },
+    [SIG_FC_VOLT] = { "fc_volt", "V", "%.4g", 0.0001f, 0.0f, 1 },
+    [SIG_FC_CURR] = { "fc_curr", "A", "%.4g", 0.0001f, 0.0f, 1 },
+    [SIG_DRV_TEMP] = { "drv_temp", "degC", "%.0f°C", 1.0f, 0.0f, 1 },
+    [SIG_DRV_HUMD] = { "drv_humd", "%", "%.4g", 1.0f, 0.0f, 1 },
+    [SIG_SPEED] = { "speed", "km/h", "%.0f km/h", 0.0001f, 0.0f, 1 },
+    [SIG_BATT_VOLT] = { "batt_volt", "V", "%.4g", 0.0001f, 0.0f, 1 },
+    [SIG_BATT_JOULES] = { "batt_joules", "J", "%.4g", 0.0001f, 0.0f, 1 },
+    [SIG_ELEC_EFF] = { "elec_eff", "", "%.4g", 0.0001f, 0.0f, 0 },
+    [SIG_ELEC_EFF_AVG] = { "elec_eff_avg", "", "%.4g", 0.0001f, 0.0f, 0 },
+    [SIG_FUEL_EFF] = { "fuel_eff", "km/J", "Current: %.1f%%", 0.0001f, 0.0f, 0 },
+    [SIG_FUEL_EFF_AVG] = { "fuel_eff_avg", "km/J", "Average: %.1f%%", 0.0001f, 0.0f, 0 },
+    [SIG_FUEL_EFF_WIN] = { "fuel_eff_win", "km/J", "%.4g", 0.0001f, 0.0f, 0 },
+    [SIG_FUEL_EFF_LAP] = { "fuel_eff_lap", "km/J", "%.4g", 0.0001f, 0.0f, 0 },
+    [SIG_FAN_RPM] = { "fan_rpm", "rpm", "%.4g", 1.0f, 0.0f, 0 },
+    [SIG_FAN_SETPOINT] = { "fan_setpoint", "degC", "set %.0f°C", 0.001f, 0.0f, 0 },
+    [SIG_HEAT_INDEX] = { "heat_index", "degC", "%.4g", 0.001f, 0.0f, 0 },
+    [SIG_LAP_NUM] = { "lap_num", "", "%.4g", 1.0f, 0.0f, 0 },
+    [SIG_LAP_DIST] = { "lap_dist", "m", "%.4g", 0.01f, 0.0f, 0 },
+    [SIG_LAP_TIME] = { "lap_time", "s", "%.4g", 0.001f, 0.0f, 0 },
+    [SIG_LAP_ENERGY] = { "lap_energy", "J", "%.4g", 0.01f, 0.0f, 0 },
+    [SIG_LAP_SPEED] = { "lap_speed", "km/h", "%.4g", 0.001f, 0.0f, 0 },
+    [SIG_LAP_EFF] = { "lap_eff", "km/J", "%.4g", 0.0001f, 0.0f, 0 },
+    [SIG_MTR_ENERGY] = { "mtr_energy", "J", "%.4g", 0.01f, 0.0f, 0 },
+    [SIG_FC_ENERGY] = { "fc_energy", "J", "%.4g", 0.01f, 0.0f, 0 },
+    [SIG_ENERGY_DRIFT] = { "energy_drift", "J", "%.4g", 0.01f, 0.0f, 0 },
+    [SIG_ENERGY_RATIO] = { "energy_ratio", "", "%.4g", 0.0001f, 0.0f, 0 },
+    [SIG_RANGE_M] = { "range_m", "m", "%.0f m left", 0.1f, 0.0f, 0 },
+    [SIG_LAPS_LEFT] = { "laps_left", "", "%.1f laps left", 0.001f, 0.0f, 0 },
+};
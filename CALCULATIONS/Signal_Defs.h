@@ -0,0 +1,80 @@
+// Generated from signals.dbc by gen_signals.py - do not edit, change signals.dbc and run it again
+#ifndef SIGNAL_DEFS_H
+#define SIGNAL_DEFS_H
+
+// every signal the store holds, index into signalStore.sig
+typedef enum signalId {
+    // decoded from CAN
+    SIG_H2_ALARM = 0,
+    SIG_MTR_VOLT,               // V
+    SIG_MTR_CURR,               // A
+    SIG_FC_JOULES,              // fuel cell energy left, J
+    SIG_FC_VOLT,                // V
+    SIG_FC_CURR,                // A
+    SIG_DRV_TEMP,               // driver side temperature, degC
+    SIG_DRV_HUMD,               // driver side relative humidity, %
+    SIG_SPEED,                  // km/h
+    SIG_BATT_VOLT,              // V
+    SIG_BATT_JOULES,            // battery pack energy left, J
+
+    // calculated
+    SIG_ELEC_EFF,
+    SIG_ELEC_EFF_AVG,
+    SIG_FUEL_EFF,               // km/J
+    SIG_FUEL_EFF_AVG,           // km/J
+    SIG_FUEL_EFF_WIN,           // average over the last CALC_WINDOW_S seconds, km/J
+    SIG_FUEL_EFF_LAP,           // average over the current lap, km/J
+    SIG_FAN_RPM,                // rpm
+    SIG_FAN_SETPOINT,           // cabin setpoint the fan loop works to, degC
+    SIG_HEAT_INDEX,             // heat index felt by the driver, degC
+    SIG_LAP_NUM,                // lap in progress, 1 = first
+    SIG_LAP_DIST,               // distance into the lap in progress, m
+    SIG_LAP_TIME,               // last finished lap: seconds, lap number in raw like the lap_* below, s
+    SIG_LAP_ENERGY,             // fuel cell energy used, J
+    SIG_LAP_SPEED,              // average speed, km/h
+    SIG_LAP_EFF,                // average fuel efficiency, km/J
+    SIG_MTR_ENERGY,             // used by the motor since the start (Energy_Integrator.c), J
+    SIG_FC_ENERGY,              // delivered by the fuel cell since the start, J
+    SIG_ENERGY_DRIFT,           // fuel cell energy - drop in fc_joules, J
+    SIG_ENERGY_RATIO,           // drop in fc_joules / fuel cell energy over the last CALC_WINDOW_S
+    SIG_RANGE_M,                // distance left at the recent consumption (Range_Estimator.c), not set until it is known, m
+    SIG_LAPS_LEFT,              // laps left, not set until it is known
+
+    SIG_COUNT
+} signalId;
+
+// raw bus value -> value in real units of the decoded signals, value = raw * SCALE + OFFSET
+// _DIV is 1 / SCALE where that is a whole number, for fixed point on the raw values
+#define SIG_H2_ALARM_SCALE       1.0
+#define SIG_MTR_VOLT_SCALE       0.0001
+#define SIG_MTR_VOLT_DIV         10000
+#define SIG_MTR_CURR_SCALE       0.0001
+#define SIG_MTR_CURR_DIV         10000
+#define SIG_FC_JOULES_SCALE      0.0001
+#define SIG_FC_JOULES_DIV        10000
+#define SIG_FC_VOLT_SCALE        0.0001
+#define SIG_FC_VOLT_DIV          10000
+#define SIG_FC_CURR_SCALE        0.0001
+#define SIG_FC_CURR_DIV          10000
+#define SIG_DRV_TEMP_SCALE       1.0
+#define SIG_DRV_HUMD_SCALE       1.0
+#define SIG_SPEED_SCALE          0.0001
+#define SIG_SPEED_DIV            10000
+#define SIG_BATT_VOLT_SCALE      0.0001
+#define SIG_BATT_VOLT_DIV        10000
+#define SIG_BATT_JOULES_SCALE    0.0001
+#define SIG_BATT_JOULES_DIV      10000
+
+// what the description says about a signal - log column schema and GUI bindings
+typedef struct signalInfo {
+    const char *name;           // short name, also the log column
+    const char *unit;           // "" if it has none
+    const char *format;         // printf format of the value on the GUI
+    float scale;                // raw -> value when decoded, log resolution when calculated
+    float offset;
+    unsigned char decoded;      // 1 = comes from the bus, 0 = calculated
+} signalInfo;
+
+extern const signalInfo signalInfos[SIG_COUNT];
+
+#endif
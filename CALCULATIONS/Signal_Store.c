@@ -0,0 +1,153 @@
+// Name: Signal_Store
+// Description: Latest value and timestamp of every signal in one cache aligned block,
+//              published under a seqlock so readers get a consistent multi-signal snapshot
+
+// The store lives in shared memory (/dev/shm/edas_signals) so the GUI process can read
+// it without talking to the calculation program. Readers never block the writer.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdatomic.h>
+#include "Signal_Store.h"
+
+const char *signal_store_name(signalId id)
+{
+    return (id < SIG_COUNT) ? signalInfos[id].name : "unknown";
+}
+
+const signalInfo *signal_store_info(signalId id)
+{
+    return (id < SIG_COUNT) ? &signalInfos[id] : NULL;
+}
+
+signalStore *signal_store_map(int writer)
+{
+    int fd;
+    void *p;
+
+    if (writer) {
+        fd = shm_open(SIGNAL_STORE_NAME, O_CREAT | O_RDWR, 0644);
+        if (fd < 0)
+            return NULL;
+        if (ftruncate(fd, sizeof(signalStore)) < 0) {
+            close(fd);
+            return NULL;
+        }
+        p = mmap(NULL, sizeof(signalStore), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    } else {
+        fd = shm_open(SIGNAL_STORE_NAME, O_RDONLY, 0);
+        if (fd < 0)
+            return NULL;
+        p = mmap(NULL, sizeof(signalStore), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (p == MAP_FAILED)
+        return NULL;
+
+    // fresh start for the writer, readers see all signals as never set
+    if (writer)
+        memset(p, 0, sizeof(signalStore));
+
+    return p;
+}
+
+void signal_store_unmap(signalStore *store)
+{
+    if (store != NULL)
+        munmap(store, sizeof(signalStore));
+}
+
+signalControl *signal_control_map(void)
+{
+    struct stat st;
+    void *p;
+
+    // either program may run as its own user, both have to be able to write
+    int fd = shm_open(SIGNAL_CONTROL_NAME, O_CREAT | O_RDWR, 0666);
+    if (fd < 0)
+        return NULL;
+    fchmod(fd, 0666);
+
+    // only grows a new object - a setpoint already in there stays
+    if (fstat(fd, &st) < 0 || (st.st_size < (off_t) sizeof(signalControl) && ftruncate(fd, sizeof(signalControl)) < 0)) {
+        close(fd);
+        return NULL;
+    }
+    p = mmap(NULL, sizeof(signalControl), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    return (p == MAP_FAILED) ? NULL : p;
+}
+
+void signal_control_unmap(signalControl *control)
+{
+    if (control != NULL)
+        munmap(control, sizeof(signalControl));
+}
+
+void signal_store_write_begin(signalStore *store)
+{
+    // odd = write in progress
+    atomic_store_explicit(&store->seq, atomic_load_explicit(&store->seq, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void signal_store_write_end(signalStore *store)
+{
+    // even again, release makes the new values visible first
+    atomic_store_explicit(&store->seq, atomic_load_explicit(&store->seq, memory_order_relaxed) + 1, memory_order_release);
+}
+
+// up to tries copies, out is only written by one that was not torn by the writer
+static int snapshot_tries(signalStore *store, signalSnapshot *out, int tries)
+{
+    signalSample sig[SIG_COUNT];
+    uint32_t seq1, seq2;
+
+    for (int i = 0; i < tries; i++)
+    {
+        // a writer preempted half way (or dead) would keep seq odd for good - let it run
+        if (i > 0)
+            sched_yield();
+
+        seq1 = atomic_load_explicit(&store->seq, memory_order_acquire);
+        if (seq1 & 1)
+            continue;
+
+        memcpy(sig, store->sig, sizeof(sig));
+
+        atomic_thread_fence(memory_order_acquire);
+        seq2 = atomic_load_explicit(&store->seq, memory_order_relaxed);
+        if (seq1 == seq2)
+        {
+            memcpy(out->sig, sig, sizeof(out->sig));
+            out->seq = seq1;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int signal_store_snapshot(signalStore *store, signalSnapshot *out)
+{
+    return snapshot_tries(store, out, SIGNAL_STORE_TRIES);
+}
+
+int signal_store_try_snapshot(signalStore *store, signalSnapshot *out)
+{
+    return snapshot_tries(store, out, 1);
+}
+
+float signal_store_seconds(const signalStore *store, uint64_t time_ns)
+{
+    if (time_ns == 0 || time_ns < store->start_ns)
+        return 0.0f;
+    return (float) ((double) (time_ns - store->start_ns) * 1e-9);
+}
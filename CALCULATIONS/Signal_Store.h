@@ -0,0 +1,89 @@
+#ifndef SIGNAL_STORE_H
+#define SIGNAL_STORE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "typedefs.h"
+#include "Signal_Defs.h"            // signalId and what each signal is, generated from signals.dbc
+
+// shared memory object the GUI maps to read the signals
+#define SIGNAL_STORE_NAME "/edas_signals"
+
+// copies a reader makes before giving up on a writer that keeps the store busy
+#define SIGNAL_STORE_TRIES 64
+
+// latest value of one signal
+typedef struct signalSample {
+    uint64_t time_ns;           // kernel receive time of the frame (CLOCK_REALTIME), 0 = never set
+    float value;                // value in real units
+    uint32_t raw;               // value as sent on the bus
+} signalSample;
+
+// One writer (calculation thread), any number of readers (GUI, other threads, other processes).
+// The writer makes seq odd while it changes sig[], readers retry if seq was odd or changed.
+typedef struct signalStore {
+    _Alignas(CACHE_LINE) _Atomic uint32_t seq;
+    uint64_t start_ns;          // time of the first frame, for seconds-since-start values
+
+    // hot region - a snapshot is one memcpy of this
+    _Alignas(CACHE_LINE) signalSample sig[SIG_COUNT];
+} signalStore;
+
+// settings the GUI changes, in their own small object because the GUI maps the store read-only
+// both sides map it read-write, every field is one atomic so no lock is needed
+#define SIGNAL_CONTROL_NAME "/edas_control"
+
+// cabin setpoint until the GUI sets one
+#define CONTROL_FAN_SETPOINT_C 25
+
+typedef struct signalControl {
+    _Atomic int32_t fan_setpoint_mc;    // cabin setpoint in 1/1000 C, 0 = not set
+    _Atomic uint32_t fan_setpoint_seq;  // counts setpoint changes
+} signalControl;
+
+// consistent copy of every signal
+typedef struct signalSnapshot {
+    uint32_t seq;
+    signalSample sig[SIG_COUNT];
+} signalSnapshot;
+
+// map the store in shared memory, writer creates it, readers map it read-only
+// returns NULL if it could not be mapped
+signalStore *signal_store_map(int writer);
+void signal_store_unmap(signalStore *store);
+
+// map the control object, created by whichever side comes first and kept across restarts
+// returns NULL if it could not be mapped
+signalControl *signal_control_map(void);
+void signal_control_unmap(signalControl *control);
+
+// writer side - every set between begin and end is seen by readers all at once
+void signal_store_write_begin(signalStore *store);
+void signal_store_write_end(signalStore *store);
+
+static inline void signal_store_set(signalStore *store, signalId id, uint32_t raw, float value, uint64_t time_ns)
+{
+    store->sig[id].time_ns = time_ns;
+    store->sig[id].raw = raw;
+    store->sig[id].value = value;
+}
+
+// reader side - never blocks the writer, retries (yielding in between) while a write is in
+// progress, at most SIGNAL_STORE_TRIES times - returns 0, or -1 with out left as it was so the
+// caller carries on with its previous snapshot
+int signal_store_snapshot(signalStore *store, signalSnapshot *out);
+
+// one copy, no retry and no yield - for real time threads, which would only spin while the
+// lower priority writer they preempted cannot finish; same result as signal_store_snapshot()
+int signal_store_try_snapshot(signalStore *store, signalSnapshot *out);
+
+// short name of a signal for logs and statistics
+const char *signal_store_name(signalId id);
+
+// schema entry of a signal from signals.dbc, NULL if id is out of range
+const signalInfo *signal_store_info(signalId id);
+
+// seconds since the first frame for a sample time
+float signal_store_seconds(const signalStore *store, uint64_t time_ns);
+
+#endif
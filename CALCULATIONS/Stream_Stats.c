@@ -0,0 +1,126 @@
+// Name: Stream_Stats
+// Description: Numerically stable running, sliding window and per lap averages
+
+// The old running average (avg * count + x) / (count + 1) in float drifts over a long run and
+// costs a multiply and a divide per sample. Welford's update keeps mean and variance accurate
+// in double; windows keep their samples in a ring and add / remove them from Kahan sums, so
+// each sample is O(1) whatever the window length.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "Stream_Stats.h"
+
+#define MASK (WIN_STATS_CAP - 1)
+
+void run_stats_init(runStats *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+void run_stats_add(runStats *s, double x)
+{
+    if (isnan(x) || isinf(x))
+        return;
+
+    s->n++;
+    double d = x - s->mean;
+    s->mean += d / (double) s->n;
+    s->m2 += d * (x - s->mean);
+    kahan_add(&s->sum, &s->sum_c, x);
+
+    if (s->n == 1 || x < s->min)
+        s->min = x;
+    if (s->n == 1 || x > s->max)
+        s->max = x;
+}
+
+double run_stats_mean(const runStats *s)
+{
+    return s->mean;
+}
+
+double run_stats_var(const runStats *s)
+{
+    return (s->n > 1) ? s->m2 / (double) (s->n - 1) : 0.0;
+}
+
+void win_stats_init(winStats *w, uint64_t window_ns)
+{
+    memset(w, 0, sizeof(*w));
+    w->window_ns = window_ns;
+}
+
+static void win_stats_drop(winStats *w)
+{
+    double x = w->value[w->tail & MASK] - w->shift;
+    kahan_add(&w->sum, &w->sum_c, -x);
+    kahan_add(&w->sq, &w->sq_c, -x * x);
+    w->tail++;
+}
+
+void win_stats_add(winStats *w, uint64_t time_ns, double x)
+{
+    if (isnan(x) || isinf(x))
+        return;
+
+    // samples that left the window, then room for the new one
+    while (w->tail != w->head && w->time_ns[w->tail & MASK] + w->window_ns < time_ns)
+        win_stats_drop(w);
+    if (w->head - w->tail == WIN_STATS_CAP) {
+        win_stats_drop(w);
+        w->evicted++;
+    }
+
+    // start the sums over whenever the window empties out, so no error is carried forever
+    if (w->head == w->tail) {
+        w->shift = x;
+        w->sum = w->sq = w->sum_c = w->sq_c = 0;
+    }
+
+    w->time_ns[w->head & MASK] = time_ns;
+    w->value[w->head & MASK] = x;
+    w->head++;
+    kahan_add(&w->sum, &w->sum_c, x - w->shift);
+    kahan_add(&w->sq, &w->sq_c, (x - w->shift) * (x - w->shift));
+}
+
+uint32_t win_stats_count(const winStats *w)
+{
+    return w->head - w->tail;
+}
+
+double win_stats_mean(const winStats *w)
+{
+    uint32_t n = w->head - w->tail;
+    return n ? w->shift + w->sum / n : 0.0;
+}
+
+double win_stats_var(const winStats *w)
+{
+    uint32_t n = w->head - w->tail;
+    if (n < 2)
+        return 0.0;
+
+    double mean = w->sum / n;           // of the shifted values
+    double var = (w->sq - n * mean * mean) / (n - 1);
+    return (var > 0) ? var : 0.0;
+}
+
+void lap_stats_init(lapStats *l)
+{
+    memset(l, 0, sizeof(*l));
+}
+
+void lap_stats_add(lapStats *l, double x)
+{
+    run_stats_add(&l->current, x);
+}
+
+void lap_stats_next(lapStats *l)
+{
+    l->last = l->current;
+    run_stats_init(&l->current);
+    l->laps++;
+}
@@ -0,0 +1,61 @@
+#ifndef STREAM_STATS_H
+#define STREAM_STATS_H
+
+#include <stdint.h>
+
+// samples a sliding window can hold - must be a power of 2
+#define WIN_STATS_CAP 1024
+
+// running mean and variance over everything added (Welford), sum kept with Kahan compensation
+typedef struct runStats {
+    uint64_t n;
+    double mean;
+    double m2;                  // sum of squared differences from the mean
+    double sum, sum_c;          // compensated total
+    double min, max;
+} runStats;
+
+// mean and variance over the last window_ns of samples, O(1) per sample
+typedef struct winStats {
+    uint64_t window_ns;
+    uint64_t time_ns[WIN_STATS_CAP];
+    double value[WIN_STATS_CAP];
+    uint32_t head, tail;        // samples added / expired so far
+    double shift;               // sums are of value - shift, so the squares do not cancel out
+    double sum, sum_c;          // compensated sum of the samples in the window
+    double sq, sq_c;            // compensated sum of squares
+    uint64_t evicted;           // samples pushed out early because the ring was full
+} winStats;
+
+// this lap and the one before
+typedef struct lapStats {
+    runStats current;
+    runStats last;
+    uint32_t laps;
+} lapStats;
+
+// compensated sum - the rounding error of every add is carried into the next one
+static inline void kahan_add(double *sum, double *c, double x)
+{
+    double y = x - *c;
+    double t = *sum + y;
+    *c = (t - *sum) - y;
+    *sum = t;
+}
+
+void run_stats_init(runStats *s);
+void run_stats_add(runStats *s, double x);
+double run_stats_mean(const runStats *s);
+double run_stats_var(const runStats *s);        // sample variance, 0 below two samples
+
+void win_stats_init(winStats *w, uint64_t window_ns);
+void win_stats_add(winStats *w, uint64_t time_ns, double x);   // times must not go backwards
+uint32_t win_stats_count(const winStats *w);
+double win_stats_mean(const winStats *w);
+double win_stats_var(const winStats *w);
+
+void lap_stats_init(lapStats *l);
+void lap_stats_add(lapStats *l, double x);
+void lap_stats_next(lapStats *l);              // lap finished, current becomes last
+
+#endif
@@ -0,0 +1,727 @@
+// Name: Telemetry_Log
+// Description: Compressed columnar log of every signal - writer fed from the signal store,
+//              reader for the export and query tools
+
+// A CSV line per value takes ~25 bytes for 12 bytes of data. Here every signal is a column of
+// its own, sampled whenever its time in the store changes, and each sample is two varints:
+// timestamps as delta-of-delta in microseconds (0 for a steady period) and values as the zigzag
+// delta in the integer units of the signal's scale in signals.dbc (raw bus value for decoded
+// signals). A steady signal costs 2 - 4 bytes a sample. Samples are encoded as they come into
+// fixed buffers; a chunk with a min/max/count header per column is handed to the log writer
+// when a column fills up or TLOG_CHUNK_MS has passed, so nothing is allocated while running.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "Telemetry_Log.h"
+
+#define SCHEMA_MAX  (SIG_COUNT * 96)
+
+// a chunk goes into one log writer block - with every column full it is this big; more
+// signals in signals.dbc need a smaller TLOG_COL_BYTES (about 42 signals at 1536)
+_Static_assert(sizeof(tlogChunk) + SIG_COUNT * (sizeof(tlogColumn) + TLOG_COL_BYTES) <= LOG_WRITER_BLOCK,
+               "a full telemetry chunk does not fit a log writer block, lower TLOG_COL_BYTES");
+
+static inline uint32_t put_varint(uint8_t *p, uint64_t v)
+{
+    uint32_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t) v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = (uint8_t) v;
+    return n;
+}
+
+// 0 if the varint runs past end
+static inline uint32_t get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+    uint64_t x = 0;
+    for (uint32_t n = 0, shift = 0; p + n < end && shift < 64; n++, shift += 7)
+    {
+        x |= (uint64_t) (p[n] & 0x7F) << shift;
+        if (!(p[n] & 0x80)) {
+            *v = x;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+static inline uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+// schema text of this build, the writer rounds with the scales exactly as written here
+static uint32_t build_schema(char *text, size_t size, double *scale)
+{
+    size_t len = 0;
+
+    for (int i = 0; i < SIG_COUNT; i++)
+    {
+        char s[32];
+        snprintf(s, sizeof(s), "%.9g", (double) signalInfos[i].scale);
+        if (scale != NULL)
+            scale[i] = strtod(s, NULL);
+        len += snprintf(text + len, size - len, "%s,%s,%s,%.9g\n", signalInfos[i].name,
+                        signalInfos[i].unit, s, (double) signalInfos[i].offset);
+    }
+    return (uint32_t) len;
+}
+
+/*-------------------------------------------------------------*/
+// writer
+
+// index written out again unless the one on the card already holds exactly these entries
+static int write_index(const char *path, uint64_t start_us, const tlogIndexEntry *e, size_t n)
+{
+    tlogIndexHeader hdr;
+    struct stat st;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TLOG_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = TLOG_VERSION;
+    hdr.entry_size = sizeof(tlogIndexEntry);
+    hdr.start_us = start_us;
+    size_t size = sizeof(hdr) + n * sizeof(tlogIndexEntry);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size == size)
+    {
+        uint8_t *old = malloc(size);
+        int same = old != NULL && pread(fd, old, size, 0) == (ssize_t) size
+                   && memcmp(old, &hdr, sizeof(hdr)) == 0 && memcmp(old + sizeof(hdr), e, size - sizeof(hdr)) == 0;
+        free(old);
+        if (same) {
+            close(fd);
+            return 0;
+        }
+    }
+
+    size_t len = n * sizeof(tlogIndexEntry);
+    if (ftruncate(fd, 0) < 0 || write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+        || (len > 0 && write(fd, e, len) != (ssize_t) len) || fdatasync(fd) < 0)
+    {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// header of a new file, or the existing one checked and cut back to its last whole chunk,
+// the index brought in line with it either way - *last_us is where the index ends
+static int prepare_file(const char *path, const char *idx_path, const char *schema, uint32_t schema_len,
+                        uint64_t *last_us)
+{
+    struct stat st;
+    tlogHeader hdr;
+    tlogIndexEntry *idx = NULL;
+    size_t n = 0, room = 0;
+
+    *last_us = 0;
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0)
+        goto fail;
+
+    if (st.st_size == 0)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, TLOG_MAGIC, sizeof(hdr.magic));
+        hdr.version = TLOG_VERSION;
+        hdr.signals = SIG_COUNT;
+        hdr.schema_len = schema_len;
+        hdr.start_us = (uint64_t) now.tv_sec * 1000000ull + (uint64_t) now.tv_nsec / 1000;
+        if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || write(fd, schema, schema_len) != schema_len
+            || write_index(idx_path, hdr.start_us, NULL, 0) < 0)
+            goto fail;
+        close(fd);
+        return 0;
+    }
+
+    char old[SCHEMA_MAX];
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || memcmp(hdr.magic, TLOG_MAGIC, sizeof(hdr.magic)) != 0
+        || hdr.version != TLOG_VERSION || hdr.schema_len != schema_len
+        || pread(fd, old, schema_len, sizeof(hdr)) != schema_len || memcmp(old, schema, schema_len) != 0)
+    {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    // walking the chunk headers only, a chunk cut short by a power loss is cut off
+    off_t end = sizeof(hdr) + schema_len;
+    tlogChunk c;
+    while (pread(fd, &c, sizeof(c), end) == sizeof(c) && c.magic == TLOG_CHUNK_MAGIC
+           && end + (off_t) sizeof(c) + c.len <= st.st_size)
+    {
+        if (n == room) {
+            room = room ? room * 2 : 1024;
+            tlogIndexEntry *more = realloc(idx, room * sizeof(*idx));
+            if (more == NULL)
+                goto fail;
+            idx = more;
+        }
+        *last_us = (c.last_us > *last_us) ? c.last_us : *last_us;
+        idx[n++] = (tlogIndexEntry) { .offset = (uint64_t) end, .first_us = c.first_us, .last_us = *last_us };
+        end += sizeof(c) + c.len;
+    }
+    if (end < st.st_size && ftruncate(fd, end) < 0)
+        goto fail;
+    if (write_index(idx_path, hdr.start_us, idx, n) < 0)
+        goto fail;
+
+    free(idx);
+    close(fd);
+    return 0;
+
+fail:
+    {
+        int err = errno;
+        free(idx);
+        close(fd);
+        errno = err;
+    }
+    return -1;
+}
+
+int tlog_open(tlogWriter *t, logWriter *w, const char *path)
+{
+    char schema[SCHEMA_MAX];
+
+    memset(t, 0, sizeof(*t));
+    t->w = w;
+    t->stream = -1;
+    t->index_stream = -1;
+
+    if (snprintf(t->index_path, sizeof(t->index_path), "%s%s", path, TLOG_INDEX_SUFFIX) >= (int) sizeof(t->index_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    uint32_t len = build_schema(schema, sizeof(schema), t->scale);
+    if (prepare_file(path, t->index_path, schema, len, &t->index_last_us) < 0)
+        return -1;
+
+    t->stream = log_writer_add(w, path, NULL);
+    if (t->stream < 0)
+        return -1;
+    // the log goes on without its index, readers walk the chunks then
+    t->index_stream = log_writer_add(w, t->index_path, NULL);
+    return 0;
+}
+
+void tlog_sample(tlogWriter *t, int signal, uint64_t time_ns, int64_t q)
+{
+    tlogEncoder *c = &t->col[signal];
+    uint64_t us = time_ns / 1000;
+
+    // chunk out once a column could overflow or it spans long enough - signals are not in
+    // time order with each other, a sample a little before the first one is no reason
+    if (t->chunk_first_us != 0
+        && (c->len + TLOG_SAMPLE_MAX > TLOG_COL_BYTES || (int64_t) (us - t->chunk_first_us) >= TLOG_CHUNK_MS * 1000ll))
+        tlog_flush(t);
+    if (t->chunk_first_us == 0)
+        t->chunk_first_us = us;
+
+    uint8_t *p = c->data + c->len;
+    if (c->count == 0) {
+        p += put_varint(p, us);
+        p += put_varint(p, zigzag(q));
+        c->first_us = us;
+        c->min = c->max = q;
+        c->last_delta = 0;
+    } else {
+        int64_t delta = (int64_t) (us - c->last_us);
+        p += put_varint(p, zigzag(delta - c->last_delta));
+        p += put_varint(p, zigzag(q - c->last_value));
+        c->last_delta = delta;
+        c->min = (q < c->min) ? q : c->min;
+        c->max = (q > c->max) ? q : c->max;
+    }
+
+    c->last_us = us;
+    c->last_value = q;
+    c->count++;
+    c->len = (uint32_t) (p - c->data);
+    t->samples++;
+}
+
+void tlog_store(tlogWriter *t, const signalStore *store)
+{
+    if (t->stream < 0)
+        return;
+
+    for (int i = 0; i < SIG_COUNT; i++)
+    {
+        const signalSample *s = &store->sig[i];
+        if (s->time_ns == 0 || s->time_ns == t->col[i].seen_ns)
+            continue;
+        t->col[i].seen_ns = s->time_ns;
+
+        // decoded signals exactly as they came, calculated ones rounded to their scale
+        int64_t q = signalInfos[i].decoded ? (int64_t) s->raw
+                                           : llround(((double) s->value - signalInfos[i].offset) / t->scale[i]);
+        tlog_sample(t, i, s->time_ns, q);
+    }
+}
+
+void tlog_flush(tlogWriter *t)
+{
+    tlogChunk hdr;
+    size_t len = 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = TLOG_CHUNK_MAGIC;
+    hdr.first_us = UINT64_MAX;
+
+    for (int i = 0; i < SIG_COUNT; i++)
+    {
+        const tlogEncoder *c = &t->col[i];
+        if (c->count == 0)
+            continue;
+        hdr.columns++;
+        hdr.samples += c->count;
+        len += sizeof(tlogColumn) + c->len;
+        hdr.first_us = (c->first_us < hdr.first_us) ? c->first_us : hdr.first_us;
+        hdr.last_us = (c->last_us > hdr.last_us) ? c->last_us : hdr.last_us;
+    }
+    if (hdr.columns == 0)
+        return;
+    hdr.len = (uint32_t) len;
+
+    // straight into the log writer's block, a chunk always fits one (checked at the top)
+    uint64_t offset = log_writer_offset(t->w, t->stream);
+    uint8_t *p = log_writer_reserve(t->w, t->stream, sizeof(hdr) + len);
+    if (p != NULL)
+    {
+        uint8_t *d = p + sizeof(hdr) + hdr.columns * sizeof(tlogColumn);
+        tlogColumn *col = (tlogColumn *) (p + sizeof(hdr));
+
+        memcpy(p, &hdr, sizeof(hdr));
+        for (int i = 0; i < SIG_COUNT; i++)
+        {
+            const tlogEncoder *c = &t->col[i];
+            if (c->count == 0)
+                continue;
+            tlogColumn ch = { .signal = i, .count = c->count, .min = c->min, .max = c->max, .bytes = c->len };
+            memcpy(col++, &ch, sizeof(ch));
+            memcpy(d, c->data, c->len);
+            d += c->len;
+        }
+        log_writer_commit(t->w, t->stream, sizeof(hdr) + len);
+        t->chunks++;
+        t->bytes += sizeof(hdr) + len;
+
+        // where the chunk went, for the queries - a lost entry is put back at the next open
+        if (t->index_stream >= 0)
+        {
+            t->index_last_us = (hdr.last_us > t->index_last_us) ? hdr.last_us : t->index_last_us;
+            tlogIndexEntry e = { .offset = offset, .first_us = hdr.first_us, .last_us = t->index_last_us };
+            log_writer_write(t->w, t->index_stream, &e, sizeof(e));
+        }
+    }
+    else
+        t->dropped_chunks++;
+
+    for (int i = 0; i < SIG_COUNT; i++)
+    {
+        t->col[i].count = 0;
+        t->col[i].len = 0;
+    }
+    t->chunk_first_us = 0;
+}
+
+void tlog_report(const tlogWriter *t, FILE *fp)
+{
+    fprintf(fp, "telemetry log: %llu samples in %llu chunks, %llu kB (%.2f bytes a sample), %llu chunks dropped\n",
+            (unsigned long long) t->samples, (unsigned long long) t->chunks, (unsigned long long) (t->bytes / 1024),
+            t->samples ? (double) t->bytes / (double) t->samples : 0.0, (unsigned long long) t->dropped_chunks);
+}
+
+void tlog_close(tlogWriter *t)
+{
+    if (t->stream < 0)
+        return;
+    tlog_flush(t);
+    t->stream = -1;
+}
+
+/*-------------------------------------------------------------*/
+// reader
+
+// index of the log if there is one that belongs to it, entries past the end of the log left out
+static void open_index(tlogReader *r, const char *path)
+{
+    char idx_path[512];
+    struct stat st;
+    tlogIndexHeader hdr;
+    tlogChunk c;
+
+    r->tail_off = r->data_off;
+    snprintf(idx_path, sizeof(idx_path), "%s%s", path, TLOG_INDEX_SUFFIX);
+    int fd = open(idx_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size <= sizeof(hdr)) {
+        close(fd);
+        return;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return;
+
+    memcpy(&hdr, p, sizeof(hdr));
+    if (memcmp(hdr.magic, TLOG_INDEX_MAGIC, sizeof(hdr.magic)) != 0 || hdr.version != TLOG_VERSION
+        || hdr.entry_size != sizeof(tlogIndexEntry) || hdr.start_us != r->start_us) {
+        munmap(p, st.st_size);
+        return;
+    }
+
+    // the index can be written ahead of the log it points into
+    const tlogIndexEntry *e = (const tlogIndexEntry *) ((const uint8_t *) p + sizeof(hdr));
+    size_t n = (st.st_size - sizeof(hdr)) / sizeof(tlogIndexEntry);
+    while (n > 0)
+    {
+        size_t off = e[n - 1].offset;
+        if (off >= r->data_off && off + sizeof(c) <= r->map_size)
+        {
+            memcpy(&c, r->map + off, sizeof(c));
+            if (c.magic == TLOG_CHUNK_MAGIC && off + sizeof(c) + c.len <= r->map_size)
+                break;
+        }
+        n--;
+    }
+    // a later run can start before an earlier one ended, so queries need the earliest
+    // start still to come from every entry on
+    uint64_t *first = (n > 0) ? malloc(n * sizeof(uint64_t)) : NULL;
+    if (first == NULL) {
+        munmap(p, st.st_size);
+        return;
+    }
+    first[n - 1] = e[n - 1].first_us;
+    for (size_t i = n - 1; i > 0; i--)
+        first[i - 1] = (e[i - 1].first_us < first[i]) ? e[i - 1].first_us : first[i];
+
+    r->idx_first = first;
+    r->idx_map = p;
+    r->idx_map_size = st.st_size;
+    r->idx = e;
+    r->idx_count = n;
+    r->tail_off = e[n - 1].offset + sizeof(c) + c.len;
+}
+
+int tlog_read_open(tlogReader *r, const char *path)
+{
+    struct stat st;
+    tlogHeader hdr;
+
+    memset(r, 0, sizeof(*r));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(hdr)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+
+    memcpy(&hdr, p, sizeof(hdr));
+    if (memcmp(hdr.magic, TLOG_MAGIC, sizeof(hdr.magic)) != 0 || hdr.version != TLOG_VERSION
+        || sizeof(hdr) + (size_t) hdr.schema_len > (size_t) st.st_size || hdr.signals == 0)
+        goto bad;
+
+    r->map = p;
+    r->map_size = st.st_size;
+    r->data_off = sizeof(hdr) + hdr.schema_len;
+    r->start_us = hdr.start_us;
+    r->signals = hdr.signals;
+    r->sig = calloc(hdr.signals, sizeof(tlogSignal));
+    if (r->sig == NULL)
+        goto bad;
+
+    // "name,unit,scale,offset\n" per signal
+    const char *s = (const char *) p + sizeof(hdr);
+    const char *end = s + hdr.schema_len;
+    for (int i = 0; i < r->signals; i++)
+    {
+        tlogSignal *g = &r->sig[i];
+        const char *nl = memchr(s, '\n', end - s);
+        char line[sizeof(g->name) + sizeof(g->unit) + 64];
+        if (nl == NULL || (size_t) (nl - s) >= sizeof(line))
+            goto bad;
+        memcpy(line, s, nl - s);
+        line[nl - s] = '\0';
+        s = nl + 1;
+
+        char *name = line, *unit = strchr(name, ',');
+        char *scale = unit ? strchr(unit + 1, ',') : NULL;
+        char *offset = scale ? strchr(scale + 1, ',') : NULL;
+        if (offset == NULL || unit - name >= (long) sizeof(g->name) || scale - unit > (long) sizeof(g->unit))
+            goto bad;
+        // lengths checked above, sig[] comes zeroed
+        memcpy(g->name, name, unit - name);
+        memcpy(g->unit, unit + 1, scale - unit - 1);
+        *scale++ = *offset++ = '\0';
+
+        g->scale = strtod(scale, NULL);
+        g->offset = strtod(offset, NULL);
+        g->decimals = (g->scale > 0 && g->scale < 1) ? (int) ceil(-log10(g->scale) - 1e-9) : 0;
+    }
+
+    // reading front to back, tell the kernel to read ahead
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    open_index(r, path);
+    return 0;
+
+bad:
+    free(r->sig);
+    munmap(p, st.st_size);
+    memset(r, 0, sizeof(*r));
+    errno = EINVAL;
+    return -1;
+}
+
+void tlog_read_close(tlogReader *r)
+{
+    if (r->map != NULL)
+        munmap((void *) r->map, r->map_size);
+    if (r->idx_map != NULL)
+        munmap((void *) r->idx_map, r->idx_map_size);
+    free(r->idx_first);
+    free(r->sig);
+    memset(r, 0, sizeof(*r));
+}
+
+int tlog_find(const tlogReader *r, const char *name)
+{
+    for (int i = 0; i < r->signals; i++)
+    {
+        if (strcmp(r->sig[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// first index entry whose chunk, or one before it, reaches from_us - last_us never goes down
+static size_t seek_entry(const tlogReader *r, uint64_t from_us)
+{
+    size_t lo = 0, hi = r->idx_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (r->idx[mid].last_us < from_us)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+size_t tlog_seek(const tlogReader *r, uint64_t from_us)
+{
+    if (r->idx_count == 0)
+        return r->data_off;
+
+    size_t i = seek_entry(r, from_us);
+    return (i < r->idx_count) ? r->idx[i].offset : r->tail_off;
+}
+
+uint64_t tlog_first_us(const tlogReader *r)
+{
+    tlogChunkView c;
+    uint64_t first = UINT64_MAX;
+    size_t offset = r->data_off;
+
+    // the index knows its part, the chunks after it are walked
+    if (r->idx_count > 0) {
+        first = r->idx_first[0];
+        offset = r->tail_off;
+    }
+    while (tlog_next_chunk(r, &offset, &c))
+        first = (c.hdr.first_us < first) ? c.hdr.first_us : first;
+    return (first == UINT64_MAX) ? 0 : first;
+}
+
+int tlog_next_chunk(const tlogReader *r, size_t *offset, tlogChunkView *c)
+{
+    size_t off = *offset;
+
+    if (off + sizeof(tlogChunk) > r->map_size)
+        return 0;
+    memcpy(&c->hdr, r->map + off, sizeof(tlogChunk));
+
+    // a cut off chunk at the end (power loss) is as good as the end
+    size_t cols = (size_t) c->hdr.columns * sizeof(tlogColumn);
+    if (c->hdr.magic != TLOG_CHUNK_MAGIC || off + sizeof(tlogChunk) + c->hdr.len > r->map_size || cols > c->hdr.len)
+        return 0;
+
+    c->offset = off;
+    c->cols = (const tlogColumn *) (r->map + off + sizeof(tlogChunk));
+    c->data = r->map + off + sizeof(tlogChunk) + cols;
+    *offset = off + sizeof(tlogChunk) + c->hdr.len;
+    return 1;
+}
+
+uint32_t tlog_decode(const tlogChunkView *c, int i, uint64_t *time_us, int64_t *q, uint32_t max)
+{
+    tlogColumn col;
+    const uint8_t *p = c->data;
+    const uint8_t *chunk_end = c->data + (c->hdr.len - c->hdr.columns * sizeof(tlogColumn));
+
+    for (int k = 0; k < i; k++)
+    {
+        memcpy(&col, &c->cols[k], sizeof(col));
+        p += col.bytes;
+    }
+    memcpy(&col, &c->cols[i], sizeof(col));
+
+    const uint8_t *end = p + col.bytes;
+    if (end > chunk_end)
+        return 0;
+
+    uint64_t t = 0, v;
+    int64_t delta = 0, value = 0;
+    uint32_t n = 0;
+    while (n < col.count && n < max)
+    {
+        uint32_t a = get_varint(p, end, &v);
+        if (a == 0)
+            break;
+        p += a;
+        if (n == 0)
+            t = v;
+        else {
+            delta += unzigzag(v);
+            t += (uint64_t) delta;
+        }
+
+        uint32_t b = get_varint(p, end, &v);
+        if (b == 0)
+            break;
+        p += b;
+        value = (n == 0) ? unzigzag(v) : value + unzigzag(v);
+
+        time_us[n] = t;
+        q[n] = value;
+        n++;
+    }
+    return n;
+}
+
+// the samples of chunk c inside the window, merged by time - buffers of max samples per signal
+static void query_chunk(const tlogChunkView *c, uint64_t from_us, uint64_t to_us, const int *signals, int n,
+                        tlogSink sink, void *ctx, uint64_t *time_us, int64_t *q, uint32_t *count, uint32_t *at,
+                        uint32_t max)
+{
+    for (int k = 0; k < n; k++)
+        count[k] = at[k] = 0;
+    for (int i = 0; i < c->hdr.columns; i++)
+    {
+        tlogColumn col;
+        memcpy(&col, &c->cols[i], sizeof(col));
+        for (int k = 0; k < n; k++)
+        {
+            if (signals[k] == col.signal)
+                count[k] = tlog_decode(c, i, time_us + (size_t) k * max, q + (size_t) k * max, max);
+        }
+    }
+
+    // merged by time, the window cut out
+    for (;;)
+    {
+        int best = -1;
+        for (int k = 0; k < n; k++)
+        {
+            if (at[k] < count[k]
+                && (best < 0 || time_us[(size_t) k * max + at[k]] < time_us[(size_t) best * max + at[best]]))
+                best = k;
+        }
+        if (best < 0)
+            break;
+
+        size_t j = (size_t) best * max + at[best]++;
+        if (time_us[j] >= from_us && time_us[j] <= to_us)
+            sink(signals[best], time_us[j], q[j], ctx);
+    }
+}
+
+long tlog_query(const tlogReader *r, uint64_t from_us, uint64_t to_us, const int *signals, int n,
+                tlogSink sink, void *ctx)
+{
+    const uint32_t max = TLOG_COL_BYTES / 2;        // a sample takes at least two bytes
+    long chunks = 0;
+    tlogChunkView c;
+
+    // one column buffer per signal asked for, for the length of the query
+    uint64_t *time_us = malloc((size_t) n * max * sizeof(uint64_t));
+    int64_t *q = malloc((size_t) n * max * sizeof(int64_t));
+    uint32_t *count = calloc(n, sizeof(uint32_t));
+    uint32_t *at = calloc(n, sizeof(uint32_t));
+    if (time_us == NULL || q == NULL || count == NULL || at == NULL) {
+        chunks = -1;
+        goto done;
+    }
+
+    // indexed chunks from the seek point until none still to come starts inside the window -
+    // a run appended with an earlier clock keeps the walk going
+    size_t offset = r->data_off;
+    if (r->idx_count > 0)
+    {
+        for (size_t i = seek_entry(r, from_us); i < r->idx_count && r->idx_first[i] <= to_us; i++)
+        {
+            offset = r->idx[i].offset;
+            if (!tlog_next_chunk(r, &offset, &c))
+                break;
+            if (c.hdr.last_us < from_us || c.hdr.first_us > to_us)
+                continue;
+            chunks++;
+            query_chunk(&c, from_us, to_us, signals, n, sink, ctx, time_us, q, count, at, max);
+        }
+        offset = r->tail_off;
+    }
+
+    // chunks the index does not know, or all of them without one
+    while (tlog_next_chunk(r, &offset, &c))
+    {
+        if (c.hdr.last_us < from_us || c.hdr.first_us > to_us)
+            continue;
+        chunks++;
+        query_chunk(&c, from_us, to_us, signals, n, sink, ctx, time_us, q, count, at, max);
+    }
+
+done:
+    free(time_us);
+    free(q);
+    free(count);
+    free(at);
+    return chunks;
+}
@@ -0,0 +1,205 @@
+#ifndef TELEMETRY_LOG_H
+#define TELEMETRY_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "Signal_Store.h"
+#include "Log_Writer.h"
+
+// Compressed columnar telemetry log
+//   file header:   tlogHeader, then schema_len bytes of schema text, one line per signal:
+//                  "name,unit,scale,offset\n" - sample values are integers, value = q * scale + offset
+//   chunks:        tlogChunk, columns tlogColumn for every signal with samples, then the
+//                  column data in the same order - a chunk covers at most TLOG_CHUNK_MS of samples
+//   column data:   per sample two varints - timestamp (us) and value
+//                  first sample: time as it is, value zigzag
+//                  then:         zigzag(time delta - previous time delta, 0 for the second
+//                                sample), zigzag(value - previous value)
+// Everything little endian. A chunk cut short by a power loss is ignored by the reader.
+//
+// Time index, path + ".idx"
+//   tlogIndexHeader, then one tlogIndexEntry per chunk in file order - appended as chunks are
+//   written and rebuilt from the chunk headers when the log is opened again if it is off
+//
+// Chunks are in time order within a run, but not across runs appended to the same file: the
+// Pi has no clock of its own and can start a run earlier than the last one ended. Readers do
+// not count on file order past what the index says.
+#define TLOG_MAGIC          "EDASTLG1"
+#define TLOG_VERSION        1
+#define TLOG_CHUNK_MAGIC    0x4B484354u         // "TCHK"
+
+// bytes of encoded samples a column holds before the chunk is written - the largest
+// chunk then still fits one log writer block (a _Static_assert in Telemetry_Log.c checks it)
+#define TLOG_COL_BYTES      1536
+#define TLOG_CHUNK_MS       10000
+
+// a sample never takes more than this: two 64 bit varints
+#define TLOG_SAMPLE_MAX     20
+
+#define TLOG_INDEX_MAGIC    "EDASTIX1"
+#define TLOG_INDEX_SUFFIX   ".idx"
+
+typedef struct tlogHeader {
+    char magic[8];
+    uint16_t version;
+    uint16_t signals;               // schema lines, column index = line number
+    uint32_t schema_len;
+    uint64_t start_us;              // wall clock when the file was created
+    uint64_t reserved;
+} tlogHeader;
+
+typedef struct tlogChunk {
+    uint32_t magic;                 // TLOG_CHUNK_MAGIC
+    uint32_t len;                   // bytes after this header
+    uint64_t first_us;              // earliest and latest sample in the chunk
+    uint64_t last_us;
+    uint16_t columns;
+    uint16_t reserved;
+    uint32_t samples;
+} tlogChunk;
+
+typedef struct tlogColumn {
+    uint16_t signal;
+    uint16_t reserved;
+    uint32_t count;
+    int64_t min;                    // smallest and largest value (integer units)
+    int64_t max;
+    uint32_t bytes;                 // column data length
+    uint32_t reserved2;
+} tlogColumn;
+
+typedef struct tlogIndexHeader {
+    char magic[8];
+    uint16_t version;               // TLOG_VERSION
+    uint16_t reserved;
+    uint32_t entry_size;            // sizeof(tlogIndexEntry)
+    uint64_t start_us;              // start_us of the log it belongs to
+    uint64_t reserved2;
+} tlogIndexHeader;
+
+typedef struct tlogIndexEntry {
+    uint64_t offset;                // of the chunk header in the log
+    uint64_t first_us;              // earliest sample of the chunk
+    uint64_t last_us;               // latest sample of this chunk and every one before it, never goes down
+} tlogIndexEntry;
+
+// one column being encoded
+typedef struct tlogEncoder {
+    uint64_t seen_ns;               // store time of the last sample taken
+    uint64_t last_us;
+    int64_t last_delta;
+    int64_t last_value;
+    uint64_t first_us;
+    uint32_t count;
+    int64_t min, max;
+    uint32_t len;
+    uint8_t data[TLOG_COL_BYTES];
+} tlogEncoder;
+
+// writer side - samples are encoded as they come, a full chunk goes to the log writer
+typedef struct tlogWriter {
+    logWriter *w;
+    int stream;                     // -1 = not open
+    double scale[SIG_COUNT];        // as written in the schema, so both sides round the same
+    tlogEncoder col[SIG_COUNT];
+    uint64_t chunk_first_us;        // first sample of the chunk being built, 0 = empty
+    int index_stream;               // -1 = no index
+    uint64_t index_last_us;         // last_us of the latest index entry
+    char index_path[256];           // the log writer keeps the pointer
+
+    uint64_t samples;
+    uint64_t chunks;
+    uint64_t bytes;                 // written into the log, headers included
+    uint64_t dropped_chunks;        // refused by the log writer
+} tlogWriter;
+
+// schema of a file being read, from its header
+typedef struct tlogSignal {
+    char name[32];
+    char unit[16];
+    double scale;
+    double offset;
+    int decimals;                   // digits after the point the scale gives
+} tlogSignal;
+
+// reader side - whole file mapped read-only
+typedef struct tlogReader {
+    const uint8_t *map;
+    size_t map_size;
+    size_t data_off;                // first chunk
+    uint64_t start_us;
+    int signals;
+    tlogSignal *sig;
+
+    // time index, idx_count = 0 without one - chunks from tail_off on are not in it
+    const uint8_t *idx_map;
+    size_t idx_map_size;
+    const tlogIndexEntry *idx;
+    size_t idx_count;
+    size_t tail_off;
+    uint64_t *idx_first;            // earliest first_us of entry i and every one after it
+} tlogReader;
+
+// a chunk found in the file, pointers into the mapping
+typedef struct tlogChunkView {
+    tlogChunk hdr;
+    size_t offset;                  // of the chunk header in the file
+    const tlogColumn *cols;         // hdr.columns entries, may be unaligned - copy before use
+    const uint8_t *data;            // column data, first column first
+} tlogChunkView;
+
+// appends to path and its time index through w (started with log_writer_open()), writing the
+// headers if new - an existing file with another schema is refused (EINVAL)
+int tlog_open(tlogWriter *t, logWriter *w, const char *path);
+
+// one sample of signal at time_ns in integer units of its scale
+void tlog_sample(tlogWriter *t, int signal, uint64_t time_ns, int64_t q);
+
+// every signal of the store that changed since the last call - decoded signals keep their raw value
+// call from the thread writing the store, after every frame decoded so no sample is overwritten first
+void tlog_store(tlogWriter *t, const signalStore *store);
+
+// writes the chunk being built, called by itself when a column is full or the chunk long enough
+void tlog_flush(tlogWriter *t);
+
+void tlog_report(const tlogWriter *t, FILE *fp);
+void tlog_close(tlogWriter *t);
+
+// maps path, and its time index if there is one that belongs to it
+int tlog_read_open(tlogReader *r, const char *path);
+void tlog_read_close(tlogReader *r);
+
+// signal index by name, -1 if the file has none
+int tlog_find(const tlogReader *r, const char *name);
+
+// offset of the first chunk that can hold samples at from_us or later, O(log chunks) with the
+// index - chunks after it are not in time order when a later run started earlier
+size_t tlog_seek(const tlogReader *r, uint64_t from_us);
+
+// earliest sample of the log, 0 if it has no chunks
+uint64_t tlog_first_us(const tlogReader *r);
+
+// chunk at *offset (start with r->data_off or tlog_seek()), 1 if found and *offset moved past it, 0 at the end
+int tlog_next_chunk(const tlogReader *r, size_t *offset, tlogChunkView *c);
+
+// decodes column i of c into times (us) and values, up to max samples - returns how many
+uint32_t tlog_decode(const tlogChunkView *c, int i, uint64_t *time_us, int64_t *q, uint32_t max);
+
+// called for every sample of a query, in time order within a chunk
+typedef void (*tlogSink)(int signal, uint64_t time_us, int64_t q, void *ctx);
+
+// every sample of the n signals from from_us to to_us (both included), only the chunks the
+// window touches are decoded - returns how many, -1 if out of memory
+// with the index the walk ends once no later indexed chunk starts inside the window, without
+// one every chunk header is read
+long tlog_query(const tlogReader *r, uint64_t from_us, uint64_t to_us, const int *signals, int n,
+                tlogSink sink, void *ctx);
+
+// integer units -> value of signal s
+static inline double tlog_value(const tlogReader *r, int s, int64_t q)
+{
+    return (double) q * r->sig[s].scale + r->sig[s].offset;
+}
+
+#endif
@@ -0,0 +1,213 @@
+// Name: Tlog_Export
+// Description: Converting a telemetry log (Telemetry_Log.c) back to CSV for the spreadsheets
+
+// Works one chunk at a time, so memory use does not grow with the length of the session.
+// Wide output (default) has one row per distinct timestamp and one column per signal, empty
+// where that signal has no sample at that time; -l writes one "time_s,signal,value" row per
+// sample instead. Rows come out in time order within a chunk.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "Telemetry_Log.h"
+
+// a sample takes at least two bytes, so no column of a chunk holds more
+#define MAX_SAMPLES (TLOG_COL_BYTES / 2)
+#define MAX_SIGNALS 256
+
+typedef struct column {
+    int signal;
+    uint32_t n, at;
+    uint64_t time_us[MAX_SAMPLES];
+    int64_t q[MAX_SAMPLES];
+} column;
+
+static column cols[MAX_SIGNALS];
+static int selected[MAX_SIGNALS];       // output position of each signal in the file, -1 = left out
+static int order[MAX_SIGNALS];          // signal of each output position
+
+static void print_time(FILE *out, uint64_t us, uint64_t base)
+{
+    us -= base;
+    fprintf(out, "%llu.%06llu", (unsigned long long) (us / 1000000), (unsigned long long) (us % 1000000));
+}
+
+int main(int argc, char *argv[])
+{
+    const char *only = NULL;
+    int longForm = 0;
+    int relative = 0;
+    int opt;
+    tlogReader r;
+
+    while ((opt = getopt(argc, argv, "s:lr")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': only = optarg; break;
+            case 'l': longForm = 1; break;
+            case 'r': relative = 1; break;
+            default:
+                printf("usage: %s [-s signal,signal,...] [-l] [-r] session.tlg [out.csv]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        printf("usage: %s [-s signal,signal,...] [-l] [-r] session.tlg [out.csv]\n", argv[0]);
+        return 1;
+    }
+
+    if (tlog_read_open(&r, argv[optind]) < 0)
+    {
+        printf("could not open telemetry log %s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+    if (r.signals > MAX_SIGNALS)
+    {
+        printf("%s has %d signals, at most %d supported\n", argv[optind], r.signals, MAX_SIGNALS);
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (optind + 1 < argc && (out = fopen(argv[optind + 1], "w")) == NULL)
+    {
+        printf("could not create %s: %s\n", argv[optind + 1], strerror(errno));
+        return 1;
+    }
+
+    // every signal in file order, or the ones asked for in that order
+    int nOut = 0;
+    for (int i = 0; i < r.signals; i++)
+        selected[i] = -1;
+    if (only == NULL)
+    {
+        for (int i = 0; i < r.signals; i++)
+        {
+            selected[i] = nOut;
+            order[nOut++] = i;
+        }
+    }
+    else
+    {
+        char names[1024];
+        snprintf(names, sizeof(names), "%s", only);
+        for (char *name = strtok(names, ","); name != NULL; name = strtok(NULL, ","))
+        {
+            int s = tlog_find(&r, name);
+            if (s < 0)
+            {
+                printf("%s has no signal %s\n", argv[optind], name);
+                return 1;
+            }
+            if (selected[s] < 0)
+            {
+                selected[s] = nOut;
+                order[nOut++] = s;
+            }
+        }
+    }
+
+    if (longForm)
+        fprintf(out, "time_s,signal,value\n");
+    else
+    {
+        fprintf(out, "time_s");
+        for (int k = 0; k < nOut; k++)
+            fprintf(out, ",%s", r.sig[order[k]].name);
+        fprintf(out, "\n");
+    }
+
+    size_t offset = r.data_off;
+    tlogChunkView c;
+    uint64_t base = 0;
+    uint64_t rows = 0, samples = 0, chunks = 0;
+
+    while (tlog_next_chunk(&r, &offset, &c))
+    {
+        int nCols = 0;
+
+        chunks++;
+        if (relative && base == 0)
+            base = c.hdr.first_us;
+
+        for (int i = 0; i < c.hdr.columns; i++)
+        {
+            tlogColumn ch;
+            memcpy(&ch, &c.cols[i], sizeof(ch));
+            if (ch.signal >= r.signals || selected[ch.signal] < 0)
+                continue;
+
+            column *col = &cols[nCols++];
+            col->signal = ch.signal;
+            col->n = tlog_decode(&c, i, col->time_us, col->q, MAX_SAMPLES);
+            col->at = 0;
+            samples += col->n;
+        }
+
+        // merging the columns by time
+        for (;;)
+        {
+            uint64_t t = UINT64_MAX;
+            for (int k = 0; k < nCols; k++)
+            {
+                if (cols[k].at < cols[k].n && cols[k].time_us[cols[k].at] < t)
+                    t = cols[k].time_us[cols[k].at];
+            }
+            if (t == UINT64_MAX)
+                break;
+
+            if (longForm)
+            {
+                for (int k = 0; k < nCols; k++)
+                {
+                    column *col = &cols[k];
+                    if (col->at < col->n && col->time_us[col->at] == t)
+                    {
+                        const tlogSignal *g = &r.sig[col->signal];
+                        print_time(out, t, base);
+                        fprintf(out, ",%s,%.*f\n", g->name, g->decimals, tlog_value(&r, col->signal, col->q[col->at]));
+                        col->at++;
+                        rows++;
+                    }
+                }
+                continue;
+            }
+
+            // one row, each signal in its own place
+            const column *at[MAX_SIGNALS] = { NULL };
+            for (int k = 0; k < nCols; k++)
+            {
+                if (cols[k].at < cols[k].n && cols[k].time_us[cols[k].at] == t)
+                    at[selected[cols[k].signal]] = &cols[k];
+            }
+            print_time(out, t, base);
+            for (int k = 0; k < nOut; k++)
+            {
+                if (at[k] == NULL)
+                    fputc(',', out);
+                else
+                    fprintf(out, ",%.*f", r.sig[order[k]].decimals, tlog_value(&r, order[k], at[k]->q[at[k]->at]));
+            }
+            fputc('\n', out);
+            for (int k = 0; k < nCols; k++)
+            {
+                if (cols[k].at < cols[k].n && cols[k].time_us[cols[k].at] == t)
+                    cols[k].at++;
+            }
+            rows++;
+        }
+    }
+
+    if (out != stdout)
+    {
+        fclose(out);
+        printf("%llu chunks, %llu samples, %llu rows written to %s\n", (unsigned long long) chunks,
+               (unsigned long long) samples, (unsigned long long) rows, argv[optind + 1]);
+    }
+    tlog_read_close(&r);
+    return 0;
+}
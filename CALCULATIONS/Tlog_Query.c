@@ -0,0 +1,136 @@
+// Name: Tlog_Query
+// Description: A time window of some signals out of a telemetry log (Telemetry_Log.c) as CSV,
+//              without reading the rest of the session
+
+// The time index next to the log is binary searched for the first chunk that reaches the
+// window and only the chunks up to its end are decoded, so a window takes the same time in
+// a 10 minute log as in a 3 hour one, and a later run with an earlier clock is still found.
+// Without an index (older logs) every chunk header is walked instead. Times are seconds from the first sample of the log, or
+// seconds since 1970 with -A. Rows are "time_s,signal,value" as from tlog2csv -l.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "Telemetry_Log.h"
+
+#define MAX_SIGNALS 256
+
+typedef struct queryOut {
+    FILE *out;
+    const tlogReader *r;
+    uint64_t base;
+    uint64_t rows;
+} queryOut;
+
+static void print_row(int signal, uint64_t time_us, int64_t q, void *ctx)
+{
+    queryOut *o = ctx;
+    const tlogSignal *g = &o->r->sig[signal];
+    uint64_t us = time_us - o->base;
+
+    fprintf(o->out, "%llu.%06llu,%s,%.*f\n", (unsigned long long) (us / 1000000), (unsigned long long) (us % 1000000),
+            g->name, g->decimals, tlog_value(o->r, signal, q));
+    o->rows++;
+}
+
+// seconds as given -> microseconds, without going through a double for long absolute times
+static uint64_t parse_us(const char *s)
+{
+    char *end;
+    uint64_t us = strtoull(s, &end, 10) * 1000000ull;
+    if (*end == '.')
+    {
+        uint64_t scale = 100000;
+        for (end++; *end >= '0' && *end <= '9' && scale > 0; end++, scale /= 10)
+            us += (uint64_t) (*end - '0') * scale;
+    }
+    return us;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *only = NULL;
+    int absolute = 0;
+    int opt;
+    tlogReader r;
+    static int signals[MAX_SIGNALS];
+
+    while ((opt = getopt(argc, argv, "s:A")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': only = optarg; break;
+            case 'A': absolute = 1; break;
+            default:
+                printf("usage: %s [-s signal,signal,...] [-A] session.tlg from_s to_s [out.csv]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind + 3 > argc)
+    {
+        printf("usage: %s [-s signal,signal,...] [-A] session.tlg from_s to_s [out.csv]\n", argv[0]);
+        return 1;
+    }
+
+    uint64_t t0 = mono_ns();
+    if (tlog_read_open(&r, argv[optind]) < 0)
+    {
+        printf("could not open telemetry log %s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    // every signal, or the ones asked for in that order
+    int n = 0;
+    if (only == NULL)
+    {
+        for (int i = 0; i < r.signals && n < MAX_SIGNALS; i++)
+            signals[n++] = i;
+    }
+    else
+    {
+        char names[1024];
+        snprintf(names, sizeof(names), "%s", only);
+        for (char *name = strtok(names, ","); name != NULL && n < MAX_SIGNALS; name = strtok(NULL, ","))
+        {
+            int s = tlog_find(&r, name);
+            if (s < 0)
+            {
+                printf("%s has no signal %s\n", argv[optind], name);
+                return 1;
+            }
+            signals[n++] = s;
+        }
+    }
+
+    // the window in log time
+    uint64_t base = absolute ? 0 : tlog_first_us(&r);
+    uint64_t from = base + parse_us(argv[optind + 1]);
+    uint64_t to = base + parse_us(argv[optind + 2]);
+
+    queryOut o = { .out = stdout, .r = &r, .base = base };
+    if (optind + 3 < argc && (o.out = fopen(argv[optind + 3], "w")) == NULL)
+    {
+        printf("could not create %s: %s\n", argv[optind + 3], strerror(errno));
+        return 1;
+    }
+
+    fprintf(o.out, "time_s,signal,value\n");
+    long chunks = tlog_query(&r, from, to, signals, n, print_row, &o);
+    if (chunks < 0)
+    {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    FILE *info = (o.out == stdout) ? stderr : stdout;
+    if (o.out != stdout)
+        fclose(o.out);
+    fprintf(info, "%llu rows from %ld chunks (%s), %.3f ms\n", (unsigned long long) o.rows, chunks,
+            r.idx_count ? "indexed" : "no index, walked from the start", (double) (mono_ns() - t0) * 1e-6);
+    tlog_read_close(&r);
+    return 0;
+}
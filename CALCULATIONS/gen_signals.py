@@ -0,0 +1,397 @@
+#!/usr/bin/env python3
+# Name: gen_signals
+# Description: Turns the signal description (signals.dbc) into the C tables the programs use
+
+# Signal_Defs.h / .c   signalId enum, raw scales and the signal schema (name, unit, GUI format)
+#                      - the GUI links these, nothing CAN in them
+# CAN_Defs.h / .c      CAN IDs, field tables and one straight line decoder per received message
+#
+# Only the part of DBC this car uses is read: BO_, SG_ (byte aligned, 1 - 4 bytes, no
+# multiplexing), CM_ and the GuiFormat string attribute. Messages sent by EDAS are the transmit
+# tables, signals of VECTOR__INDEPENDENT_SIG_MSG are the calculated ones.
+#
+#   python3 gen_signals.py [signals.dbc] [output folder]
+# ----------------------------------------------------------------------------
+import os
+import re
+import sys
+
+OWN_NODE = "EDAS"
+INDEPENDENT_ID = 0xC0000000
+EXT_FLAG = 0x80000000
+
+BO_RE = re.compile(r'^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)\s+(\w+)')
+SG_RE = re.compile(r'^SG_\s+(\w+)\s*(M|m\d+)?\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*'
+                   r'\(([^,]+),([^)]+)\)\s*\[([^|]*)\|([^\]]*)\]\s*"([^"]*)"\s*(.*)$')
+CM_SG_RE = re.compile(r'^CM_\s+SG_\s+(\d+)\s+(\w+)\s+"((?:[^"\\]|\\.)*)"\s*;')
+CM_BO_RE = re.compile(r'^CM_\s+BO_\s+(\d+)\s+"((?:[^"\\]|\\.)*)"\s*;')
+BA_SG_RE = re.compile(r'^BA_\s+"(\w+)"\s+SG_\s+(\d+)\s+(\w+)\s+"((?:[^"\\]|\\.)*)"\s*;')
+BA_DEF_DEF_RE = re.compile(r'^BA_DEF_DEF_\s+"(\w+)"\s+"((?:[^"\\]|\\.)*)"\s*;')
+
+
+class DbcError(Exception):
+    pass
+
+
+class Signal:
+    def __init__(self, name, start, length, intel, signed, scale, offset, unit):
+        self.name = name
+        self.start = start
+        self.length = length
+        self.intel = intel
+        self.signed = signed
+        self.scale = scale
+        self.offset = offset
+        self.unit = unit
+        self.comment = ""
+        self.gui_format = None
+
+    @property
+    def byte(self):
+        # first byte in the payload - Motorola start bit is the MSB of the first byte
+        return self.start // 8
+
+    @property
+    def width(self):
+        return self.length // 8
+
+
+class Message:
+    def __init__(self, raw_id, name, dlc, sender):
+        self.extended = bool(raw_id & EXT_FLAG) and raw_id != INDEPENDENT_ID
+        self.id = raw_id & 0x1FFFFFFF if self.extended else raw_id
+        self.raw_id = raw_id
+        self.name = name
+        self.dlc = dlc
+        self.sender = sender
+        self.signals = []
+        self.comment = ""
+
+    @property
+    def independent(self):
+        return self.raw_id == INDEPENDENT_ID
+
+    @property
+    def needed(self):
+        # bytes the frame must carry for every field to be read without checks
+        return max((s.byte + s.width for s in self.signals), default=0)
+
+
+def parse(path):
+    messages = []
+    by_id = {}
+    gui_default = "%.4g"
+    current = None
+
+    with open(path, encoding="utf-8") as fp:
+        for lineno, line in enumerate(fp, 1):
+            text = line.strip()
+            where = "%s:%d" % (path, lineno)
+
+            m = BO_RE.match(text)
+            if m:
+                current = Message(int(m.group(1)), m.group(2), int(m.group(3)), m.group(4))
+                if current.raw_id in by_id:
+                    raise DbcError("%s: message ID %d twice" % (where, current.raw_id))
+                messages.append(current)
+                by_id[current.raw_id] = current
+                continue
+
+            if text.startswith("SG_"):
+                m = SG_RE.match(text)
+                if m is None or current is None:
+                    raise DbcError("%s: cannot read signal" % where)
+                if m.group(2):
+                    raise DbcError("%s: multiplexed signals are not supported" % where)
+                sig = Signal(m.group(1), int(m.group(3)), int(m.group(4)), m.group(5) == "1",
+                             m.group(6) == "-", float(m.group(7)), float(m.group(8)), m.group(11))
+                if not current.independent:
+                    check_layout(sig, current, where)
+                if any(s.name == sig.name for s in current.signals):
+                    raise DbcError("%s: %s twice in %s" % (where, sig.name, current.name))
+                current.signals.append(sig)
+                continue
+
+            if text == "":
+                current = None
+                continue
+
+            m = CM_SG_RE.match(text)
+            if m:
+                find_signal(by_id, int(m.group(1)), m.group(2), where).comment = m.group(3)
+                continue
+            m = CM_BO_RE.match(text)
+            if m:
+                if int(m.group(1)) not in by_id:
+                    raise DbcError("%s: comment for unknown message %s" % (where, m.group(1)))
+                by_id[int(m.group(1))].comment = m.group(2)
+                continue
+            m = BA_DEF_DEF_RE.match(text)
+            if m and m.group(1) == "GuiFormat":
+                gui_default = m.group(2)
+                continue
+            m = BA_SG_RE.match(text)
+            if m and m.group(1) == "GuiFormat":
+                find_signal(by_id, int(m.group(2)), m.group(3), where).gui_format = m.group(4)
+                continue
+
+    return messages, gui_default
+
+
+def check_layout(sig, msg, where):
+    if sig.length not in (8, 16, 24, 32):
+        raise DbcError("%s: %s is %d bits, only 1 - 4 whole bytes are supported" % (where, sig.name, sig.length))
+    if (sig.intel and sig.start % 8 != 0) or (not sig.intel and sig.start % 8 != 7):
+        raise DbcError("%s: %s does not start on a byte" % (where, sig.name))
+    if sig.byte + sig.width > 64:
+        raise DbcError("%s: %s is past the end of a CAN FD frame" % (where, sig.name))
+    if msg.dlc and sig.byte + sig.width > msg.dlc:
+        raise DbcError("%s: %s is past the end of %s (%d bytes)" % (where, sig.name, msg.name, msg.dlc))
+    for other in msg.signals:
+        if sig.byte < other.byte + other.width and other.byte < sig.byte + sig.width:
+            raise DbcError("%s: %s overlaps %s" % (where, sig.name, other.name))
+
+
+def find_signal(by_id, raw_id, name, where):
+    for s in by_id.get(raw_id, Message(0, "", 0, "")).signals:
+        if s.name == name:
+            return s
+    raise DbcError("%s: unknown signal %s in message %d" % (where, name, raw_id))
+
+
+def float_lit(v):
+    text = repr(float(v))
+    if "e" not in text and "." not in text:
+        text += ".0"
+    return text + "f"
+
+
+def enum_name(name):
+    return "SIG_" + name.upper()
+
+
+def c_string(s):
+    return '"' + s.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def signal_list(messages):
+    # decoded signals first in file order, then the calculated ones
+    received = [m for m in messages if not m.independent and m.sender != OWN_NODE]
+    independent = [m for m in messages if m.independent]
+    seen = {}
+    for msg in received + independent:
+        for s in msg.signals:
+            if s.name in seen:
+                raise DbcError("signal %s is in %s and %s" % (s.name, seen[s.name][0].name, msg.name))
+            seen[s.name] = (msg, s)
+    sent = [m for m in messages if m.sender == OWN_NODE]
+    for msg in sent:
+        for s in msg.signals:
+            if s.name not in seen:
+                raise DbcError("%s sends %s, which is neither received nor calculated" % (msg.name, s.name))
+    return [seen[name] for name in seen], received, sent
+
+
+HEADER = "// Generated from %s by gen_signals.py - do not edit, change %s and run it again\n"
+
+
+def gen_signal_defs_h(src, signals):
+    out = [HEADER % (src, src), "#ifndef SIGNAL_DEFS_H\n#define SIGNAL_DEFS_H\n\n"]
+    out.append("// every signal the store holds, index into signalStore.sig\n")
+    out.append("typedef enum signalId {\n")
+    group = None
+    for i, (msg, s) in enumerate(signals):
+        g = "calculated" if msg.independent else "decoded from CAN"
+        if g != group:
+            out.append("%s    // %s\n" % ("\n" if group else "", g))
+            group = g
+        decl = "    %s%s," % (enum_name(s.name), " = 0" if i == 0 else "")
+        comment = ", ".join(c for c in (s.comment, s.unit) if c)
+        out.append(decl + (" " * max(1, 32 - len(decl)) + "// " + comment if comment else "") + "\n")
+    out.append("\n    SIG_COUNT\n} signalId;\n\n")
+
+    out.append("// raw bus value -> value in real units of the decoded signals, value = raw * SCALE + OFFSET\n")
+    out.append("// _DIV is 1 / SCALE where that is a whole number, for fixed point on the raw values\n")
+    for msg, s in signals:
+        if msg.independent:
+            continue
+        out.append("#define %-24s %r\n" % (enum_name(s.name) + "_SCALE", s.scale))
+        if s.offset != 0:
+            out.append("#define %-24s %r\n" % (enum_name(s.name) + "_OFFSET", s.offset))
+        inv = 1.0 / s.scale if s.scale else 0
+        if s.scale < 1 and abs(inv - round(inv)) < 1e-9:
+            out.append("#define %-24s %d\n" % (enum_name(s.name) + "_DIV", round(inv)))
+    out.append("\n")
+
+    out.append("// what the description says about a signal - log column schema and GUI bindings\n")
+    out.append("typedef struct signalInfo {\n")
+    out.append("    const char *name;           // short name, also the log column\n")
+    out.append("    const char *unit;           // \"\" if it has none\n")
+    out.append("    const char *format;         // printf format of the value on the GUI\n")
+    out.append("    float scale;                // raw -> value when decoded, log resolution when calculated\n")
+    out.append("    float offset;\n")
+    out.append("    unsigned char decoded;      // 1 = comes from the bus, 0 = calculated\n")
+    out.append("} signalInfo;\n\n")
+    out.append("extern const signalInfo signalInfos[SIG_COUNT];\n\n#endif\n")
+    return "".join(out)
+
+
+def gen_signal_defs_c(src, signals, gui_default):
+    out = [HEADER % (src, src), "#include \"Signal_Defs.h\"\n\n"]
+    out.append("const signalInfo signalInfos[SIG_COUNT] = {\n")
+    for msg, s in signals:
+        fmt = s.gui_format if s.gui_format is not None else gui_default
+        out.append("    [%s] = { %s, %s, %s, %s, %s, %d },\n"
+                   % (enum_name(s.name), c_string(s.name), c_string(s.unit), c_string(fmt),
+                      float_lit(s.scale),
+                      float_lit(s.offset), 0 if msg.independent else 1))
+    out.append("};\n")
+    return "".join(out)
+
+
+def id_name(msg):
+    return "CAN_ID_" + msg.name
+
+
+def table_name(msg):
+    return msg.name.lower()
+
+
+def gen_can_defs_h(src, messages, received, sent):
+    out = [HEADER % (src, src), "// included by CAN_Sort.h\n#ifndef CAN_DEFS_H\n#define CAN_DEFS_H\n\n"]
+    for title, group in (("IDs received", received), ("IDs the results are published on (CAN_Transmit.c)", sent)):
+        out.append("// %s\n" % title)
+        for msg in group:
+            comment = "// 29 bit ID" if msg.extended else ""
+            line = "#define %-28s 0x%03X" % (id_name(msg), msg.id)
+            out.append(line + ("       " + comment if comment else "") + "\n")
+        out.append("\n")
+    out.append("// every received message, decoded or only counted\n")
+    out.append("#define CAN_RX_MESSAGES %d\n" % len(received))
+    out.append("extern const canMessageDef CAN_rx_messages[CAN_RX_MESSAGES];\n\n")
+    out.append("// field tables of the messages EDAS sends, for CAN_Transmit.c\n")
+    for msg in sent:
+        out.append("extern const canMessage CAN_msg_%s;\n" % table_name(msg))
+    out.append("\n#endif\n")
+    return "".join(out)
+
+
+def load_expr(s):
+    p = "d + %d" % s.byte if s.byte else "d"
+    kind = "le" if s.intel else "be"
+    return "CAN_get_%s%d(%s)" % (kind, s.length, p)
+
+
+def value_expr(s):
+    raw = s.name
+    if s.signed:
+        shift = 32 - s.length
+        v = "(float) ((int32_t) %s)" % raw if shift == 0 else "(float) ((int32_t) (%s << %d) >> %d)" % (raw, shift, shift)
+    else:
+        v = "(float) %s" % raw
+    if s.scale != 1.0:
+        v += " * " + float_lit(s.scale)
+    if s.offset != 0.0:
+        v += " + " + float_lit(s.offset)
+    return v
+
+
+def gen_can_defs_c(src, signals, received, sent):
+    out = [HEADER % (src, src)]
+    out.append("// Every field of a message is read at a fixed offset with a fixed width, so each decoder is\n")
+    out.append("// straight line code with one length check; a frame too short for all of them goes through\n")
+    out.append("// the table driven CAN_decode_message() like any other registered message.\n")
+    out.append("#include <stddef.h>\n#include <stdint.h>\n#include \"CAN_Sort.h\"\n\n")
+
+    for msg in received + sent:
+        if not msg.signals:
+            continue
+        out.append("static const canField %s_fields[] = {\n" % table_name(msg))
+        for s in msg.signals:
+            flags = []
+            if s.signed:
+                flags.append("CAN_FIELD_SIGNED")
+            if not s.intel:
+                flags.append("CAN_FIELD_BIG_ENDIAN")
+            out.append("    { %s, %d, %d, %s, %s, %s },\n"
+                       % (enum_name(s.name), s.byte, s.width, " | ".join(flags) or "0",
+                          float_lit(s.scale), float_lit(s.offset)))
+        out.append("};\n")
+        out.append("%sconst canMessage %s%s = { %d, %s_fields };\n\n"
+                   % ("" if msg in sent else "static ", "CAN_msg_" if msg in sent else "",
+                      table_name(msg) + ("" if msg in sent else "_msg"), len(msg.signals), table_name(msg)))
+
+    for msg in received:
+        if not msg.signals:
+            continue
+        out.append("// 0x%03X %s%s\n" % (msg.id, msg.name, (" - " + msg.comment) if msg.comment else ""))
+        out.append("static void decode_%s(const canFrame *frame, void *ctx)\n{\n" % table_name(msg))
+        out.append("    const canBinding *b = ctx;\n")
+        out.append("    const uint8_t *d = frame->data;\n\n")
+        out.append("    if (frame->len < %d) {\n" % msg.needed)
+        out.append("        CAN_decode_message(frame, ctx);\n        return;\n    }\n")
+        out.append("    if (b->store->start_ns == 0)\n        b->store->start_ns = frame->time_ns;\n\n")
+        for s in msg.signals:
+            out.append("    uint32_t %s = %s;\n" % (s.name, load_expr(s)))
+        for s in msg.signals:
+            out.append("    signal_store_set(b->store, %s, %s, %s, frame->time_ns);\n"
+                       % (enum_name(s.name), s.name, value_expr(s)))
+        out.append("}\n\n")
+
+    out.append("const canMessageDef CAN_rx_messages[CAN_RX_MESSAGES] = {\n")
+    for msg in received:
+        if msg.signals:
+            out.append("    { %s, %d, %d, \"%s\", &%s_msg, decode_%s },\n"
+                       % (id_name(msg), int(msg.extended), msg.dlc, msg.name, table_name(msg), table_name(msg)))
+        else:
+            out.append("    { %s, %d, %d, \"%s\", NULL, NULL },\n"
+                       % (id_name(msg), int(msg.extended), msg.dlc, msg.name))
+    out.append("};\n")
+    return "".join(out)
+
+
+def write_if_changed(path, text):
+    try:
+        with open(path, encoding="utf-8") as fp:
+            if fp.read() == text:
+                return False
+    except FileNotFoundError:
+        pass
+    with open(path, "w", encoding="utf-8") as fp:
+        fp.write(text)
+    return True
+
+
+def main(argv):
+    here = os.path.dirname(os.path.abspath(__file__))
+    dbc = argv[1] if len(argv) > 1 else os.path.join(here, "signals.dbc")
+    outdir = argv[2] if len(argv) > 2 else os.path.dirname(os.path.abspath(dbc))
+    src = os.path.basename(dbc)
+
+    try:
+        messages, gui_default = parse(dbc)
+        signals, received, sent = signal_list(messages)
+    except (DbcError, OSError) as e:
+        print("gen_signals: %s" % e, file=sys.stderr)
+        return 1
+    if len(signals) > 255:
+        print("gen_signals: %d signals, canField holds at most 255" % len(signals), file=sys.stderr)
+        return 1
+
+    files = {
+        "Signal_Defs.h": gen_signal_defs_h(src, signals),
+        "Signal_Defs.c": gen_signal_defs_c(src, signals, gui_default),
+        "CAN_Defs.h": gen_can_defs_h(src, messages, received, sent),
+        "CAN_Defs.c": gen_can_defs_c(src, signals, received, sent),
+    }
+    for name, text in files.items():
+        if write_if_changed(os.path.join(outdir, name), text):
+            print("wrote %s" % name)
+
+    print("%d signals, %d received messages (%d decoded), %d sent"
+          % (len(signals), len(received), sum(1 for m in received if m.signals), len(sent)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -1,101 +1,525 @@
+#define _GNU_SOURCE            // recvmmsg() and struct mmsghdr used by CAN_Receive.h
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <gpiod.h>
 
 // Calling .C files with functions in it
-#include "Elec_Efficiency.h"
-#include "Fuel_Efficiency.h"
-#include "Fan_Control.h"
+#include "Calculate.h"
+#include "CAN_Sort.h"
+#include "CAN_Receive.h"
+#include "Frame_Ring.h"
+#include "CAN_Trace.h"
+#include "CAN_Stats.h"
+#include "CAN_Transmit.h"
+#include "Signal_Store.h"
 #include "typedefs.h"
 
 /***************************************************************/
 /*---------------Declaring variables by component--------------*/
 uint8_t ProgStarted = 0;
 
-// raw data temporary store
-uint32_t    mtr_volt, mtr_curr,                                 // MTR = motor
-            mtrV_time, mtrC_time,
-            fc_volt, fc_curr,                                   // FC = fuel cell
-            fcV_time, fcI_time,
-            fc_joules, fcE_time;                                // remaining amount of fuel in tank - unit joules
-uint32_t driver_temp, driver_humid;
-rData SpeedVal[2], fuelVal[2];
-
-// function to initialize values so calculation can start now
-void initializeSpeedVal() {
-    SpeedVal[0].time    = 0.0;
-    SpeedVal[1].time    = 0.0;
-    fuelVal[0].time     = 0.0;
-    fuelVal[1].time     = 0.0;
-
-    SpeedVal[0].value   = 0;
-    SpeedVal[1].value   = 0;
-    fuelVal[0].value    = 0;
-    fuelVal[1].value    = 0;
-
-    data_Fcnt = 0;
-    PreCal_FEff = 0;
+// latest decoded and calculated values - shared with the GUI
+signalStore *store;
+
+// CAN buses the data comes in on, all watched by one epoll loop
+canRx buses[CAN_MAX_BUSES];
+canMux mux = { .epfd = -1 };
+canFrame rxFrames[CAN_RX_BATCH];
+
+// frames handed from the CAN reader thread to the calculation thread
+frameRing rxRing;
+pthread_t canThread;
+
+// recording every frame to a trace file (-r) or replaying one instead of the bus (-p)
+canRecorder recorder = { .stream = -1 };
+canTrace replay;
+double replaySpeed = 1.0;
+
+// per-ID and per-bus statistics, counted by whichever thread feeds the ring
+canStats stats;
+int statsInterval = 0;          // seconds between reports (-s), 0 = only at exit
+
+// publishing results back onto the first bus (-t)
+canTx tx = { .sock = -1, .tfd = -1 };
+pthread_t txThread;
+int transmit = 0;
+
+// results published on the bus, laid out in signals.dbc (TX_* messages)
+// fan speed as soon as it changes and once a second, efficiencies every 100 ms half a period apart
+static const canTxMsg txTable[] = {
+    { CAN_ID_TX_FAN, 0, 8, CAN_TX_PERIODIC | CAN_TX_ON_CHANGE, 1000, 0, &CAN_msg_tx_fan },
+    { CAN_ID_TX_ELEC_EFF, 0, 8, CAN_TX_PERIODIC, 100, 0, &CAN_msg_tx_elec_eff },
+    { CAN_ID_TX_FUEL_EFF, 0, 8, CAN_TX_PERIODIC, 100, 50, &CAN_msg_tx_fuel_eff },
+};
+
+// settings from the GUI (fan setpoint)
+signalControl *control;
+
+// cabin fan loop thread, SCHED_FIFO at this priority with -R (0 = normal scheduling)
+pthread_t fanThread;
+int fanPriority = 0;
+
+// lap marker (-m): falling edge on a GPIO line when the car passes the beacon
+#define LAP_GPIO_CHIP "gpiochip0"
+struct gpiod_chip *lapChip;
+struct gpiod_line *lapLine;
+
+// CSV files: fsync policy (-F never / block / milliseconds) and waiting instead of dropping (-W)
+logFsync logSync = LOG_FSYNC_INTERVAL;
+uint32_t logSyncMs = LOG_WRITER_FSYNC_MS;
+logFull logFullPolicy = LOG_FULL_DROP;
+
+// telemetry log of every signal (-l session.tlg), appended to if it exists
+const char *tlogFile = NULL;
+
+// flight recorder file (-k file, -k none to go without), survives a crash or a power cut
+const char *flightFile = FREC_FILE;
+
+// set by SIGINT/SIGTERM to leave the main loop
+volatile sig_atomic_t keepRunning = 1;
+
+// keeping the kernel filters in step with the decoders, so frames nobody decodes never wake us up
+// IDs tracked by the statistics are let through as well
+// more IDs than filters goes to can_rx_set_filters as is, it lets everything through then
+static void updateFilters(void *ctx) {
+    canMux *m = ctx;
+    uint32_t ids[CAN_RX_MAX_FILTERS];
+
+    for (int b = 0; b < m->count; b++)
+    {
+        canRx *rx = m->rx[b];
+        int n = CAN_registered_ids(rx->bus, ids, CAN_RX_MAX_FILTERS);
+        if (n + stats.n_ids > CAN_RX_MAX_FILTERS)
+            n += stats.n_ids;
+        else
+            n += can_stats_ids(&stats, &ids[n], CAN_RX_MAX_FILTERS - n);
+
+        if (can_rx_set_filters(rx, ids, n) < 0)
+            printf("could not set CAN filters on %s: %s\n", rx->ifname, strerror(errno));
+    }
+}
+
+// CAN reader thread - only receives and queues, so a slow calculation never blocks the socket
+// one thread waits on every bus through epoll (can_mux_wait), a silent bus never holds up the others
+static void *canReader(void *arg) {
+    canMux *m = arg;
+    canFrame batch[CAN_RX_BATCH];
+
+    while (keepRunning)
+    {
+        int n = can_mux_wait(m, batch, CAN_RX_BATCH);
+        if (n < 0)
+        {
+            printf("CAN receive error: %s\n", strerror(errno));
+            keepRunning = 0;
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            can_stats_frame(&stats, &batch[i]);
+            frame_ring_push(&rxRing, &batch[i]);
+        }
+    }
+
+    return NULL;
+}
+
+// replayed frames go into the ring like received ones, waiting instead of dropping when it is full
+static void replayFrame(const canFrame *frame, void *ctx) {
+    frameRing *ring = ctx;
+    can_stats_frame(&stats, frame);
+    while (frame_ring_count(ring) >= FRAME_RING_SIZE && keepRunning)
+        sched_yield();
+    frame_ring_push(ring, frame);
+}
+
+// replay thread - stands in for the CAN reader when running from a trace
+static void *traceReader(void *arg) {
+    canTrace *trace = arg;
+    uint64_t n = can_trace_replay(trace, replaySpeed, replayFrame, &rxRing, &keepRunning);
+    printf("replayed %llu of %llu frames, %llu bad records skipped\n", (unsigned long long) (n - trace->bad),
+           (unsigned long long) trace->count, (unsigned long long) trace->bad);
+
+    // let the calculations finish what is queued, then stop
+    while (frame_ring_count(&rxRing) > 0 && keepRunning)
+        usleep(1000);
+    keepRunning = 0;
+    return NULL;
 }
 
-/*-------------------------------------------------------------*/
-// storing calculated data from program
-dataStruct Fuel_Eff, Elec_Eff;
-uint32_t fan_RPM;
-float PreCal_FEff = 0;
+// transmit thread - sleeps on the timerfd between ticks
+static void *canWriter(void *arg) {
+    can_tx_run(arg, &keepRunning);
+    return NULL;
+}
+
+// fan loop thread - sleeps on the timerfd between steps
+static void *fanRunner(void *arg) {
+    fan_loop_run(arg, &keepRunning);
+    return NULL;
+}
+
+// starting the fan loop at a real-time priority if asked, normal scheduling if that is not allowed
+static int startFanLoop(void) {
+    pthread_attr_t attr;
+    struct sched_param param = { .sched_priority = fanPriority };
+    int err;
+
+    if (fanPriority > 0)
+    {
+        pthread_attr_init(&attr);
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+        err = pthread_create(&fanThread, &attr, fanRunner, &fan);
+        pthread_attr_destroy(&attr);
+        if (err == 0)
+            return 0;
+        printf("could not run the fan loop at SCHED_FIFO %d (%s), using normal scheduling\n", fanPriority, strerror(err));
+    }
+
+    return pthread_create(&fanThread, NULL, fanRunner, &fan);
+}
 
-// for storing calculated running average values 
-float PreCal_FEff;
-float *inst_FEff;
-int data_Fcnt;
+// writing the fan loop timing histograms to FAN_LOOP_FILE
+static void writeFanLoop(void) {
+    FILE *fp = fopen(FAN_LOOP_FILE, "w");
+    if (fp == NULL)
+        return;
+    fan_loop_print_json(&fan, fp);
+    fclose(fp);
+}
 
-float PreCal_EEff;
-float inst_EEff;
-int data_Ecnt;
+// lap marker edges since the last pass, without waiting - stamped like frames (CLOCK_REALTIME)
+static void pollLapMarker(void) {
+    struct timespec zero = { 0, 0 };
+    struct gpiod_line_event event;
 
-// control when array filing happens -> for file storage
-#define array_Limit = 50;
+    while (gpiod_line_event_wait(lapLine, &zero) == 1 && gpiod_line_event_read(lapLine, &event) == 0)
+    {
+        // the edge as the kernel stamped it, not when this loop got round to it - on the
+        // sample clock (CLOCK_REALTIME), kernels from 5.7 on stamp it CLOCK_MONOTONIC
+        struct timespec real, mono;
+        clock_gettime(CLOCK_REALTIME, &real);
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+        int64_t edge = (int64_t) event.ts.tv_sec * 1000000000ll + event.ts.tv_nsec;
+        int64_t real_ns = (int64_t) real.tv_sec * 1000000000ll + real.tv_nsec;
+        int64_t mono_ns = (int64_t) mono.tv_sec * 1000000000ll + mono.tv_nsec;
+        if (llabs(mono_ns - edge) < llabs(real_ns - edge))
+            edge += real_ns - mono_ns;
 
-// FEff = Fuel Efficiency and EEff = Electrical Efficiency
-int array_Count_FEff, array_Count_EEff;
+        if (event.event_type == GPIOD_LINE_EVENT_FALLING_EDGE && calc_lap((uint64_t) edge))
+        {
+            const lapResult *lap = lap_engine_result(&laps, 0);
+            printf("lap %u: %.1f s, %.0f m, %.0f J\n", lap->lap, lap->time_s, lap->distance_m, lap->energy_j);
+        }
+    }
+}
 
-// count for keeping track of data size
-int EE_cnt = 0;
-int FE_cnt = 0;
+static void stopProgram(int sig) {
+    (void) sig;
+    keepRunning = 0;
+}
 
 /***************************************************************/
 /*--------------------------Main Program-----------------------*/
-int main()
-{   
+int main(int argc, char *argv[])
+{
+    const char *ifnames[CAN_MAX_BUSES] = { "can0" };
+    int nIf = 1;
+    const char *recordFile = NULL;
+    const char *replayFile = NULL;
+    int recordFD = 0;
+    int lapGpio = -1;
+    int opt;
+
+    // edas [-r record.trc [-f]] [-p replay.trc [-x speed]] [-s seconds] [-t] [-L metres] [-m gpio] [-R priority] [-F fsync] [-W] [-l session.tlg] [-k flight.rec] [interface ...]
+    while ((opt = getopt(argc, argv, "r:fp:x:s:tL:m:R:F:Wl:k:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r': recordFile = optarg; break;
+            case 'f': recordFD = 1; break;
+            case 'p': replayFile = optarg; break;
+            case 'x': replaySpeed = atof(optarg); break;
+            case 's': statsInterval = atoi(optarg); break;
+            case 't': transmit = 1; break;
+            case 'L': lapTrack_m = atof(optarg); break;
+            case 'm': lapGpio = atoi(optarg); break;
+            case 'R': fanPriority = atoi(optarg); break;
+            case 'F':
+                if (strcmp(optarg, "never") == 0)
+                    logSync = LOG_FSYNC_NEVER;
+                else if (strcmp(optarg, "block") == 0)
+                    logSync = LOG_FSYNC_BLOCK;
+                else
+                    logSyncMs = (uint32_t) atoi(optarg);
+                break;
+            case 'W': logFullPolicy = LOG_FULL_WAIT; break;
+            case 'l': tlogFile = optarg; break;
+            case 'k': flightFile = (strcmp(optarg, "none") == 0) ? NULL : optarg; break;
+            default:
+                printf("usage: %s [-r record.trc [-f]] [-p replay.trc [-x speed, 0 = max]] [-s stats seconds] [-t] [-L track metres] [-m lap marker gpio] [-R fan loop priority] [-F never|block|fsync ms] [-W] [-l telemetry log] [-k flight recorder|none] [interface ...]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind > CAN_MAX_BUSES)
+    {
+        printf("at most %d CAN interfaces, %d given\n", CAN_MAX_BUSES, argc - optind);
+        return 1;
+    }
+    if (optind < argc)
+    {
+        nIf = 0;
+        while (optind < argc)
+            ifnames[nIf++] = argv[optind++];
+    }
+
+    store = signal_store_map(1);
+    if (store == NULL)
+    {
+        printf("could not create signal store %s: %s\n", SIGNAL_STORE_NAME, strerror(errno));
+        return 1;
+    }
+
+    // without it the fan loop still runs on the default setpoint
+    control = signal_control_map();
+    if (control == NULL)
+        printf("could not map %s, fan setpoint stays at %d C: %s\n", SIGNAL_CONTROL_NAME, CONTROL_FAN_SETPOINT_C, strerror(errno));
+
     // initializing to prevent random data
     while (ProgStarted == 0)
     {
+        lapMarker = (lapGpio >= 0);
         initializeSpeedVal();
+        if (CAN_sort_init(store) < 0)
+        {
+            printf("could not register every CAN decoder\n");
+            return 1;
+        }
         ProgStarted = 1;
     }
-    
-    // Fan control in RPM
-    uint32_t FANspeed = Fan_Ctrl (driver_temp, driver_humid);
-
-    // Calculate efficiency - instant and running average
-    Fuel_Eff.value = fuel_efficiency(   SpeedVal[0].value, 
-                                        SpeedVal[1].value, 
-                                        fuelVal[0].value, 
-                                        fuelVal[1].value, 
-                                        SpeedVal[0].time,
-                                        SpeedVal[1].time,
-                                        fuelVal[0].time,
-                                        fuelVal[1].time,
-                                        PreCal_FEff, &inst_FEff, data_Fcnt);
-    
-    Elec_Eff.value = elec_efficiency(   mtr_volt, mtr_curr, fc_volt, fc_curr, fc_joules,
-                                        mtrV_time, fcV_time, PreCal_EEff, &inst_EEff, data_Ecnt);
-
-    // Controlling driver fan
-    fan_RPM = Fan_Ctrl(driver_temp, driver_humid);
-
-    // Storing data into file
-    while (array_Count < array_Limit)
-    {
-        File_Array(*);
-    }
-}
\ No newline at end of file
+
+    // the calculations go on without the files
+    if (calc_log_open(logSync, logSyncMs, logFullPolicy) < 0)
+        printf("could not open the CSV files: %s\n", strerror(errno));
+    else if (tlogFile != NULL && calc_tlog_open(tlogFile) < 0)
+        printf("could not open telemetry log %s: %s\n", tlogFile, strerror(errno));
+
+    // what the last run left is kept until the ring comes round to it
+    if (flightFile != NULL && flight_rec_open(&flight, flightFile, 0) < 0)
+        printf("could not open flight recorder %s: %s\n", flightFile, strerror(errno));
+    else if (flightFile != NULL && flight.recovered_last > 0)
+        printf("flight recorder %s: records %llu - %llu of earlier runs kept\n", flightFile,
+               (unsigned long long) flight.recovered_first, (unsigned long long) flight.recovered_last);
+
+    // no SA_RESTART so a blocked receive returns on Ctrl+C
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stopProgram;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (lapGpio >= 0)
+    {
+        lapChip = gpiod_chip_open_by_name(LAP_GPIO_CHIP);
+        lapLine = (lapChip != NULL) ? gpiod_chip_get_line(lapChip, lapGpio) : NULL;
+        if (lapLine == NULL || gpiod_line_request_falling_edge_events_flags(lapLine, "edas_lap", GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_UP) < 0)
+        {
+            printf("could not watch GPIO %d for the lap marker: %s\n", lapGpio, strerror(errno));
+            return 1;
+        }
+    }
+
+    // no page faults in the real-time loop
+    if (fanPriority > 0 && mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        printf("could not lock memory: %s\n", strerror(errno));
+
+    if (fan_loop_open(&fan, store, control) < 0 || startFanLoop() != 0)
+    {
+        printf("could not start the fan loop: %s\n", strerror(errno));
+        return 1;
+    }
+
+    frame_ring_init(&rxRing);
+    can_stats_init(&stats, CAN_STATS_BITRATE, CAN_STATS_DBITRATE);
+    time_t lastReport = time(NULL);
+
+    // through the CSV files' writer, so recording never waits on the card either
+    if (recordFile != NULL && can_rec_open(&recorder, &logw, recordFile, recordFD) < 0)
+    {
+        printf("could not create trace file %s: %s\n", recordFile, strerror(errno));
+        return 1;
+    }
+
+    if (replayFile != NULL)
+    {
+        if (can_trace_open(&replay, replayFile) < 0)
+        {
+            printf("could not open trace file %s: %s\n", replayFile, strerror(errno));
+            return 1;
+        }
+        printf("Replaying %llu frames from %s\n", (unsigned long long) replay.count, replayFile);
+
+        if (pthread_create(&canThread, NULL, traceReader, &replay) != 0)
+        {
+            printf("could not start replay thread\n");
+            return 1;
+        }
+    }
+    else
+    {
+        if (can_mux_init(&mux) < 0)
+        {
+            printf("could not create epoll: %s\n", strerror(errno));
+            return 1;
+        }
+        for (int b = 0; b < nIf; b++)
+        {
+            if (can_rx_open(&buses[b], ifnames[b]) < 0 || can_mux_add(&mux, &buses[b]) < 0)
+            {
+                printf("could not open CAN interface %s: %s\n", ifnames[b], strerror(errno));
+                return 1;
+            }
+            printf("Bus interface %s connected as bus %d\n", ifnames[b], buses[b].bus);
+        }
+
+        // program filters for the decoders registered so far and for any added later
+        updateFilters(&mux);
+        CAN_set_register_hook(updateFilters, &mux);
+
+        if (pthread_create(&canThread, NULL, canReader, &mux) != 0)
+        {
+            printf("could not start CAN reader thread\n");
+            return 1;
+        }
+
+        if (transmit)
+        {
+            if (can_tx_open(&tx, ifnames[0], store) < 0)
+            {
+                printf("could not open %s for transmitting: %s\n", ifnames[0], strerror(errno));
+                return 1;
+            }
+            for (size_t i = 0; i < sizeof(txTable) / sizeof(txTable[0]); i++)
+                can_tx_add(&tx, &txTable[i]);
+
+            if (pthread_create(&txThread, NULL, canWriter, &tx) != 0)
+            {
+                printf("could not start CAN transmit thread\n");
+                return 1;
+            }
+        }
+    }
+
+    while (keepRunning)
+    {
+        int n = frame_ring_pop(&rxRing, rxFrames, CAN_RX_BATCH);
+
+        if (lapLine != NULL)
+            pollLapMarker();
+
+        if (statsInterval > 0 && time(NULL) - lastReport >= statsInterval)
+        {
+            can_stats_report(&stats, stdout);
+            printf("%llu error frames, %llu frames too short for their message\n",
+                   (unsigned long long) CAN_errors, (unsigned long long) CAN_short_frames);
+            fan_loop_report(&fan, stdout);
+            log_writer_report(&logw, stdout);
+            if (tlog.stream >= 0)
+                tlog_report(&tlog, stdout);
+            if (flight.hdr != NULL)
+                flight_rec_report(&flight, stdout);
+            lastReport = time(NULL);
+        }
+
+        // nothing waiting, give the core back for a moment
+        if (n == 0)
+        {
+            usleep(1000);
+            continue;
+        }
+
+        if (recorder.stream >= 0)
+        {
+            for (int i = 0; i < n; i++)
+                can_rec_write(&recorder, &rxFrames[i]);
+        }
+
+        // every frame goes through the decoder, readers see the whole batch at once
+        // each frame's samples are resampled and recorded before the next one can overwrite them
+        signal_store_write_begin(store);
+        for (int i = 0; i < n; i++)
+        {
+            CAN_sort(&rxFrames[i]);
+            calc_resample(store);
+            calc_record(store);
+        }
+        signal_store_write_end(store);
+
+        calculate(store);
+    }
+
+    pthread_join(canThread, NULL);
+    if (tx.sock >= 0)
+        pthread_join(txThread, NULL);
+    pthread_join(fanThread, NULL);
+
+    for (int b = 0; b < mux.count; b++)
+    {
+        canRx *rx = mux.rx[b];
+        printf("\n%s: %llu frames received in %llu batches, %llu dropped by socket queue\n",
+               rx->ifname, (unsigned long long) rx->frames, (unsigned long long) rx->batches,
+               (unsigned long long) rx->drops);
+        printf("%s: %llu frames filtered out by the kernel (%d filters)\n",
+               rx->ifname, (unsigned long long) can_rx_filtered(rx), rx->n_filters);
+    }
+    printf("\n");
+    can_stats_report(&stats, stdout);
+    if (tx.sock >= 0)
+        can_tx_report(&tx, stdout);
+    fan_loop_report(&fan, stdout);
+    writeFanLoop();
+    calc_log_close();
+    log_writer_report(&logw, stdout);
+    if (tlogFile != NULL)
+        tlog_report(&tlog, stdout);
+    if (flight.hdr != NULL)
+        flight_rec_report(&flight, stdout);
+    flight_rec_close(&flight);
+    printf("%llu error frames, %llu frames too short for their message\n",
+           (unsigned long long) CAN_errors, (unsigned long long) CAN_short_frames);
+    printf("%llu frames dropped because the calculations fell behind\n",
+           (unsigned long long) atomic_load(&rxRing.dropped));
+    printf("%u laps, %.0f m, %llu lap marker bounces ignored\n",
+           laps.laps, laps.distance_m, (unsigned long long) laps.bounces);
+    printf("energy: motor %.0f J, fuel cell %.0f J, fc_joules dropped %.0f J, drift %.0f J, ratio %.3f\n",
+           energy_int_motor(&energy), energy_int_fc(&energy), energy_int_reported(&energy),
+           energy_int_drift(&energy), energy_int_consistency(&energy));
+    can_mux_close(&mux);
+    can_tx_close(&tx);
+    fan_loop_close(&fan);
+    can_trace_close(&replay);
+    if (recorder.stream >= 0)
+        printf("%llu frames recorded to %s, %llu dropped\n", (unsigned long long) recorder.records, recordFile,
+               (unsigned long long) recorder.dropped);
+    can_rec_close(&recorder);
+    signal_store_unmap(store);
+    signal_control_unmap(control);
+    if (lapLine != NULL)
+        gpiod_line_release(lapLine);
+    if (lapChip != NULL)
+        gpiod_chip_close(lapChip);
+
+    return 0;
+}
@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 
+// data shared between threads is laid out on cache line boundaries
+#define CACHE_LINE 64
+
 // for combined time and data value together
 typedef struct RdataStruct {
     float time;
@@ -16,4 +19,24 @@ typedef struct dataStruct {
     uint32_t value;
 } dataStruct;
 
+// CAN frame flags
+#define CAN_FRAME_EFF   0x01        // 29 bit extended identifier
+#define CAN_FRAME_RTR   0x02        // remote transmission request
+#define CAN_FRAME_ERR   0x04        // error frame reported by the controller
+#define CAN_FRAME_FD    0x08        // CAN FD frame
+#define CAN_FRAME_BRS   0x10        // CAN FD bit rate switch
+
+// most CAN interfaces watched at once - must be a power of 2
+#define CAN_MAX_BUSES   4
+
+// for a single CAN / CAN FD frame as it comes off the bus
+typedef struct canFrame {
+    uint64_t time_ns;               // kernel receive timestamp (CLOCK_REALTIME) in ns
+    uint32_t id;                    // arbitration ID without flag bits
+    uint8_t flags;                  // CAN_FRAME_* flags
+    uint8_t len;                    // payload length in bytes (0 - 64)
+    uint8_t bus;                    // index of the interface it came in on
+    uint8_t data[64];
+} canFrame;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef CAN_RECEIVE_H
+#define CAN_RECEIVE_H
+
+// needs _GNU_SOURCE defined before the first system header for struct mmsghdr
+
+#include <stdint.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include "typedefs.h"
+
+// max frames pulled out of the socket with one recvmmsg() call
+#define CAN_RX_BATCH 64
+
+// most acceptance filters programmed into the socket, more IDs than this accept everything
+#define CAN_RX_MAX_FILTERS 512
+
+// room for SO_TIMESTAMPING and SO_RXQ_OVFL control messages per frame
+#define CAN_RX_CTRL_LEN 128
+
+// one raw CAN socket bound to a single interface
+typedef struct canRx {
+    int sock;
+    int bus;                        // index put in canFrame.bus
+    char ifname[IFNAMSIZ];
+
+    // statistics
+    uint64_t frames;                // frames handed to the caller
+    uint64_t batches;               // recvmmsg() calls that returned data
+    uint64_t drops;                 // frames the socket queue dropped (SO_RXQ_OVFL)
+    uint32_t ovfl_last;             // last cumulative drop count seen from the kernel
+    uint64_t if_rx_start;           // interface rx_packets when the socket was opened
+    uint64_t filtered;              // frames the kernel filter kept out of user space
+    int n_filters;                  // acceptance filters programmed, 0 = accept all
+
+    // recvmmsg() scratch space - kept here so receiving never allocates
+    struct canfd_frame raw[CAN_RX_BATCH];
+    struct iovec iov[CAN_RX_BATCH];
+    struct mmsghdr msgs[CAN_RX_BATCH];
+    uint8_t ctrl[CAN_RX_BATCH][CAN_RX_CTRL_LEN];
+} canRx;
+
+// every bus watched from one epoll loop
+typedef struct canMux {
+    int epfd;
+    int count;
+    canRx *rx[CAN_MAX_BUSES];
+} canMux;
+
+// open and bind a raw CAN socket, returns 0 or -1 with errno set
+int can_rx_open(canRx *rx, const char *ifname);
+
+// block until at least one frame arrives, then return everything already queued (up to max)
+// returns number of frames written to out, 0 if interrupted by a signal or nothing came
+// in for a second, -1 on error
+int can_rx_batch(canRx *rx, canFrame *out, int max);
+
+// program kernel acceptance filters for exactly these IDs (bit 31 set = 29 bit ID)
+// plus the controller error frames we care about, n = 0 accepts everything
+// returns 0 or -1 with errno set
+int can_rx_set_filters(canRx *rx, const uint32_t *ids, int n);
+
+// refresh rx->filtered from the interface counters, returns it
+uint64_t can_rx_filtered(canRx *rx);
+
+void can_rx_close(canRx *rx);
+
+// epoll loop over several buses, frames are tagged with the bus index they came in on
+int can_mux_init(canMux *mux);
+
+// add an opened bus, its index becomes the next free one - returns 0 or -1
+int can_mux_add(canMux *mux, canRx *rx);
+
+// wait up to a second for any bus, then take what is queued on every ready bus without
+// blocking, sharing max between them so a busy bus cannot starve a quiet one
+// returns number of frames, 0 on timeout or signal, -1 on error
+int can_mux_wait(canMux *mux, canFrame *out, int max);
+
+void can_mux_close(canMux *mux);
+
+#endif
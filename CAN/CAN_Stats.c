@@ -0,0 +1,201 @@
+// Name: CAN_Stats
+// Description: Per-ID and per-bus statistics for the CAN ingestion path - frames/s, bytes/s,
+//              inter-arrival jitter, DLC mismatches, error frames and bus load
+
+// Replaces the print() per frame of Receive-ECOCAR.py. Counting a frame is a table lookup and
+// a few increments; the reader thread is the only writer so counters need no locks, only
+// atomic loads and stores so another thread can read them while they change.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <linux/can.h>
+#include <linux/can/error.h>
+#include "CAN_Stats.h"
+#include "CAN_Sort.h"
+
+static inline uint64_t get(_Atomic uint64_t *c)
+{
+    return atomic_load_explicit(c, memory_order_relaxed);
+}
+
+// estimated time a frame holds the bus, worst case bit stuffing included
+// classic: 47 (11 bit) or 67 (29 bit) bits of overhead + payload, stuff bits every 4 bits
+// FD: arbitration and end of frame at the nominal rate, DLC, payload and CRC at the data rate with BRS
+static uint64_t frame_bus_ns(const canStats *s, const canFrame *f)
+{
+    uint32_t nominal, data;
+    uint32_t len8 = 8u * f->len;
+    int ext = (f->flags & CAN_FRAME_EFF) != 0;
+
+    if (!(f->flags & CAN_FRAME_FD))
+    {
+        uint32_t bits = ext ? 67 + len8 + (54 + len8 - 1) / 4 : 47 + len8 + (34 + len8 - 1) / 4;
+        return (uint64_t) bits * 1000000000ull / s->bitrate;
+    }
+
+    nominal = (ext ? 50 : 30) + 13;
+    data = 5 + len8 + ((f->len > 16) ? 21 : 17) + 4;
+    data += data / 5;
+    if (f->flags & CAN_FRAME_BRS)
+        return (uint64_t) nominal * 1000000000ull / s->bitrate + (uint64_t) data * 1000000000ull / s->dbitrate;
+    return (uint64_t) (nominal + data) * 1000000000ull / s->bitrate;
+}
+
+void can_stats_init(canStats *s, uint32_t bitrate, uint32_t dbitrate)
+{
+    memset(s, 0, sizeof(*s));
+    s->bitrate = bitrate ? bitrate : CAN_STATS_BITRATE;
+    s->dbitrate = dbitrate ? dbitrate : CAN_STATS_DBITRATE;
+    s->prev_report_ns = mono_ns();
+
+    // IDs tracked from the start - every message in signals.dbc, expected length 0 = learn
+    for (int i = 0; i < CAN_RX_MESSAGES; i++)
+        can_stats_track(s, CAN_rx_messages[i].id, CAN_rx_messages[i].extended, CAN_rx_messages[i].len);
+}
+
+int can_stats_track(canStats *s, uint32_t id, int extended, uint8_t expect_len)
+{
+    uint32_t key = extended ? (id & CAN_EFF_MASK) | CAN_ID_EXT_BIT : id & CAN_SFF_MASK;
+
+    for (int i = 0; i < s->n_ids; i++)
+    {
+        if (s->ids[i] == key) {
+            s->expect_len[i] = expect_len;
+            return 0;
+        }
+    }
+    if (s->n_ids >= CAN_STATS_MAX_IDS)
+        return -1;
+
+    s->ids[s->n_ids] = key;
+    s->expect_len[s->n_ids] = expect_len;
+    if (!extended)
+        s->std_slot[key] = s->n_ids + 1;
+    s->n_ids++;
+    return 0;
+}
+
+int can_stats_ids(const canStats *s, uint32_t *ids, int max)
+{
+    int n = (s->n_ids < max) ? s->n_ids : max;
+    memcpy(ids, s->ids, n * sizeof(uint32_t));
+    return n;
+}
+
+// slot of a frame's ID, -1 if not tracked
+// 11 bit IDs are a direct lookup, the few 29 bit ones a short scan
+static inline int find_slot(const canStats *s, const canFrame *f)
+{
+    if (!(f->flags & CAN_FRAME_EFF))
+        return (int) s->std_slot[f->id & CAN_SFF_MASK] - 1;
+
+    uint32_t key = f->id | CAN_ID_EXT_BIT;
+    for (int i = 0; i < s->n_ids; i++)
+    {
+        if (s->ids[i] == key)
+            return i;
+    }
+    return -1;
+}
+
+void can_stats_frame(canStats *s, const canFrame *f)
+{
+    canBusStats *b = &s->bus[f->bus < CAN_MAX_BUSES ? f->bus : 0];
+
+    if (get(&b->frames) == 0)
+        atomic_store_explicit(&b->first_ns, f->time_ns, memory_order_relaxed);
+    bump(&b->frames, 1);
+    bump(&b->bus_ns, frame_bus_ns(s, f));
+    atomic_store_explicit(&b->last_ns, f->time_ns, memory_order_relaxed);
+
+    if (f->flags & CAN_FRAME_ERR)
+    {
+        bump(&b->errors, 1);
+        if (f->id & CAN_ERR_BUSOFF)
+            bump(&b->busoff, 1);
+        return;
+    }
+    bump(&b->bytes, f->len);
+
+    int slot = find_slot(s, f);
+    if (slot < 0)
+        return;
+
+    canIdStats *st = &b->id[slot];
+    bump(&st->frames, 1);
+    bump(&st->bytes, f->len);
+
+    // first frame of an ID without a configured length sets what is expected
+    if (s->expect_len[slot] == 0)
+        s->expect_len[slot] = f->len;
+    else if (f->len != s->expect_len[slot])
+        bump(&st->dlc_mismatch, 1);
+
+    if (st->last_ns != 0 && f->time_ns > st->last_ns)
+    {
+        uint64_t interval = (f->time_ns - st->last_ns) / 1000;
+        hist_add(&st->interval, interval);
+        if (st->last_interval != 0)
+            hist_add(&st->jitter, interval > st->last_interval ? interval - st->last_interval : st->last_interval - interval);
+        st->last_interval = interval;
+    }
+    st->last_ns = f->time_ns;
+}
+
+void can_stats_report(canStats *s, FILE *fp)
+{
+    uint64_t now = mono_ns();
+    double wallSecs = (double) (now - s->prev_report_ns) / 1e9;
+    s->prev_report_ns = now;
+
+    for (int bus = 0; bus < CAN_MAX_BUSES; bus++)
+    {
+        canBusStats *b = &s->bus[bus];
+        uint64_t frames = get(&b->frames), bytes = get(&b->bytes), busNs = get(&b->bus_ns), last = get(&b->last_ns);
+        double secs = wallSecs;
+
+        if (frames == 0)
+            continue;
+
+        // time covered by the frames since the last report, wall time if the bus went quiet
+        // (the first report counts from the first frame)
+        if (b->prev_last_ns == 0)
+            b->prev_last_ns = get(&b->first_ns);
+        if (last > b->prev_last_ns && frames > b->prev_frames)
+            secs = (double) (last - b->prev_last_ns) / 1e9;
+        if (secs <= 0)
+            secs = 1;
+        b->prev_last_ns = last;
+
+        fprintf(fp, "bus %d: %.0f frames/s, %.0f bytes/s, load %.1f%%, %llu error frames (%llu bus-off)\n",
+                bus, (frames - b->prev_frames) / secs, (bytes - b->prev_bytes) / secs,
+                (double) (busNs - b->prev_bus_ns) / (secs * 1e7),
+                (unsigned long long) get(&b->errors), (unsigned long long) get(&b->busoff));
+        b->prev_frames = frames;
+        b->prev_bytes = bytes;
+        b->prev_bus_ns = busNs;
+
+        fprintf(fp, "  %-10s %8s %9s %9s %9s %9s %9s %9s\n",
+                "id", "frames/s", "bytes/s", "dlc_err", "ia_p50us", "ia_p99us", "jit_p99us", "jit_max");
+        for (int i = 0; i < s->n_ids; i++)
+        {
+            canIdStats *st = &b->id[i];
+            uint64_t f = get(&st->frames), by = get(&st->bytes);
+
+            if (f == 0)
+                continue;
+            fprintf(fp, "  0x%-8X %8.0f %9.0f %9llu %9llu %9llu %9llu %9llu\n",
+                    s->ids[i] & ~CAN_ID_EXT_BIT, (f - st->prev_frames) / secs, (by - st->prev_bytes) / secs,
+                    (unsigned long long) get(&st->dlc_mismatch),
+                    (unsigned long long) hist_percentile(&st->interval, 0.50),
+                    (unsigned long long) hist_percentile(&st->interval, 0.99),
+                    (unsigned long long) hist_percentile(&st->jitter, 0.99),
+                    (unsigned long long) st->jitter.max);
+            st->prev_frames = f;
+            st->prev_bytes = by;
+        }
+    }
+}
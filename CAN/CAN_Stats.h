@@ -0,0 +1,80 @@
+#ifndef CAN_STATS_H
+#define CAN_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "typedefs.h"
+#include "Log_Hist.h"
+
+// most IDs tracked individually (same set on every bus)
+#define CAN_STATS_MAX_IDS   32
+
+// bitrates used for the bus load estimate - bus is brought up with bitrate 1000000,
+// FD data phase 2000000 (Receive-ECOCAR.py)
+#define CAN_STATS_BITRATE   1000000
+#define CAN_STATS_DBITRATE  2000000
+
+// counters for one ID on one bus
+// written only by the thread calling can_stats_frame(), read by anyone
+// (a reader may see a histogram one sample behind in its count)
+typedef struct canIdStats {
+    _Atomic uint64_t frames;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t dlc_mismatch;      // payload length differs from the expected one
+    uint64_t last_ns;                   // writer only
+    uint64_t last_interval;             // writer only, microseconds
+    logHist interval;                   // inter-arrival time, microseconds
+    logHist jitter;                     // change of inter-arrival time, microseconds
+
+    // reader only - totals at the previous can_stats_report()
+    uint64_t prev_frames;
+    uint64_t prev_bytes;
+} canIdStats;
+
+typedef struct canBusStats {
+    _Atomic uint64_t frames;            // every frame, tracked or not
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t errors;            // error frames from the controller
+    _Atomic uint64_t busoff;            // of those, bus-off
+    _Atomic uint64_t bus_ns;            // estimated time the frames occupied the bus
+    _Atomic uint64_t first_ns;          // receive time of the first frame
+    _Atomic uint64_t last_ns;           // receive time of the newest frame
+    canIdStats id[CAN_STATS_MAX_IDS];
+
+    // reader only
+    uint64_t prev_frames;
+    uint64_t prev_bytes;
+    uint64_t prev_bus_ns;
+    uint64_t prev_last_ns;
+} canBusStats;
+
+typedef struct canStats {
+    int n_ids;
+    uint32_t ids[CAN_STATS_MAX_IDS];        // CAN_ID_EXT_BIT set for 29 bit IDs
+    uint8_t expect_len[CAN_STATS_MAX_IDS];  // 0 = learn from the first frame
+    uint8_t std_slot[2048];                 // 11 bit ID -> slot + 1, 0 = not tracked
+    uint32_t bitrate;
+    uint32_t dbitrate;
+    uint64_t prev_report_ns;                // reader only, CLOCK_MONOTONIC
+    canBusStats bus[CAN_MAX_BUSES];
+} canStats;
+
+// clear everything and track the ECOCAR IDs (0x001 - 0x050) and the ones the calculations decode
+void can_stats_init(canStats *s, uint32_t bitrate, uint32_t dbitrate);
+
+// track one more ID, expect_len 0 = whatever length it first arrives with
+// returns 0 or -1 if the table is full
+int can_stats_track(canStats *s, uint32_t id, int extended, uint8_t expect_len);
+
+// copy tracked IDs into ids (for the kernel filters), returns how many
+int can_stats_ids(const canStats *s, uint32_t *ids, int max);
+
+// count one frame - O(1), no locks, call from one thread only
+void can_stats_frame(canStats *s, const canFrame *frame);
+
+// print rates since the last report (frames/s, bytes/s, bus load) and the per-ID tables
+// rates are over frame receive times, so a trace replayed faster than real time reports the recorded rates
+void can_stats_report(canStats *s, FILE *fp);
+
+#endif
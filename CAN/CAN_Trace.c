@@ -0,0 +1,185 @@
+// Name: CAN_Trace
+// Description: Binary CAN trace recorder and memory mapped replayer
+
+// Recording a race session lets us reproduce field problems and load test the
+// calculations offline at many times the real bus rate.
+/* ---------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "CAN_Trace.h"
+
+int can_rec_open(canRecorder *rec, logWriter *w, const char *path, int fd)
+{
+    memset(rec, 0, sizeof(*rec));
+    rec->w = w;
+    rec->stream = -1;
+    rec->rec_size = fd ? CAN_TRACE_REC_FD : CAN_TRACE_REC_CLASSIC;
+
+    // a new trace every time, the writer only appends
+    int f = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (f < 0)
+        return -1;
+    close(f);
+
+    rec->stream = log_writer_add(w, path, NULL);
+    return (rec->stream < 0) ? -1 : 0;
+}
+
+int can_rec_write(canRecorder *rec, const canFrame *frame)
+{
+    size_t payload = rec->rec_size - offsetof(canTraceRecord, data);
+    size_t len = rec->rec_size;
+
+    // the header waits for the first frame, it carries its time as the start time
+    if (rec->records == 0)
+        len += sizeof(canTraceHeader);
+
+    uint8_t *p = log_writer_reserve(rec->w, rec->stream, len);
+    if (p == NULL) {
+        rec->dropped++;
+        return -1;
+    }
+
+    if (rec->records == 0) {
+        canTraceHeader hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, CAN_TRACE_MAGIC, sizeof(hdr.magic));
+        hdr.version = CAN_TRACE_VERSION;
+        hdr.rec_size = rec->rec_size;
+        hdr.start_ns = frame->time_ns;
+        memcpy(p, &hdr, sizeof(hdr));
+        p += sizeof(hdr);
+    }
+
+    canTraceRecord r;
+    memset(&r, 0, rec->rec_size);
+    r.time_ns = frame->time_ns;
+    r.id = frame->id;
+    r.flags = frame->flags;
+    r.len = frame->len;
+    r.bus = frame->bus;
+    if (r.len > payload) {
+        r.len = payload;
+        rec->truncated++;
+    }
+    memcpy(r.data, frame->data, r.len);
+    memcpy(p, &r, rec->rec_size);
+    log_writer_commit(rec->w, rec->stream, len);
+
+    rec->records++;
+    return 0;
+}
+
+void can_rec_close(canRecorder *rec)
+{
+    rec->stream = -1;
+}
+
+int can_trace_open(canTrace *trace, const char *path)
+{
+    struct stat st;
+    canTraceHeader hdr;
+
+    memset(trace, 0, sizeof(*trace));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(hdr)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+
+    memcpy(&hdr, p, sizeof(hdr));
+    if (memcmp(hdr.magic, CAN_TRACE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        (hdr.rec_size != CAN_TRACE_REC_CLASSIC && hdr.rec_size != CAN_TRACE_REC_FD)) {
+        munmap(p, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    // reading front to back, tell the kernel to read ahead
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+    trace->map = p;
+    trace->map_size = st.st_size;
+    trace->rec_size = hdr.rec_size;
+    trace->start_ns = hdr.start_ns;
+    // a partly written last record (power loss while recording) is ignored
+    trace->count = (st.st_size - sizeof(hdr)) / hdr.rec_size;
+
+    return 0;
+}
+
+void can_trace_close(canTrace *trace)
+{
+    if (trace->map != NULL)
+        munmap((void *) trace->map, trace->map_size);
+    trace->map = NULL;
+}
+
+int can_trace_get(canTrace *trace, uint64_t i, canFrame *frame)
+{
+    const uint8_t *p = trace->map + sizeof(canTraceHeader) + i * trace->rec_size;
+    size_t payload = trace->rec_size - offsetof(canTraceRecord, data);
+    canTraceRecord r;
+
+    memcpy(&r, p, trace->rec_size);
+
+    // a corrupt record must not index past the per bus tables
+    if (r.bus >= CAN_MAX_BUSES) {
+        trace->bad++;
+        return 0;
+    }
+
+    frame->time_ns = r.time_ns;
+    frame->id = r.id;
+    frame->flags = r.flags;
+    frame->len = (r.len > payload) ? (uint8_t) payload : r.len;
+    frame->bus = r.bus;
+    memcpy(frame->data, r.data, frame->len);
+    return 1;
+}
+
+uint64_t can_trace_replay(canTrace *trace, double speed, canTraceSink sink, void *ctx,
+                          volatile sig_atomic_t *run)
+{
+    canFrame frame;
+    uint64_t wall_start = mono_ns();
+    uint64_t first_ns = 0;
+    uint64_t i;
+
+    for (i = 0; i < trace->count && *run; i++)
+    {
+        if (!can_trace_get(trace, i, &frame))
+            continue;
+        if (first_ns == 0)
+            first_ns = frame.time_ns;
+
+        // paced replay - sleep until this frame is due
+        if (speed > 0 && frame.time_ns > first_ns) {
+            uint64_t due = wall_start + (uint64_t) ((double) (frame.time_ns - first_ns) / speed);
+            if (due > mono_ns()) {
+                struct timespec ts = { .tv_sec = due / 1000000000ull, .tv_nsec = due % 1000000000ull };
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            }
+        }
+
+        sink(&frame, ctx);
+    }
+
+    return i;
+}
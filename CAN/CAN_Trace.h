@@ -0,0 +1,89 @@
+#ifndef CAN_TRACE_H
+#define CAN_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <signal.h>
+#include "typedefs.h"
+#include "Log_Writer.h"
+
+// Binary CAN trace file
+//   header:  canTraceHeader (32 bytes)
+//   records: fixed size, back to back, little endian
+//            classic traces use 24 byte records (8 byte payload), FD traces 80 byte records
+#define CAN_TRACE_MAGIC     "EDASTRC1"
+#define CAN_TRACE_VERSION   1
+
+#define CAN_TRACE_REC_CLASSIC   24
+#define CAN_TRACE_REC_FD        80
+
+typedef struct canTraceHeader {
+    char magic[8];
+    uint16_t version;
+    uint16_t rec_size;              // CAN_TRACE_REC_CLASSIC or CAN_TRACE_REC_FD
+    uint32_t reserved;
+    uint64_t start_ns;              // time of first record
+    uint64_t reserved2;
+} canTraceHeader;
+
+// one record, payload is 8 or 64 bytes depending on rec_size
+typedef struct canTraceRecord {
+    uint64_t time_ns;               // kernel receive timestamp
+    uint32_t id;
+    uint8_t flags;                  // CAN_FRAME_* flags
+    uint8_t len;                    // payload length in bytes (decoded DLC)
+    uint8_t bus;                    // interface index the frame came in on
+    uint8_t reserved;
+    uint8_t data[64];
+} canTraceRecord;
+
+// recorder - appends frames as a stream of the log writer, so the card never holds up the caller
+typedef struct canRecorder {
+    logWriter *w;
+    int stream;                     // -1 = not recording
+    uint16_t rec_size;
+    uint64_t records;               // frames written
+    uint64_t dropped;               // frames lost because the writer had no free block (LOG_FULL_DROP)
+    uint64_t truncated;             // FD frames cut to 8 bytes in a classic trace
+} canRecorder;
+
+// replayer - whole trace file mapped read-only
+typedef struct canTrace {
+    const uint8_t *map;
+    size_t map_size;
+    uint16_t rec_size;
+    uint64_t count;                 // number of records
+    uint64_t start_ns;
+    uint64_t bad;                   // records skipped, bus out of range
+} canTrace;
+
+// called for every replayed frame
+typedef void (*canTraceSink)(const canFrame *frame, void *ctx);
+
+// fd = 1 records full 64 byte payloads, fd = 0 keeps records small for classic CAN
+// path is started afresh as a stream of w (log_writer_open() it first), the header goes out with
+// the first frame - returns 0 or -1 with errno set
+int can_rec_open(canRecorder *rec, logWriter *w, const char *path, int fd);
+
+// returns 0, or -1 if the frame was dropped
+int can_rec_write(canRecorder *rec, const canFrame *frame);
+
+// the file itself is written out and closed by log_writer_close()
+void can_rec_close(canRecorder *rec);
+
+// returns 0 or -1 with errno set (EINVAL = not a trace file)
+int can_trace_open(canTrace *trace, const char *path);
+void can_trace_close(canTrace *trace);
+
+// copy record i into frame, the length cut to what the record holds
+// returns 0 (and counts it in trace->bad) if the record cannot be a frame of ours
+int can_trace_get(canTrace *trace, uint64_t i, canFrame *frame);
+
+// feed every record to sink, speed = 1 real time, N = N times faster, 0 = as fast as possible
+// frames keep their recorded timestamps so results do not depend on the replay speed
+// stops early when *run becomes 0, returns number of records gone through, bad ones skipped
+uint64_t can_trace_replay(canTrace *trace, double speed, canTraceSink sink, void *ctx,
+                          volatile sig_atomic_t *run);
+
+#endif
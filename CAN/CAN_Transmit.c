@@ -0,0 +1,292 @@
+// Name: CAN_Transmit
+// Description: Periodic and on-change CAN transmit scheduler driven by one timerfd
+
+// Replaces the send + time.sleep(0.1) loop of Transmit-ECOCAR.py, whose period drifted by the
+// print and send time. Every tick of an absolute timer the table is checked, payloads of the
+// due messages are built from one signal store snapshot and sent together with sendmmsg().
+// A full TX queue does not block: frames that did not fit stay pending for the next tick.
+/* ---------------------------------------------------------------------------- */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include "CAN_Transmit.h"
+
+#define TICK_NS ((uint64_t) CAN_TX_TICK_MS * 1000000ull)
+
+int can_tx_open(canTx *tx, const char *ifname, signalStore *store)
+{
+    struct sockaddr_can addr;
+    struct ifreq ifr;
+
+    memset(tx, 0, sizeof(*tx));
+    tx->tfd = -1;
+    tx->store = store;
+
+    tx->sock = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (tx->sock < 0)
+        return -1;
+
+    snprintf(tx->ifname, sizeof(tx->ifname), "%s", ifname);
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+    if (ioctl(tx->sock, SIOCGIFINDEX, &ifr) < 0)
+        goto fail;
+
+    // send only - nothing should queue up on this socket
+    setsockopt(tx->sock, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(tx->sock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+        goto fail;
+
+    // absolute ticks so the period never drifts with the time spent sending
+    tx->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (tx->tfd < 0)
+        goto fail;
+
+    uint64_t start = (mono_ns() / TICK_NS + 1) * TICK_NS;
+    struct itimerspec its = {
+        .it_interval = { .tv_sec = 0, .tv_nsec = TICK_NS },
+        .it_value = { .tv_sec = start / 1000000000ull, .tv_nsec = start % 1000000000ull },
+    };
+    if (timerfd_settime(tx->tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        goto fail;
+
+    for (int i = 0; i < CAN_TX_MAX; i++)
+    {
+        tx->iov[i].iov_base = &tx->frames_buf[i];
+        tx->iov[i].iov_len = sizeof(struct can_frame);
+        tx->msgs[i].msg_hdr.msg_iov = &tx->iov[i];
+        tx->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    return 0;
+
+fail:
+    {
+        int err = errno;
+        close(tx->sock);
+        if (tx->tfd >= 0)
+            close(tx->tfd);
+        tx->sock = tx->tfd = -1;
+        errno = err;
+    }
+    return -1;
+}
+
+int can_tx_add(canTx *tx, const canTxMsg *msg)
+{
+    if (tx->n >= CAN_TX_MAX || msg->len > 8 || msg->mode == 0)
+        return -1;
+    if ((msg->mode & CAN_TX_PERIODIC) && (msg->period_ms < CAN_TX_TICK_MS || msg->period_ms % CAN_TX_TICK_MS))
+        return -1;
+
+    tx->msg[tx->n] = *msg;
+    memset(&tx->st[tx->n], 0, sizeof(canTxState));
+
+    // first send on the next whole period, shifted by the phase
+    if (msg->mode & CAN_TX_PERIODIC)
+    {
+        uint64_t period = (uint64_t) msg->period_ms * 1000000ull;
+        tx->st[tx->n].next_due = (mono_ns() / period + 1) * period + (uint64_t) msg->phase_ms * 1000000ull;
+    }
+
+    tx->n++;
+    return 0;
+}
+
+// writing one signal into the payload, saturating to the field width
+static void encode_field(uint8_t *data, const canField *f, float value)
+{
+    double raw = round(((double) value - f->offset_val) / f->scale);
+    double lo = 0, hi = (double) (0xFFFFFFFFu >> (32 - 8 * f->width));
+    uint32_t bits;
+
+    if (f->flags & CAN_FIELD_SIGNED) {
+        hi = (double) (0x7FFFFFFF >> (32 - 8 * f->width));
+        lo = -hi - 1;
+    }
+    if (isnan(raw))
+        raw = 0;
+    raw = (raw < lo) ? lo : (raw > hi) ? hi : raw;
+    bits = (f->flags & CAN_FIELD_SIGNED) ? (uint32_t) (int32_t) raw : (uint32_t) raw;
+
+    for (int b = 0; b < f->width; b++)
+    {
+        int pos = (f->flags & CAN_FIELD_BIG_ENDIAN) ? f->width - 1 - b : b;
+        data[f->offset + pos] = bits >> (8 * b);
+    }
+}
+
+// building the payload of message i, returns 0 if one of its signals has never been set
+static int build_payload(const canTxMsg *m, const signalSnapshot *snap, uint8_t *data)
+{
+    memset(data, 0, 8);
+
+    for (int k = 0; k < m->msg->n_fields; k++)
+    {
+        const canField *f = &m->msg->fields[k];
+
+        if (snap->sig[f->signal].time_ns == 0 || f->offset + f->width > m->len)
+            return 0;
+        encode_field(data, f, snap->sig[f->signal].value);
+    }
+
+    return 1;
+}
+
+int can_tx_tick(canTx *tx)
+{
+    uint64_t expirations;
+    const signalSnapshot *snap = &tx->snap;
+    int n = 0;
+
+    if (read(tx->tfd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+
+    tx->ticks++;
+    if (expirations > 1)
+        tx->missed_ticks += expirations - 1;
+
+    uint64_t now = mono_ns();
+    if (signal_store_snapshot(tx->store, &tx->snap) < 0)
+        tx->stale_snapshots++;
+
+    for (int i = 0; i < tx->n; i++)
+    {
+        const canTxMsg *m = &tx->msg[i];
+        canTxState *st = &tx->st[i];
+        struct can_frame *cf = &tx->frames_buf[n];
+        int due = st->pending;
+
+        // periodic slot reached - catch up on missed ticks by sending once, not once per slot
+        if ((m->mode & CAN_TX_PERIODIC) && now + TICK_NS / 2 >= st->next_due)
+        {
+            uint64_t period = (uint64_t) m->period_ms * 1000000ull;
+
+            if (st->pending)
+                st->dropped++;
+            st->due = st->next_due;
+            st->periodic = 1;
+            due = 1;
+            while (st->next_due <= now + TICK_NS / 2)
+                st->next_due += period;
+        }
+
+        if (!build_payload(m, snap, cf->data))
+            continue;
+
+        if (!due && (m->mode & CAN_TX_ON_CHANGE) &&
+            (!st->ever_sent || memcmp(cf->data, st->payload, m->len) != 0))
+        {
+            st->due = now;
+            st->periodic = 0;
+            due = 1;
+        }
+        if (!due)
+            continue;
+
+        cf->can_id = m->extended ? (m->id & CAN_EFF_MASK) | CAN_EFF_FLAG : m->id & CAN_SFF_MASK;
+        cf->can_dlc = CAN_len2dlc[m->len];          // classic frame, the code is the length
+        tx->slot[n++] = i;
+    }
+
+    if (n == 0)
+        return 0;
+
+    // a full queue returns ENOBUFS instead of blocking, whatever did not fit waits for the next tick
+    int sent = sendmmsg(tx->sock, tx->msgs, n, MSG_DONTWAIT);
+    if (sent < 0)
+    {
+        if (errno != ENOBUFS && errno != EAGAIN && errno != EINTR)
+            return -1;
+        sent = 0;
+    }
+    tx->batches++;
+    tx->frames += sent;
+    if (sent < n)
+        tx->backpressure++;
+
+    uint64_t done = mono_ns();
+    for (int k = 0; k < n; k++)
+    {
+        const canTxMsg *m = &tx->msg[tx->slot[k]];
+        canTxState *st = &tx->st[tx->slot[k]];
+
+        if (k >= sent) {
+            st->pending = 1;
+            continue;
+        }
+
+        hist_add(&st->late, done > st->due ? (done - st->due) / 1000 : 0);
+        if (st->periodic)
+        {
+            uint64_t period = (uint64_t) m->period_ms * 1000;
+            if (st->last_sent != 0) {
+                uint64_t interval = (done - st->last_sent) / 1000;
+                hist_add(&st->jitter, interval > period ? interval - period : period - interval);
+            }
+            st->last_sent = done;
+        }
+
+        memcpy(st->payload, tx->frames_buf[k].data, 8);
+        st->pending = 0;
+        st->ever_sent = 1;
+        st->sent++;
+    }
+
+    return sent;
+}
+
+void can_tx_run(canTx *tx, volatile sig_atomic_t *run)
+{
+    while (*run)
+    {
+        if (can_tx_tick(tx) < 0)
+        {
+            printf("CAN transmit error on %s: %s\n", tx->ifname, strerror(errno));
+            break;
+        }
+    }
+}
+
+void can_tx_report(const canTx *tx, FILE *fp)
+{
+    fprintf(fp, "%s: %llu frames sent in %llu batches, %llu ticks (%llu missed), TX queue full on %llu ticks, "
+                "%llu ticks on the previous snapshot\n",
+            tx->ifname, (unsigned long long) tx->frames, (unsigned long long) tx->batches,
+            (unsigned long long) tx->ticks, (unsigned long long) tx->missed_ticks,
+            (unsigned long long) tx->backpressure, (unsigned long long) tx->stale_snapshots);
+
+    for (int i = 0; i < tx->n; i++)
+    {
+        const canTxState *st = &tx->st[i];
+        fprintf(fp, "  tx 0x%-8X %9llu sent %6llu dropped, late p50 %llu us p99 %llu us, jitter p99 %llu us max %llu us\n",
+                tx->msg[i].id, (unsigned long long) st->sent, (unsigned long long) st->dropped,
+                (unsigned long long) hist_percentile(&st->late, 0.50),
+                (unsigned long long) hist_percentile(&st->late, 0.99),
+                (unsigned long long) hist_percentile(&st->jitter, 0.99),
+                (unsigned long long) st->jitter.max);
+    }
+}
+
+void can_tx_close(canTx *tx)
+{
+    if (tx->sock >= 0)
+        close(tx->sock);
+    if (tx->tfd >= 0)
+        close(tx->tfd);
+    tx->sock = tx->tfd = -1;
+}
@@ -0,0 +1,99 @@
+#ifndef CAN_TRANSMIT_H
+#define CAN_TRANSMIT_H
+
+// needs _GNU_SOURCE defined before the first system header for struct mmsghdr
+
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include "CAN_Sort.h"
+#include "Signal_Store.h"
+#include "Log_Hist.h"
+
+// scheduler tick - every period and phase is a multiple of this
+#define CAN_TX_TICK_MS  10
+
+// most messages in the transmit table
+#define CAN_TX_MAX      16
+
+// when a message is sent
+#define CAN_TX_PERIODIC     0x01        // every period_ms, offset by phase_ms
+#define CAN_TX_ON_CHANGE    0x02        // on the first tick its payload differs from the last one sent
+
+// one message in the transmit table - payload built from the signal store with the same
+// field tables the receive side decodes with (raw = (value - offset_val) / scale)
+typedef struct canTxMsg {
+    uint32_t id;
+    uint8_t extended;
+    uint8_t len;                        // payload bytes, 0 - 8
+    uint8_t mode;                       // CAN_TX_* flags
+    uint16_t period_ms;
+    uint16_t phase_ms;
+    const canMessage *msg;
+} canTxMsg;
+
+// scheduling state and statistics for one message, only touched by the transmit thread
+typedef struct canTxState {
+    uint64_t next_due;                  // CLOCK_MONOTONIC ns of the next periodic send
+    uint64_t due;                       // when the pending frame was due
+    uint64_t last_sent;                 // time of the last periodic send
+    uint8_t payload[8];                 // last payload sent
+    uint8_t pending;                    // due but not sent yet (queue was full)
+    uint8_t periodic;                   // pending frame is a periodic send, not an on-change one
+    uint8_t ever_sent;
+    uint64_t sent;
+    uint64_t dropped;                   // due again while still pending, one period lost
+    logHist late;                       // send time - due time, microseconds
+    logHist jitter;                     // |interval between periodic sends - period|, microseconds
+} canTxState;
+
+typedef struct canTx {
+    int sock;
+    int tfd;                            // timerfd firing every CAN_TX_TICK_MS
+    char ifname[IFNAMSIZ];
+    signalStore *store;
+
+    int n;
+    canTxMsg msg[CAN_TX_MAX];
+    canTxState st[CAN_TX_MAX];
+
+    // statistics
+    uint64_t ticks;
+    uint64_t missed_ticks;              // timer expirations the thread was too late to see
+    uint64_t batches;                   // sendmmsg() calls
+    uint64_t frames;
+    uint64_t backpressure;              // ticks where the TX queue could not take every frame
+    uint64_t stale_snapshots;           // ticks sent from the previous snapshot, the store was busy
+
+    // latest snapshot of the store, kept when a new one cannot be taken
+    signalSnapshot snap;
+
+    // sendmmsg() scratch space
+    struct can_frame frames_buf[CAN_TX_MAX];
+    struct iovec iov[CAN_TX_MAX];
+    struct mmsghdr msgs[CAN_TX_MAX];
+    int slot[CAN_TX_MAX];               // message index of each frame in the batch
+} canTx;
+
+// open a raw CAN socket on ifname for sending and a timerfd, values are read from store
+// returns 0 or -1 with errno set
+int can_tx_open(canTx *tx, const char *ifname, signalStore *store);
+
+// add a message to the table, returns 0 or -1 if the table is full or the message is invalid
+int can_tx_add(canTx *tx, const canTxMsg *msg);
+
+// wait for the next tick and send every message that is due in one sendmmsg()
+// returns frames sent, 0 if nothing was due or interrupted, -1 on error
+int can_tx_tick(canTx *tx);
+
+// run ticks until *run is cleared
+void can_tx_run(canTx *tx, volatile sig_atomic_t *run);
+
+void can_tx_report(const canTx *tx, FILE *fp);
+
+void can_tx_close(canTx *tx);
+
+#endif
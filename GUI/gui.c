@@ -20,11 +20,17 @@
 #include <glib.h>
 #include <gpiod.h>
 #include <errno.h>
+#include "Signal_Store.h"
+#include "Fan_Control.h"
+#include "Log_Hist.h"
+#include "Stream_Stats.h"
 
 // Constants for efficiency meter and GUI settings
 #define MAX_EFFICIENCY 100      // Maximum efficiency value (100%)
 #define UPDATE_INTERVAL 50      // Update interval in milliseconds
 #define GUI_SCALE_FACTOR 1.45   // Scaling factor for GUI elements
+#define LATENCY_FILE "latency.json" // Frame-to-pixel latency histograms, rewritten every LATENCY_INTERVAL
+#define LATENCY_INTERVAL 10     // Seconds between latency file updates
 
 // GPIO pin definitions
 #define GPIO_CHIP "gpiochip0"   // GPIO chip identifier
@@ -53,6 +59,7 @@ typedef struct {
     int battery_percent;        // Current battery percentage
     GtkWidget *battery_da;      // Drawing area for battery visualization
     int current_temp;           // Current temperature value
+    int fan_setpoint;           // Cabin fan setpoint set with the temp buttons
     guint temp_timeout_id;      // ID for temperature timeout
     struct gpiod_chip *chip;    // GPIO chip handle
     struct gpiod_line *line_temp_up;    // GPIO line for temp up
@@ -68,8 +75,77 @@ static gboolean temp_timeout_callback(gpointer user_data);
 static gboolean update_message(gpointer data);
 static gboolean gpio_event_handler(GIOChannel *source, GIOCondition condition, gpointer user_data);
 
+// Signal store shared with the calculation program, NULL until it is running
+static signalStore *signals = NULL;
+
+// Settings shared with the calculation program (fan setpoint), NULL if it could not be mapped
+static signalControl *control = NULL;
+
+// Kernel receive time of the value each widget currently shows, 0 = simulated value
+static uint64_t shown_ns[SIG_COUNT];
+
+// Age of the shown value (receive to paint) in microseconds, per signal
+static logHist paint_age[SIG_COUNT];
+
+// Records how old a signal's value is at the moment it is painted
+static void record_paint(signalId id) {
+    struct timespec now;
+    if (shown_ns[id] == 0) return;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+    hist_add(&paint_age[id], now_ns > shown_ns[id] ? (now_ns - shown_ns[id]) / 1000 : 0);
+}
+
+// Writes the latency histograms of every painted signal to LATENCY_FILE
+static gboolean write_latency(gpointer data) {
+    FILE *fp = fopen(LATENCY_FILE ".tmp", "w");
+    if (fp == NULL) return G_SOURCE_CONTINUE;
+    int first = 1;
+    fprintf(fp, "{\"unit\":\"us\",\"signals\":{");
+    for (int i = 0; i < SIG_COUNT; i++) {
+        if (paint_age[i].count == 0) continue;
+        fprintf(fp, "%s\"%s\":", first ? "" : ",", signal_store_name(i));
+        hist_print_json(fp, &paint_age[i]);
+        first = 0;
+    }
+    fprintf(fp, "}}\n");
+    fclose(fp);
+    rename(LATENCY_FILE ".tmp", LATENCY_FILE);
+    return G_SOURCE_CONTINUE;
+}
+
+// Maps the signal store, retrying at most once a second until the calculation program creates it
+static signalStore *get_signals() {
+    static GTimer *retry = NULL;
+    if (signals != NULL) return signals;
+    if (retry != NULL && g_timer_elapsed(retry, NULL) < 1.0) return NULL;
+    if (retry == NULL) retry = g_timer_new();
+    g_timer_reset(retry);
+    signals = signal_store_map(0);
+    return signals;
+}
+
+// Takes a consistent snapshot of every signal, FALSE if there is no live data
+// While the calculation program keeps the store busy the previous snapshot is shown again
+static gboolean get_snapshot(signalSnapshot *snap) {
+    static signalSnapshot last;
+    static gboolean have_last = FALSE;
+    signalStore *store = get_signals();
+    if (store == NULL) return FALSE;
+    if (signal_store_snapshot(store, &last) == 0) have_last = TRUE;
+    if (!have_last) return FALSE;
+    *snap = last;
+    return TRUE;
+}
+
 // Generates a random speed value between 28-33 km/h
 int get_speed() {
+    signalSnapshot snap;
+    if (get_snapshot(&snap) && snap.sig[SIG_SPEED].time_ns != 0) {
+        shown_ns[SIG_SPEED] = snap.sig[SIG_SPEED].time_ns;
+        return (int)lroundf(snap.sig[SIG_SPEED].value);
+    }
+    shown_ns[SIG_SPEED] = 0;
     int base_speed = rand() % 6 + 28;
     if (base_speed == 29) {
         return (rand() % 2 == 0) ? 28 : 30;
@@ -90,8 +166,12 @@ int get_battery() {
     return battery;
 }
 
-// Tracks lap number, incrementing every 10 seconds
+// Lap in progress from the calculation program's lap engine, simulated every 10 seconds without it
 int get_lap_number() {
+    signalSnapshot snap;
+    if (get_snapshot(&snap) && snap.sig[SIG_LAP_NUM].time_ns != 0) {
+        return (int)snap.sig[SIG_LAP_NUM].value;
+    }
     static int lap = 0;
     static GTimer *timer = NULL;
     if (timer == NULL) timer = g_timer_new();
@@ -102,8 +182,20 @@ int get_lap_number() {
     return lap;
 }
 
-// Returns a constant temperature value (placeholder)
-int get_temperature() { return 25; }
+// Cockpit temperature from the calculation program, constant placeholder without it
+int get_temperature() {
+    signalSnapshot snap;
+    if (get_snapshot(&snap) && snap.sig[SIG_DRV_TEMP].time_ns != 0) {
+        return (int)snap.sig[SIG_DRV_TEMP].raw;
+    }
+    return 25;
+}
+
+// Fan setpoint last set by the buttons (kept across restarts in the control object), default without one
+int get_fan_setpoint() {
+    int32_t mc = (control != NULL) ? atomic_load(&control->fan_setpoint_mc) : 0;
+    return (mc != 0) ? (int)(mc / 1000) : CONTROL_FAN_SETPOINT_C;
+}
 
 // Simulates current fuel efficiency with random fluctuations
 float get_current_fuel_efficiency() {
@@ -124,20 +216,31 @@ float get_current_fuel_efficiency() {
 
 // Calculates running average of fuel efficiency
 float get_average_fuel_efficiency() {
-    static float total = 0.0;
-    static int count = 0;
-    static float last_avg = 60.0;
+    static runStats avg;
+    float last_avg;
     float current = get_current_fuel_efficiency();
-    total += current;
-    count++;
-    last_avg = total / count;
+    run_stats_add(&avg, current);
+    last_avg = (float)run_stats_mean(&avg);
     if (last_avg < 40) last_avg = 40;
     if (last_avg > 70) last_avg = 70;
     return last_avg;
 }
 
-// Returns a static crew message (placeholder)
-const char* get_crew_message() { return "You are the leader!"; }
+// Returns the active crew message, NULL when there is none (no crew messages are received yet)
+const char* get_crew_message() { return NULL; }
+
+// Writes the estimated laps and distance left, FALSE until the calculation program has an estimate
+gboolean get_range_text(char *text, size_t size) {
+    signalSnapshot snap;
+    if (!get_snapshot(&snap) || snap.sig[SIG_RANGE_M].time_ns == 0) return FALSE;
+    float km = snap.sig[SIG_RANGE_M].value / 1000.0f;
+    if (snap.sig[SIG_LAPS_LEFT].time_ns != 0) {
+        snprintf(text, size, "%.1f laps / %.1f km left", snap.sig[SIG_LAPS_LEFT].value, km);
+    } else {
+        snprintf(text, size, "%.1f km left", km);
+    }
+    return TRUE;
+}
 
 // Simulates H2 alarm toggling every 5 seconds
 gboolean get_h2_alarm() {
@@ -163,14 +266,20 @@ void hide_cursor(GtkWidget *widget) {
     g_object_unref(invisible_cursor);
 }
 
-// Updates the speed label with current value
+// Updates the speed label with current value - label formats come from signals.dbc (GuiFormat)
 gboolean update_speed(AppData *data) {
     char speed_text[32];
-    snprintf(speed_text, sizeof(speed_text), "%d km/h", get_speed());
+    snprintf(speed_text, sizeof(speed_text), signal_store_info(SIG_SPEED)->format, (double) get_speed());
     gtk_label_set_text(data->speed_label, speed_text);
     return TRUE;
 }
 
+// Runs before the speed label paints itself
+static gboolean on_speed_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    record_paint(SIG_SPEED);
+    return FALSE;
+}
+
 // Updates battery level and triggers redraw
 gboolean update_battery(AppData *data) {
     int raw_battery = get_battery();
@@ -182,20 +291,32 @@ gboolean update_battery(AppData *data) {
     return TRUE;
 }
 
-// Updates lap number display
+// Updates lap number display, with the time of the last finished lap once there is one
 gboolean update_lap_number(AppData *data) {
-    char lap_text[32];
-    snprintf(lap_text, sizeof(lap_text), "#%d", get_lap_number());
+    char lap_text[48];
+    signalSnapshot snap;
+    int lap = get_lap_number();
+    if (get_snapshot(&snap) && snap.sig[SIG_LAP_TIME].time_ns != 0) {
+        int t = (int)lroundf(snap.sig[SIG_LAP_TIME].value);
+        snprintf(lap_text, sizeof(lap_text), "#%d  %d:%02d", lap, t / 60, t % 60);
+    } else {
+        snprintf(lap_text, sizeof(lap_text), "#%d", lap);
+    }
     gtk_label_set_text(data->lap_label, lap_text);
     return TRUE;
 }
 
-// Adjusts temperature based on GPIO input and sets timeout
+// Adjusts the fan setpoint based on GPIO input, shows it until the timeout puts the temperature back
 void adjust_temp(AppData *data, int delta) {
-    data->current_temp += delta;
-    data->current_temp = (data->current_temp < 0) ? 0 : data->current_temp;
+    data->fan_setpoint += delta;
+    data->fan_setpoint = (data->fan_setpoint < FAN_SETPOINT_MIN_C) ? FAN_SETPOINT_MIN_C : data->fan_setpoint;
+    data->fan_setpoint = (data->fan_setpoint > FAN_SETPOINT_MAX_C) ? FAN_SETPOINT_MAX_C : data->fan_setpoint;
+    if (control != NULL) {
+        atomic_store(&control->fan_setpoint_mc, data->fan_setpoint * 1000);
+        atomic_fetch_add(&control->fan_setpoint_seq, 1);
+    }
     char temp_text[16];
-    snprintf(temp_text, sizeof(temp_text), "%d°C", data->current_temp);
+    snprintf(temp_text, sizeof(temp_text), signal_store_info(SIG_FAN_SETPOINT)->format, (double) data->fan_setpoint);
     gtk_label_set_text(data->temp_label, temp_text);
     if (data->temp_timeout_id != 0) {
         g_source_remove(data->temp_timeout_id);
@@ -210,16 +331,20 @@ static gboolean temp_timeout_callback(gpointer user_data) {
     int current_temp = get_temperature();
     data->current_temp = current_temp;
     char temp_text[16];
-    snprintf(temp_text, sizeof(temp_text), "%d°C", current_temp);
+    snprintf(temp_text, sizeof(temp_text), signal_store_info(SIG_DRV_TEMP)->format, (double) current_temp);
     gtk_label_set_text(data->temp_label, temp_text);
     data->temp_timeout_id = 0;
     return G_SOURCE_REMOVE;
 }
 
-// Updates crew message display
+// Updates crew message display, the range estimate takes the slot while there is no crew message
 static gboolean update_message(gpointer data) {
     AppData *app_data = (AppData *)data;
+    char range_text[64];
     const char *message = get_crew_message();
+    if (message == NULL) {
+        message = get_range_text(range_text, sizeof(range_text)) ? range_text : "You are the leader!";
+    }
     gtk_label_set_text(app_data->crew_msg_label, message);
     return TRUE;
 }
@@ -402,6 +527,10 @@ static gboolean on_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
     cairo_stroke(cr);
     cairo_restore(cr);
 
+    record_paint(SIG_FUEL_EFF);
+    record_paint(SIG_FUEL_EFF_AVG);
+    record_paint(SIG_H2_ALARM);
+
     if (meter->h2_alarm) {
         cairo_set_source_rgb(cr, 1.0, 0.0, 0.0);
         cairo_set_line_width(cr, 4 * GUI_SCALE_FACTOR);
@@ -414,12 +543,24 @@ static gboolean on_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
 // Updates efficiency meter values and redraws
 static gboolean update_efficiency(gpointer data) {
     EfficiencyMeter *meter = (EfficiencyMeter *)data;
-    meter->current_efficiency = get_current_fuel_efficiency();
-    meter->average_efficiency = get_average_fuel_efficiency();
-    meter->h2_alarm = get_h2_alarm();
+    signalSnapshot snap;
+    if (get_snapshot(&snap) && snap.sig[SIG_FUEL_EFF].time_ns != 0) {
+        // all three values from the same snapshot
+        meter->current_efficiency = snap.sig[SIG_FUEL_EFF].value;
+        meter->average_efficiency = snap.sig[SIG_FUEL_EFF_AVG].value;
+        meter->h2_alarm = snap.sig[SIG_H2_ALARM].raw != 0;
+        shown_ns[SIG_FUEL_EFF] = snap.sig[SIG_FUEL_EFF].time_ns;
+        shown_ns[SIG_FUEL_EFF_AVG] = snap.sig[SIG_FUEL_EFF_AVG].time_ns;
+        shown_ns[SIG_H2_ALARM] = snap.sig[SIG_H2_ALARM].time_ns;
+    } else {
+        shown_ns[SIG_FUEL_EFF] = shown_ns[SIG_FUEL_EFF_AVG] = shown_ns[SIG_H2_ALARM] = 0;
+        meter->current_efficiency = get_current_fuel_efficiency();
+        meter->average_efficiency = get_average_fuel_efficiency();
+        meter->h2_alarm = get_h2_alarm();
+    }
     char current_text[32], average_text[32];
-    snprintf(current_text, sizeof(current_text), "Current: %.1f%%", meter->current_efficiency);
-    snprintf(average_text, sizeof(average_text), "Average: %.1f%%", meter->average_efficiency);
+    snprintf(current_text, sizeof(current_text), signal_store_info(SIG_FUEL_EFF)->format, meter->current_efficiency);
+    snprintf(average_text, sizeof(average_text), signal_store_info(SIG_FUEL_EFF_AVG)->format, meter->average_efficiency);
     gtk_label_set_text(meter->current_label, current_text);
     gtk_label_set_text(meter->average_label, average_text);
     gtk_widget_queue_draw(meter->drawing_area);
@@ -534,18 +675,22 @@ int main(int argc, char *argv[]) {
     data->efficiency_meter.average_label = GTK_LABEL(average_eff_label);
     data->battery_da = battery_da;
     data->battery_percent = get_battery();
+    control = signal_control_map();
     data->current_temp = get_temperature();
+    data->fan_setpoint = get_fan_setpoint();
     data->temp_timeout_id = 0;
 
     g_signal_connect(window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
     g_signal_connect(efficiency_drawing_area, "draw", G_CALLBACK(on_draw), &data->efficiency_meter);
     g_signal_connect(battery_da, "draw", G_CALLBACK(draw_battery), data);
+    g_signal_connect(speed_label, "draw", G_CALLBACK(on_speed_draw), NULL);
 
     g_timeout_add(1000, (GSourceFunc)update_speed, data);
     g_timeout_add(500, (GSourceFunc)update_battery, data);
     g_timeout_add(3000, (GSourceFunc)update_message, data);
     g_timeout_add(1000, (GSourceFunc)update_lap_number, data);
     g_timeout_add(UPDATE_INTERVAL, update_efficiency, &data->efficiency_meter);
+    g_timeout_add_seconds(LATENCY_INTERVAL, write_latency, NULL);
 
     g_signal_connect(window, "realize", G_CALLBACK(hide_cursor), NULL);
 
@@ -559,6 +704,9 @@ int main(int argc, char *argv[]) {
     if (data->line_ack) gpiod_line_release(data->line_ack);
     if (data->chip) gpiod_chip_close(data->chip);
 
+    write_latency(NULL);
+    signal_store_unmap(signals);
+    signal_control_unmap(control);
     g_free(data);
     return 0;
 }